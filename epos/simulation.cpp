@@ -0,0 +1,1002 @@
+////////////////////////////////////////////////////////////////////////////////
+//                                                                            //
+//  Copyright (c) 2019 Leonardo Consoni <leonardjc@protonmail.com>            //
+//                                                                            //
+//  This file is part of Signal-IO-EposCmd.                                   //
+//                                                                            //
+//  Signal-IO-EposCmd is free software: you can redistribute it and/or modify //
+//  it under the terms of the GNU Lesser General Public License as published  //
+//  by the Free Software Foundation, either version 3 of the License, or      //
+//  (at your option) any later version.                                       //
+//                                                                            //
+//  Signal-IO-EposCmd is distributed in the hope that it will be useful,      //
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of            //
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the              //
+//  GNU Lesser General Public License for more details.                       //
+//                                                                            //
+//  You should have received a copy of the GNU Lesser General Public License  //
+//  along with Signal-IO-EposCmd. If not, see <http://www.gnu.org/licenses/>. //
+//                                                                            //
+////////////////////////////////////////////////////////////////////////////////
+
+// Simulated EposCmd bus, replacing the vendor library for tests and development.
+// Every transaction costs a fixed bus time, and drives apply setpoints after a fixed
+// response delay. Both are read (in seconds) from the environment variables
+// EPOSCMD_SIMULATION_TRANSACTION_TIME and EPOSCMD_SIMULATION_RESPONSE_DELAY
+
+#include "epos/Definitions.h"
+#include "epos/simulation.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <map>
+#include <string>
+#include <set>
+#include <vector>
+#include <mutex>
+#include <thread>
+#include <chrono>
+#include <algorithm>
+
+#define DEFAULT_TRANSACTION_TIME 0.0002
+#define DEFAULT_RESPONSE_DELAY 0.001
+#define RECEIVE_QUEUE_LENGTH 256
+
+#define SIMULATION_ERROR_INVALID_HANDLE 0x10000008
+#define SIMULATION_ERROR_INVALID_NODE 0x10000009
+#define SIMULATION_ERROR_DEVICE_DISABLED 0x1000000A
+#define SIMULATION_ERROR_WRONG_MODE 0x1000000B
+#define SIMULATION_ERROR_OBJECT_NOT_FOUND 0x06020000
+#define SIMULATION_ERROR_INVALID_OUTPUT 0x1000000C
+#define SIMULATION_ERROR_CAN_TIMEOUT 0x1000000D
+
+#define STATUSWORD_INDEX 0x6041
+#define SYNC_COB_ID 0x080
+#define RPDO1_COB_ID_BASE 0x200
+#define RPDO4_COB_ID_BASE 0x500
+#define RPDO_COMMUNICATION_INDEX 0x1400
+#define RPDO_MAPPING_INDEX 0x1600
+#define TPDO_COMMUNICATION_INDEX 0x1800
+#define TPDO_MAPPING_INDEX 0x1A00
+#define TPDOS_NUMBER 4
+#define STATUSWORD_MAPPING ( ( STATUSWORD_INDEX << 16 ) | 16 )
+#define PDO_TRANSMISSION_ON_CHANGE 254
+#define PDO_COB_ID_INVALID 0x80000000
+#define SDO_REQUEST_COB_ID_BASE 0x600
+#define SDO_RESPONSE_COB_ID_BASE 0x580
+#define SDO_ABORT_TOGGLE 0x05030000
+#define SDO_ABORT_COMMAND 0x05040001
+#define STATUSWORD_OPERATION_ENABLED 0x0037
+#define STATUSWORD_SWITCH_ON_DISABLED 0x0040
+#define STATUSWORD_FAULT 0x0008
+#define STATUSWORD_TARGET_REACHED 0x0400
+
+// Segmented or block upload in progress on the node SDO server
+typedef struct SdoUpload
+{
+  bool isActive, isBlock;
+  std::vector<unsigned char> data;
+  size_t offset, blockOffset;
+  bool toggle;
+  unsigned char blockSize, lastSequence;
+  bool isLastSegmentSent;
+}
+SdoUpload;
+
+typedef struct SimulatedNode
+{
+  unsigned short state;
+  signed char operationMode;
+  double positionSetpoint, velocitySetpoint, currentSetpoint;
+  double lastSetpoints[ 3 ], setpointTimes[ 3 ];
+  double position, positionTime;
+  unsigned int positionWindow, velocityWindow;
+  double positionWindowTime, velocityWindowTime;
+  std::map<unsigned int, std::vector<unsigned char>> objects;
+  unsigned short digitalOutputs;
+  unsigned short analogOutputs[ 2 ];
+  bool isOperational;
+  double pdoSetpoints[ 3 ];
+  bool isPdoSetpointPending[ 3 ];
+  bool isStatusWordSent;
+  unsigned short sentStatusWord;
+  double statusWordTime;
+  SdoUpload sdoUpload;
+}
+SimulatedNode;
+
+// Fixed ring of received CAN frames, so that steady state traffic does not allocate
+typedef struct FrameQueue
+{
+  unsigned char frames[ RECEIVE_QUEUE_LENGTH ][ 8 ];
+  unsigned short lengths[ RECEIVE_QUEUE_LENGTH ];
+  size_t first, count;
+}
+FrameQueue;
+
+typedef struct SimulatedBus
+{
+  std::mutex lock;
+  std::string portName;
+  size_t usersCount;
+  unsigned int baudrate, timeout;
+  std::map<unsigned short, SimulatedNode> nodes;
+  std::map<unsigned short, FrameQueue> receivedFrames;
+}
+SimulatedBus;
+
+// Open buses, which all receive injected CAN frames. Devices opened on the same port share its bus (and handle)
+static std::set<SimulatedBus*> openBuses;
+static std::mutex openBusesLock;
+
+typedef struct SimulationClock
+{
+  double (*GetTime)( void* );
+  void (*Delay)( double, void* );
+  void* data;
+}
+SimulationClock;
+
+static SimulationClock simulationClock = { NULL, NULL, NULL };
+
+static double GetTime( void )
+{
+  if( simulationClock.GetTime != NULL ) return simulationClock.GetTime( simulationClock.data );
+  return std::chrono::duration<double>( std::chrono::steady_clock::now().time_since_epoch() ).count();
+}
+
+static void Delay( double duration )
+{
+  if( simulationClock.Delay != NULL ) simulationClock.Delay( duration, simulationClock.data );
+  else std::this_thread::sleep_for( std::chrono::duration<double>( duration ) );
+}
+
+void SetSimulationClock( double (*GetTime)( void* ), void (*Delay)( double, void* ), void* data )
+{
+  simulationClock.GetTime = GetTime;
+  simulationClock.Delay = Delay;
+  simulationClock.data = data;
+}
+
+static double GetEnvironmentTime( const char* variableName, double defaultValue )
+{
+  const char* value = getenv( variableName );
+  return ( value != NULL ) ? strtod( value, NULL ) : defaultValue;
+}
+
+static double transactionTime = GetEnvironmentTime( "EPOSCMD_SIMULATION_TRANSACTION_TIME", DEFAULT_TRANSACTION_TIME );
+static double responseDelay = GetEnvironmentTime( "EPOSCMD_SIMULATION_RESPONSE_DELAY", DEFAULT_RESPONSE_DELAY );
+
+static void SendStatusWordPdos( SimulatedBus* bus );
+
+// Holds the bus for one transaction and returns the addressed node (created on first access)
+static SimulatedNode* BeginTransaction( void* keyHandle, unsigned short nodeId, std::unique_lock<std::mutex>& lock, unsigned int* pErrorCode )
+{
+  if( keyHandle == NULL )
+  {
+    *pErrorCode = SIMULATION_ERROR_INVALID_HANDLE;
+    return NULL;
+  }
+
+  if( nodeId == 0 || nodeId > 127 )
+  {
+    *pErrorCode = SIMULATION_ERROR_INVALID_NODE;
+    return NULL;
+  }
+
+  SimulatedBus* bus = (SimulatedBus*) keyHandle;
+  lock = std::unique_lock<std::mutex>( bus->lock );
+  Delay( transactionTime );
+  SendStatusWordPdos( bus );
+
+  // EposCmd transactions use the same SDO server, replacing any raw transfer in progress
+  SimulatedNode* node = &(bus->nodes[ nodeId ]);
+  node->sdoUpload.isActive = false;
+  *pErrorCode = 0;
+  return node;
+}
+
+// Value actually applied by the drive: setpoints only take effect after the response delay
+static double GetAppliedSetpoint( SimulatedNode* node, int index, double setpoint )
+{
+  if( GetTime() - node->setpointTimes[ index ] < responseDelay ) return node->lastSetpoints[ index ];
+  return setpoint;
+}
+
+static void ChangeSetpoint( SimulatedNode* node, int index, double* ref_setpoint, double value )
+{
+  node->lastSetpoints[ index ] = GetAppliedSetpoint( node, index, *ref_setpoint );
+  node->setpointTimes[ index ] = GetTime();
+  *ref_setpoint = value;
+}
+
+static double GetActualVelocity( SimulatedNode* node )
+{
+  if( node->state != ST_ENABLED ) return 0.0;
+  if( node->operationMode != OMD_VELOCITY_MODE ) return 0.0;
+  return GetAppliedSetpoint( node, 1, node->velocitySetpoint );
+}
+
+static double GetActualPosition( SimulatedNode* node )
+{
+  double time = GetTime();
+  if( node->state == ST_ENABLED && node->operationMode == OMD_POSITION_MODE )
+    node->position = GetAppliedSetpoint( node, 0, node->positionSetpoint );
+  else if( node->positionTime > 0.0 )
+    node->position += GetActualVelocity( node ) * ( time - node->positionTime ) / 60.0;
+  node->positionTime = time;
+  return node->position;
+}
+
+static double GetActualCurrent( SimulatedNode* node )
+{
+  if( node->state != ST_ENABLED ) return 0.0;
+  if( node->operationMode != OMD_CURRENT_MODE ) return 0.0;
+  return GetAppliedSetpoint( node, 2, node->currentSetpoint );
+}
+
+void* VCS_OpenDevice( char* DeviceName, char* ProtocolStackName, char* InterfaceName, char* PortName, unsigned int* pErrorCode )
+{
+  std::lock_guard<std::mutex> lock( openBusesLock );
+  for( SimulatedBus* bus : openBuses )
+  {
+    if( bus->portName != PortName ) continue;
+    bus->usersCount++;
+    *pErrorCode = 0;
+    return bus;
+  }
+  
+  SimulatedBus* bus = new SimulatedBus;
+  bus->portName = PortName;
+  bus->usersCount = 1;
+  bus->baudrate = 1000000;
+  bus->timeout = 500;
+  openBuses.insert( bus );
+  *pErrorCode = 0;
+  return bus;
+}
+
+int VCS_CloseDevice( void* KeyHandle, unsigned int* pErrorCode )
+{
+  if( KeyHandle == NULL )
+  {
+    *pErrorCode = SIMULATION_ERROR_INVALID_HANDLE;
+    return 0;
+  }
+
+  SimulatedBus* bus = (SimulatedBus*) KeyHandle;
+  {
+    std::lock_guard<std::mutex> lock( openBusesLock );
+    if( --bus->usersCount > 0 ) 
+    {
+      *pErrorCode = 0;
+      return 1;
+    }
+    openBuses.erase( bus );
+  }
+  delete bus;
+  *pErrorCode = 0;
+  return 1;
+}
+
+int VCS_SetProtocolStackSettings( void* KeyHandle, unsigned int Baudrate, unsigned int Timeout, unsigned int* pErrorCode )
+{
+  if( KeyHandle == NULL )
+  {
+    *pErrorCode = SIMULATION_ERROR_INVALID_HANDLE;
+    return 0;
+  }
+
+  SimulatedBus* bus = (SimulatedBus*) KeyHandle;
+  std::lock_guard<std::mutex> lock( bus->lock );
+  bus->baudrate = Baudrate;
+  bus->timeout = Timeout;
+  *pErrorCode = 0;
+  return 1;
+}
+
+int VCS_GetProtocolStackSettings( void* KeyHandle, unsigned int* pBaudrate, unsigned int* pTimeout, unsigned int* pErrorCode )
+{
+  if( KeyHandle == NULL )
+  {
+    *pErrorCode = SIMULATION_ERROR_INVALID_HANDLE;
+    return 0;
+  }
+
+  SimulatedBus* bus = (SimulatedBus*) KeyHandle;
+  std::lock_guard<std::mutex> lock( bus->lock );
+  *pBaudrate = bus->baudrate;
+  *pTimeout = bus->timeout;
+  *pErrorCode = 0;
+  return 1;
+}
+
+int VCS_GetErrorInfo( unsigned int ErrorCodeValue, char* pErrorInfo, unsigned short MaxStrSize )
+{
+  const char* errorInfo = "Unknown error";
+  if( ErrorCodeValue == 0 ) errorInfo = "No error";
+  else if( ErrorCodeValue == SIMULATION_ERROR_INVALID_HANDLE ) errorInfo = "Simulation: invalid handle";
+  else if( ErrorCodeValue == SIMULATION_ERROR_INVALID_NODE ) errorInfo = "Simulation: invalid node id";
+  else if( ErrorCodeValue == SIMULATION_ERROR_DEVICE_DISABLED ) errorInfo = "Simulation: device disabled";
+  else if( ErrorCodeValue == SIMULATION_ERROR_WRONG_MODE ) errorInfo = "Simulation: wrong operation mode";
+  else if( ErrorCodeValue == SIMULATION_ERROR_OBJECT_NOT_FOUND ) errorInfo = "Simulation: object does not exist";
+  else if( ErrorCodeValue == SIMULATION_ERROR_INVALID_OUTPUT ) errorInfo = "Simulation: invalid output number";
+  else if( ErrorCodeValue == SIMULATION_ERROR_CAN_TIMEOUT ) errorInfo = "Simulation: no CAN frame received";
+  snprintf( pErrorInfo, MaxStrSize, "%s", errorInfo );
+  return 1;
+}
+
+int VCS_GetPositionIs( void* KeyHandle, unsigned short NodeId, int* pPositionIs, unsigned int* pErrorCode )
+{
+  std::unique_lock<std::mutex> lock;
+  SimulatedNode* node = BeginTransaction( KeyHandle, NodeId, lock, pErrorCode );
+  if( node == NULL ) return 0;
+  *pPositionIs = (int) GetActualPosition( node );
+  return 1;
+}
+
+int VCS_GetVelocityIs( void* KeyHandle, unsigned short NodeId, int* pVelocityIs, unsigned int* pErrorCode )
+{
+  std::unique_lock<std::mutex> lock;
+  SimulatedNode* node = BeginTransaction( KeyHandle, NodeId, lock, pErrorCode );
+  if( node == NULL ) return 0;
+  *pVelocityIs = (int) GetActualVelocity( node );
+  return 1;
+}
+
+int VCS_GetCurrentIs( void* KeyHandle, unsigned short NodeId, short* pCurrentIs, unsigned int* pErrorCode )
+{
+  std::unique_lock<std::mutex> lock;
+  SimulatedNode* node = BeginTransaction( KeyHandle, NodeId, lock, pErrorCode );
+  if( node == NULL ) return 0;
+  *pCurrentIs = (short) GetActualCurrent( node );
+  return 1;
+}
+
+int VCS_GetCurrentIsAveraged( void* KeyHandle, unsigned short NodeId, short* pCurrentIsAveraged, unsigned int* pErrorCode )
+{
+  return VCS_GetCurrentIs( KeyHandle, NodeId, pCurrentIsAveraged, pErrorCode );
+}
+
+static int SetSetpoint( void* KeyHandle, unsigned short NodeId, signed char mode, int index, double value, unsigned int* pErrorCode )
+{
+  std::unique_lock<std::mutex> lock;
+  SimulatedNode* node = BeginTransaction( KeyHandle, NodeId, lock, pErrorCode );
+  if( node == NULL ) return 0;
+  if( node->operationMode != mode )
+  {
+    *pErrorCode = SIMULATION_ERROR_WRONG_MODE;
+    return 0;
+  }
+  GetActualPosition( node );
+  double* setpoints[ 3 ] = { &(node->positionSetpoint), &(node->velocitySetpoint), &(node->currentSetpoint) };
+  ChangeSetpoint( node, index, setpoints[ index ], value );
+  return 1;
+}
+
+int VCS_SetPositionMust( void* KeyHandle, unsigned short NodeId, long PositionMust, unsigned int* pErrorCode )
+{
+  return SetSetpoint( KeyHandle, NodeId, OMD_POSITION_MODE, 0, (double) PositionMust, pErrorCode );
+}
+
+int VCS_SetVelocityMust( void* KeyHandle, unsigned short NodeId, long VelocityMust, unsigned int* pErrorCode )
+{
+  return SetSetpoint( KeyHandle, NodeId, OMD_VELOCITY_MODE, 1, (double) VelocityMust, pErrorCode );
+}
+
+int VCS_SetCurrentMust( void* KeyHandle, unsigned short NodeId, short CurrentMust, unsigned int* pErrorCode )
+{
+  return SetSetpoint( KeyHandle, NodeId, OMD_CURRENT_MODE, 2, (double) CurrentMust, pErrorCode );
+}
+
+int VCS_GetPositionMust( void* KeyHandle, unsigned short NodeId, long* pPositionMust, unsigned int* pErrorCode )
+{
+  std::unique_lock<std::mutex> lock;
+  SimulatedNode* node = BeginTransaction( KeyHandle, NodeId, lock, pErrorCode );
+  if( node == NULL ) return 0;
+  *pPositionMust = (long) node->positionSetpoint;
+  return 1;
+}
+
+int VCS_GetVelocityMust( void* KeyHandle, unsigned short NodeId, long* pVelocityMust, unsigned int* pErrorCode )
+{
+  std::unique_lock<std::mutex> lock;
+  SimulatedNode* node = BeginTransaction( KeyHandle, NodeId, lock, pErrorCode );
+  if( node == NULL ) return 0;
+  *pVelocityMust = (long) node->velocitySetpoint;
+  return 1;
+}
+
+int VCS_GetCurrentMust( void* KeyHandle, unsigned short NodeId, short* pCurrentMust, unsigned int* pErrorCode )
+{
+  std::unique_lock<std::mutex> lock;
+  SimulatedNode* node = BeginTransaction( KeyHandle, NodeId, lock, pErrorCode );
+  if( node == NULL ) return 0;
+  *pCurrentMust = (short) node->currentSetpoint;
+  return 1;
+}
+
+int VCS_GetState( void* KeyHandle, unsigned short NodeId, unsigned short* pState, unsigned int* pErrorCode )
+{
+  std::unique_lock<std::mutex> lock;
+  SimulatedNode* node = BeginTransaction( KeyHandle, NodeId, lock, pErrorCode );
+  if( node == NULL ) return 0;
+  *pState = node->state;
+  return 1;
+}
+
+int VCS_SetEnableState( void* KeyHandle, unsigned short NodeId, unsigned int* pErrorCode )
+{
+  std::unique_lock<std::mutex> lock;
+  SimulatedNode* node = BeginTransaction( KeyHandle, NodeId, lock, pErrorCode );
+  if( node == NULL ) return 0;
+  GetActualPosition( node );
+  if( node->state != ST_FAULT ) node->state = ST_ENABLED;
+  return ( node->state == ST_ENABLED ) ? 1 : 0;
+}
+
+int VCS_SetDisableState( void* KeyHandle, unsigned short NodeId, unsigned int* pErrorCode )
+{
+  std::unique_lock<std::mutex> lock;
+  SimulatedNode* node = BeginTransaction( KeyHandle, NodeId, lock, pErrorCode );
+  if( node == NULL ) return 0;
+  GetActualPosition( node );
+  if( node->state != ST_FAULT ) node->state = ST_DISABLED;
+  return 1;
+}
+
+int VCS_ClearFault( void* KeyHandle, unsigned short NodeId, unsigned int* pErrorCode )
+{
+  std::unique_lock<std::mutex> lock;
+  SimulatedNode* node = BeginTransaction( KeyHandle, NodeId, lock, pErrorCode );
+  if( node == NULL ) return 0;
+  if( node->state == ST_FAULT ) node->state = ST_DISABLED;
+  return 1;
+}
+
+int VCS_GetEnableState( void* KeyHandle, unsigned short NodeId, int* pIsEnabled, unsigned int* pErrorCode )
+{
+  std::unique_lock<std::mutex> lock;
+  SimulatedNode* node = BeginTransaction( KeyHandle, NodeId, lock, pErrorCode );
+  if( node == NULL ) return 0;
+  *pIsEnabled = ( node->state == ST_ENABLED ) ? 1 : 0;
+  return 1;
+}
+
+int VCS_GetFaultState( void* KeyHandle, unsigned short NodeId, int* pIsInFault, unsigned int* pErrorCode )
+{
+  std::unique_lock<std::mutex> lock;
+  SimulatedNode* node = BeginTransaction( KeyHandle, NodeId, lock, pErrorCode );
+  if( node == NULL ) return 0;
+  *pIsInFault = ( node->state == ST_FAULT ) ? 1 : 0;
+  return 1;
+}
+
+int VCS_SetOperationMode( void* KeyHandle, unsigned short NodeId, char OperationMode, unsigned int* pErrorCode )
+{
+  std::unique_lock<std::mutex> lock;
+  SimulatedNode* node = BeginTransaction( KeyHandle, NodeId, lock, pErrorCode );
+  if( node == NULL ) return 0;
+  GetActualPosition( node );
+  node->operationMode = (signed char) OperationMode;
+  node->positionSetpoint = node->position;
+  return 1;
+}
+
+int VCS_GetOperationMode( void* KeyHandle, unsigned short NodeId, char* pOperationMode, unsigned int* pErrorCode )
+{
+  std::unique_lock<std::mutex> lock;
+  SimulatedNode* node = BeginTransaction( KeyHandle, NodeId, lock, pErrorCode );
+  if( node == NULL ) return 0;
+  *pOperationMode = (char) node->operationMode;
+  return 1;
+}
+
+int VCS_EnablePositionWindow( void* KeyHandle, unsigned short NodeId, unsigned int PositionWindow, unsigned short PositionWindowTime, unsigned int* pErrorCode )
+{
+  std::unique_lock<std::mutex> lock;
+  SimulatedNode* node = BeginTransaction( KeyHandle, NodeId, lock, pErrorCode );
+  if( node == NULL ) return 0;
+  node->positionWindow = PositionWindow;
+  node->positionWindowTime = PositionWindowTime / 1000.0;
+  return 1;
+}
+
+int VCS_DisablePositionWindow( void* KeyHandle, unsigned short NodeId, unsigned int* pErrorCode )
+{
+  return VCS_EnablePositionWindow( KeyHandle, NodeId, 0, 0, pErrorCode );
+}
+
+int VCS_EnableVelocityWindow( void* KeyHandle, unsigned short NodeId, unsigned int VelocityWindow, unsigned short VelocityWindowTime, unsigned int* pErrorCode )
+{
+  std::unique_lock<std::mutex> lock;
+  SimulatedNode* node = BeginTransaction( KeyHandle, NodeId, lock, pErrorCode );
+  if( node == NULL ) return 0;
+  node->velocityWindow = VelocityWindow;
+  node->velocityWindowTime = VelocityWindowTime / 1000.0;
+  return 1;
+}
+
+int VCS_DisableVelocityWindow( void* KeyHandle, unsigned short NodeId, unsigned int* pErrorCode )
+{
+  return VCS_EnableVelocityWindow( KeyHandle, NodeId, 0, 0, pErrorCode );
+}
+
+// Simulated actual values jump to the setpoint after the response delay, so they enter 
+// the window at that moment, and the target is reached after the window time
+static bool IsTargetReached( SimulatedNode* node )
+{
+  if( node->state != ST_ENABLED ) return false;
+  
+  double time = GetTime();
+  if( node->operationMode == OMD_POSITION_MODE && node->positionWindow > 0 )
+    return ( time - node->setpointTimes[ 0 ] >= responseDelay + node->positionWindowTime );
+  if( node->operationMode == OMD_VELOCITY_MODE && node->velocityWindow > 0 )
+    return ( time - node->setpointTimes[ 1 ] >= responseDelay + node->velocityWindowTime );
+  
+  return false;
+}
+
+static unsigned short GetStatusWord( SimulatedNode* node )
+{
+  unsigned short statusWord = STATUSWORD_SWITCH_ON_DISABLED;
+  if( node->state == ST_ENABLED ) statusWord = STATUSWORD_OPERATION_ENABLED;
+  else if( node->state == ST_FAULT ) statusWord = STATUSWORD_FAULT;
+  if( IsTargetReached( node ) ) statusWord |= STATUSWORD_TARGET_REACHED;
+  return statusWord;
+}
+
+// Object dictionary: written entries are stored as raw bytes, and the status word is computed
+static bool GetObjectData( SimulatedNode* node, unsigned short index, unsigned char subIndex, std::vector<unsigned char>& ref_value )
+{
+  if( index == STATUSWORD_INDEX && subIndex == 0 )
+  {
+    unsigned short statusWord = GetStatusWord( node );
+    ref_value.assign( (unsigned char*) &statusWord, (unsigned char*) &statusWord + sizeof(statusWord) );
+    return true;
+  }
+  
+  std::map<unsigned int, std::vector<unsigned char>>::iterator object = node->objects.find( ( index << 8 ) | subIndex );
+  if( object == node->objects.end() ) return false;
+  ref_value = object->second;
+  return true;
+}
+
+int VCS_GetObject( void* KeyHandle, unsigned short NodeId, unsigned short ObjectIndex, unsigned char ObjectSubIndex, void* pData, unsigned int NbOfBytesToRead, unsigned int* pNbOfBytesRead, unsigned int* pErrorCode )
+{
+  std::unique_lock<std::mutex> lock;
+  SimulatedNode* node = BeginTransaction( KeyHandle, NodeId, lock, pErrorCode );
+  if( node == NULL ) return 0;
+  
+  // Reused per thread, as reads would otherwise allocate on every transaction
+  static thread_local std::vector<unsigned char> value;
+  if( !GetObjectData( node, ObjectIndex, ObjectSubIndex, value ) )
+  {
+    *pErrorCode = SIMULATION_ERROR_OBJECT_NOT_FOUND;
+    return 0;
+  }
+  
+  unsigned int bytesNumber = std::min( (unsigned int) value.size(), NbOfBytesToRead );
+  memcpy( pData, value.data(), bytesNumber );
+  if( pNbOfBytesRead != NULL ) *pNbOfBytesRead = bytesNumber;
+  return 1;
+}
+
+int VCS_SetObject( void* KeyHandle, unsigned short NodeId, unsigned short ObjectIndex, unsigned char ObjectSubIndex, void* pData, unsigned int NbOfBytesToWrite, unsigned int* pNbOfBytesWritten, unsigned int* pErrorCode )
+{
+  std::unique_lock<std::mutex> lock;
+  SimulatedNode* node = BeginTransaction( KeyHandle, NodeId, lock, pErrorCode );
+  if( node == NULL ) return 0;
+  
+  unsigned char* data = (unsigned char*) pData;
+  node->objects[ ( ObjectIndex << 8 ) | ObjectSubIndex ].assign( data, data + NbOfBytesToWrite );
+  if( pNbOfBytesWritten != NULL ) *pNbOfBytesWritten = NbOfBytesToWrite;
+  return 1;
+}
+
+int VCS_GetAllDigitalOutputs( void* KeyHandle, unsigned short NodeId, unsigned short* pOutputs, unsigned int* pErrorCode )
+{
+  std::unique_lock<std::mutex> lock;
+  SimulatedNode* node = BeginTransaction( KeyHandle, NodeId, lock, pErrorCode );
+  if( node == NULL ) return 0;
+  *pOutputs = node->digitalOutputs;
+  return 1;
+}
+
+int VCS_SetAllDigitalOutputs( void* KeyHandle, unsigned short NodeId, unsigned short Outputs, unsigned int* pErrorCode )
+{
+  std::unique_lock<std::mutex> lock;
+  SimulatedNode* node = BeginTransaction( KeyHandle, NodeId, lock, pErrorCode );
+  if( node == NULL ) return 0;
+  node->digitalOutputs = Outputs;
+  return 1;
+}
+
+int VCS_SetAnalogOutput( void* KeyHandle, unsigned short NodeId, unsigned short OutputNumber, unsigned short AnalogValue, unsigned int* pErrorCode )
+{
+  std::unique_lock<std::mutex> lock;
+  SimulatedNode* node = BeginTransaction( KeyHandle, NodeId, lock, pErrorCode );
+  if( node == NULL ) return 0;
+  if( OutputNumber < 1 || OutputNumber > 2 )
+  {
+    *pErrorCode = SIMULATION_ERROR_INVALID_OUTPUT;
+    return 0;
+  }
+  node->analogOutputs[ OutputNumber - 1 ] = AnalogValue;
+  return 1;
+}
+
+// Restoring defaults drops every written object
+int VCS_Restore( void* KeyHandle, unsigned short NodeId, unsigned int* pErrorCode )
+{
+  std::unique_lock<std::mutex> lock;
+  SimulatedNode* node = BeginTransaction( KeyHandle, NodeId, lock, pErrorCode );
+  if( node == NULL ) return 0;
+  node->objects.clear();
+  return 1;
+}
+
+// Only the current fault is logged in the simulated error history
+int VCS_GetNbOfDeviceError( void* KeyHandle, unsigned short NodeId, unsigned char* pNbDeviceError, unsigned int* pErrorCode )
+{
+  std::unique_lock<std::mutex> lock;
+  SimulatedNode* node = BeginTransaction( KeyHandle, NodeId, lock, pErrorCode );
+  if( node == NULL ) return 0;
+  *pNbDeviceError = ( node->state == ST_FAULT ) ? 1 : 0;
+  return 1;
+}
+
+int VCS_DefinePosition( void* KeyHandle, unsigned short NodeId, int HomePosition, unsigned int* pErrorCode )
+{
+  std::unique_lock<std::mutex> lock;
+  SimulatedNode* node = BeginTransaction( KeyHandle, NodeId, lock, pErrorCode );
+  if( node == NULL ) return 0;
+  GetActualPosition( node );
+  node->position = node->positionSetpoint = HomePosition;
+  return 1;
+}
+
+// Receive queues drop their oldest frames when full. Called with the bus lock held
+static void QueueFrame( SimulatedBus* bus, unsigned short cobId, const unsigned char* data, unsigned short length )
+{
+  FrameQueue& frames = bus->receivedFrames[ cobId ];
+  if( frames.count >= RECEIVE_QUEUE_LENGTH ) 
+  {
+    frames.first = ( frames.first + 1 ) % RECEIVE_QUEUE_LENGTH;
+    frames.count--;
+  }
+  size_t last = ( frames.first + frames.count ) % RECEIVE_QUEUE_LENGTH;
+  frames.lengths[ last ] = std::min( length, (unsigned short) sizeof(frames.frames[ last ]) );
+  memcpy( frames.frames[ last ], data, frames.lengths[ last ] );
+  frames.count++;
+}
+
+void InjectSimulatedCANFrame( unsigned short cobId, unsigned short length, const void* data )
+{
+  const unsigned char* frameData = (const unsigned char*) data;
+  std::lock_guard<std::mutex> lock( openBusesLock );
+  for( SimulatedBus* bus : openBuses )
+  {
+    std::lock_guard<std::mutex> busLock( bus->lock );
+    QueueFrame( bus, cobId, frameData, length );
+  }
+}
+
+void PowerCycleSimulatedNode( const char* portName, unsigned short nodeId )
+{
+  std::lock_guard<std::mutex> lock( openBusesLock );
+  for( SimulatedBus* bus : openBuses )
+  {
+    if( bus->portName != portName ) continue;
+    std::lock_guard<std::mutex> busLock( bus->lock );
+    bus->nodes.erase( nodeId );
+  }
+}
+
+// Receiving takes no bus time. Only frames already received are returned, oldest first, whatever the timeout
+int VCS_ReadCANFrame( void* KeyHandle, unsigned short CobID, unsigned short Length, void* pData, unsigned int Timeout, unsigned int* pErrorCode )
+{
+  if( KeyHandle == NULL )
+  {
+    *pErrorCode = SIMULATION_ERROR_INVALID_HANDLE;
+    return 0;
+  }
+
+  SimulatedBus* bus = (SimulatedBus*) KeyHandle;
+  std::lock_guard<std::mutex> lock( bus->lock );
+  SendStatusWordPdos( bus );
+  std::map<unsigned short, FrameQueue>::iterator frames = bus->receivedFrames.find( CobID );
+  if( frames == bus->receivedFrames.end() || frames->second.count == 0 )
+  {
+    *pErrorCode = SIMULATION_ERROR_CAN_TIMEOUT;
+    return 0;
+  }
+  FrameQueue& queue = frames->second;
+  memcpy( pData, queue.frames[ queue.first ], std::min( Length, queue.lengths[ queue.first ] ) );
+  queue.first = ( queue.first + 1 ) % RECEIVE_QUEUE_LENGTH;
+  queue.count--;
+  *pErrorCode = 0;
+  return 1;
+}
+
+int VCS_SendNMTService( void* KeyHandle, unsigned short NodeId, unsigned short CommandSpecifier, unsigned int* pErrorCode )
+{
+  if( KeyHandle == NULL )
+  {
+    *pErrorCode = SIMULATION_ERROR_INVALID_HANDLE;
+    return 0;
+  }
+
+  // Node ID 0 addresses every node on the bus
+  SimulatedBus* bus = (SimulatedBus*) KeyHandle;
+  std::lock_guard<std::mutex> lock( bus->lock );
+  Delay( transactionTime / 2 );
+  for( std::map<unsigned short, SimulatedNode>::iterator node = bus->nodes.begin(); node != bus->nodes.end(); node++ )
+  {
+    if( NodeId == 0 || node->first == NodeId ) node->second.isOperational = ( CommandSpecifier == NCS_START_REMOTE_NODE );
+  }
+  *pErrorCode = 0;
+  return 1;
+}
+
+static unsigned int GetObjectValue( SimulatedNode* node, unsigned short index, unsigned char subIndex )
+{
+  unsigned int value = 0;
+  std::map<unsigned int, std::vector<unsigned char>>::iterator object = node->objects.find( ( index << 8 ) | subIndex );
+  if( object != node->objects.end() ) memcpy( &value, object->second.data(), std::min( object->second.size(), sizeof(value) ) );
+  return value;
+}
+
+static void ApplyPdoSetpoint( SimulatedNode* node, int index, double value )
+{
+  const signed char SETPOINT_MODES[ 3 ] = { OMD_POSITION_MODE, OMD_VELOCITY_MODE, OMD_CURRENT_MODE };
+  if( node->operationMode != SETPOINT_MODES[ index ] ) return;
+  GetActualPosition( node );
+  double* setpoints[ 3 ] = { &(node->positionSetpoint), &(node->velocitySetpoint), &(node->currentSetpoint) };
+  ChangeSetpoint( node, index, setpoints[ index ], value );
+}
+
+// Operational nodes send the status word on change through any valid TPDO mapping it alone. The status is only 
+// computed at bus accesses, so a target reached bit set before a setpoint change, and set again since, is sent
+// cleared first, as the drive clears it at the change. Called with the bus lock held
+static void SendStatusWordPdos( SimulatedBus* bus )
+{
+  double time = GetTime();
+  for( std::map<unsigned short, SimulatedNode>::iterator nodeEntry = bus->nodes.begin(); nodeEntry != bus->nodes.end(); nodeEntry++ )
+  {
+    SimulatedNode* node = &(nodeEntry->second);
+    if( !node->isOperational ) continue;
+    
+    for( unsigned short pdoIndex = 0; pdoIndex < TPDOS_NUMBER; pdoIndex++ )
+    {
+      unsigned int cobId = GetObjectValue( node, TPDO_COMMUNICATION_INDEX + pdoIndex, 0x01 );
+      if( cobId == 0 || ( cobId & PDO_COB_ID_INVALID ) != 0 ) continue;
+      if( GetObjectValue( node, TPDO_MAPPING_INDEX + pdoIndex, 0x00 ) != 1 ) continue;
+      if( GetObjectValue( node, TPDO_MAPPING_INDEX + pdoIndex, 0x01 ) != STATUSWORD_MAPPING ) continue;
+      if( (unsigned char) GetObjectValue( node, TPDO_COMMUNICATION_INDEX + pdoIndex, 0x02 ) < PDO_TRANSMISSION_ON_CHANGE ) continue;
+      
+      unsigned short statusWord = GetStatusWord( node );
+      bool isSetpointChanged = false;
+      for( int index = 0; index < 3; index++ )
+        isSetpointChanged = isSetpointChanged || ( node->setpointTimes[ index ] >= node->statusWordTime && node->setpointTimes[ index ] > 0.0 );
+      if( node->isStatusWordSent && isSetpointChanged && ( node->sentStatusWord & STATUSWORD_TARGET_REACHED ) != 0 )
+      {
+        node->sentStatusWord &= ~STATUSWORD_TARGET_REACHED;
+        QueueFrame( bus, (unsigned short) ( cobId & 0x7FF ), (const unsigned char*) &(node->sentStatusWord), sizeof(node->sentStatusWord) );
+      }
+      if( !node->isStatusWordSent || statusWord != node->sentStatusWord )
+      {
+        node->sentStatusWord = statusWord;
+        node->isStatusWordSent = true;
+        QueueFrame( bus, (unsigned short) ( cobId & 0x7FF ), (const unsigned char*) &statusWord, sizeof(statusWord) );
+      }
+      break;
+    }
+    node->statusWordTime = time;
+  }
+}
+
+// Decodes an RPDO through its mapping to the setpoint objects of either EPOS2 modes or EPOS4 cyclic modes,
+// and applies it at once or, for synchronous PDOs, on the next SYNC frame
+static void ReceiveRpdo( SimulatedNode* node, unsigned short pdoIndex, unsigned short CobID, const unsigned char* data )
+{
+  unsigned int cobId = GetObjectValue( node, RPDO_COMMUNICATION_INDEX + pdoIndex, 0x01 );
+  if( !node->isOperational || ( cobId & PDO_COB_ID_INVALID ) != 0 || ( cobId & 0x7FF ) != CobID ) return;
+  if( GetObjectValue( node, RPDO_MAPPING_INDEX + pdoIndex, 0x00 ) < 1 ) return;
+  
+  unsigned int mapping = GetObjectValue( node, RPDO_MAPPING_INDEX + pdoIndex, 0x01 );
+  unsigned short objectIndex = (unsigned short) ( mapping >> 16 );
+  int index = -1;
+  if( objectIndex == 0x2062 || objectIndex == 0x607A ) index = 0;
+  else if( objectIndex == 0x206B || objectIndex == 0x60FF ) index = 1;
+  else if( objectIndex == 0x2030 || objectIndex == 0x6071 ) index = 2;
+  if( index < 0 ) return;
+  
+  unsigned int rawValue = 0;
+  for( unsigned int byteIndex = 0; byteIndex < ( mapping & 0xFF ) / 8 && byteIndex < 4; byteIndex++ )
+    rawValue |= (unsigned int) data[ byteIndex ] << ( 8 * byteIndex );
+  double value = ( ( mapping & 0xFF ) == 16 ) ? (double) (short) rawValue : (double) (int) rawValue;
+  
+  unsigned char transmissionType = (unsigned char) GetObjectValue( node, RPDO_COMMUNICATION_INDEX + pdoIndex, 0x02 );
+  if( transmissionType <= 240 )
+  {
+    node->pdoSetpoints[ index ] = value;
+    node->isPdoSetpointPending[ index ] = true;
+  }
+  else ApplyPdoSetpoint( node, index, value );
+}
+
+static void SendSdoAbort( SimulatedBus* bus, unsigned short nodeId, const unsigned char* request, unsigned int abortCode )
+{
+  unsigned char response[ 8 ] = { 0x80, request[ 1 ], request[ 2 ], request[ 3 ] };
+  memcpy( response + 4, &abortCode, sizeof(abortCode) );
+  QueueFrame( bus, SDO_RESPONSE_COB_ID_BASE + nodeId, response, 8 );
+  bus->nodes[ nodeId ].sdoUpload.isActive = false;
+}
+
+// Sends the next block of up to blockSize segments, the last one flagged
+static void SendSdoBlock( SimulatedBus* bus, unsigned short nodeId, SdoUpload* upload )
+{
+  upload->blockOffset = upload->offset;
+  for( unsigned char sequence = 1; sequence <= upload->blockSize && upload->offset < upload->data.size(); sequence++ )
+  {
+    unsigned char segment[ 8 ] = { sequence };
+    size_t segmentLength = std::min( (size_t) 7, upload->data.size() - upload->offset );
+    memcpy( segment + 1, upload->data.data() + upload->offset, segmentLength );
+    upload->offset += segmentLength;
+    upload->lastSequence = sequence;
+    if( upload->offset == upload->data.size() )
+    {
+      segment[ 0 ] |= 0x80;
+      upload->isLastSegmentSent = true;
+    }
+    QueueFrame( bus, SDO_RESPONSE_COB_ID_BASE + nodeId, segment, 8 );
+  }
+}
+
+// CiA 301 SDO server, for expedited, segmented and block uploads only (downloads go through VCS_SetObject())
+static void ServeSdoRequest( SimulatedBus* bus, unsigned short nodeId, const unsigned char* request )
+{
+  SimulatedNode* node = &(bus->nodes[ nodeId ]);
+  SdoUpload* upload = &(node->sdoUpload);
+  unsigned char response[ 8 ] = { 0 };
+  unsigned short responseCobId = SDO_RESPONSE_COB_ID_BASE + nodeId;
+  unsigned char command = request[ 0 ];
+  
+  if( command == 0x80 ) 
+  {
+    upload->isActive = false;
+    return;
+  }
+  
+  if( command == 0x40 || ( command & 0xE3 ) == 0xA0 )
+  {
+    std::vector<unsigned char> value;
+    if( !GetObjectData( node, request[ 1 ] | ( request[ 2 ] << 8 ), request[ 3 ], value ) ) 
+    {
+      SendSdoAbort( bus, nodeId, request, SIMULATION_ERROR_OBJECT_NOT_FOUND );
+      return;
+    }
+    memcpy( response + 1, request + 1, 3 );
+    if( command == 0x40 && value.size() <= 4 )
+    {
+      response[ 0 ] = 0x43 | ( ( 4 - value.size() ) << 2 );
+      memcpy( response + 4, value.data(), value.size() );
+      QueueFrame( bus, responseCobId, response, 8 );
+      return;
+    }
+    unsigned int size = (unsigned int) value.size();
+    response[ 0 ] = ( command == 0x40 ) ? 0x41 : 0xC2;
+    memcpy( response + 4, &size, sizeof(size) );
+    upload->isActive = true;
+    upload->isBlock = ( command != 0x40 );
+    upload->data = value;
+    upload->offset = 0;
+    upload->toggle = false;
+    upload->blockSize = std::max( (unsigned char) 1, std::min( request[ 4 ], (unsigned char) 127 ) );
+    upload->isLastSegmentSent = false;
+    QueueFrame( bus, responseCobId, response, 8 );
+    return;
+  }
+  
+  if( !upload->isActive )
+  {
+    SendSdoAbort( bus, nodeId, request, SDO_ABORT_COMMAND );
+    return;
+  }
+  
+  if( ( command & 0xEF ) == 0x60 && !upload->isBlock )
+  {
+    bool toggle = ( ( command & 0x10 ) != 0 );
+    if( toggle != upload->toggle )
+    {
+      SendSdoAbort( bus, nodeId, request, SDO_ABORT_TOGGLE );
+      return;
+    }
+    size_t segmentLength = std::min( (size_t) 7, upload->data.size() - upload->offset );
+    bool isLast = ( upload->offset + segmentLength == upload->data.size() );
+    response[ 0 ] = ( toggle ? 0x10 : 0x00 ) | ( ( 7 - segmentLength ) << 1 ) | ( isLast ? 0x01 : 0x00 );
+    memcpy( response + 1, upload->data.data() + upload->offset, segmentLength );
+    upload->offset += segmentLength;
+    upload->toggle = !upload->toggle;
+    upload->isActive = !isLast;
+    QueueFrame( bus, responseCobId, response, 8 );
+    return;
+  }
+  
+  if( command == 0xA3 && upload->isBlock )
+  {
+    SendSdoBlock( bus, nodeId, upload );
+    return;
+  }
+  
+  // Acknowledged segments move the transfer on, lost ones are sent again
+  if( command == 0xA2 && upload->isBlock )
+  {
+    unsigned char acknowledgedSequence = request[ 1 ];
+    upload->offset = std::min( upload->blockOffset + 7 * (size_t) acknowledgedSequence, upload->data.size() );
+    upload->blockSize = std::max( (unsigned char) 1, std::min( request[ 2 ], (unsigned char) 127 ) );
+    if( upload->isLastSegmentSent && acknowledgedSequence == upload->lastSequence )
+    {
+      size_t lastLength = upload->data.size() % 7;
+      if( lastLength == 0 && !upload->data.empty() ) lastLength = 7;
+      response[ 0 ] = 0xC1 | ( ( 7 - lastLength ) << 2 );
+      QueueFrame( bus, responseCobId, response, 8 );
+      return;
+    }
+    upload->isLastSegmentSent = false;
+    SendSdoBlock( bus, nodeId, upload );
+    return;
+  }
+  
+  if( command == 0xA1 && upload->isBlock )
+  {
+    upload->isActive = false;
+    return;
+  }
+  
+  SendSdoAbort( bus, nodeId, request, SDO_ABORT_COMMAND );
+}
+
+// A frame takes about half the time of a confirmed SDO transaction. Frames nobody consumes are dropped
+int VCS_SendCANFrame( void* KeyHandle, unsigned short CobID, unsigned short Length, void* pData, unsigned int* pErrorCode )
+{
+  if( KeyHandle == NULL )
+  {
+    *pErrorCode = SIMULATION_ERROR_INVALID_HANDLE;
+    return 0;
+  }
+
+  SimulatedBus* bus = (SimulatedBus*) KeyHandle;
+  std::lock_guard<std::mutex> lock( bus->lock );
+  Delay( transactionTime / 2 );
+  
+  unsigned char data[ 8 ] = { 0 };
+  memcpy( data, pData, std::min( (size_t) Length, sizeof(data) ) );
+  if( CobID == SYNC_COB_ID )
+  {
+    for( std::map<unsigned short, SimulatedNode>::iterator node = bus->nodes.begin(); node != bus->nodes.end(); node++ )
+    {
+      for( int index = 0; index < 3; index++ )
+      {
+        if( !node->second.isPdoSetpointPending[ index ] ) continue;
+        node->second.isPdoSetpointPending[ index ] = false;
+        ApplyPdoSetpoint( &(node->second), index, node->second.pdoSetpoints[ index ] );
+      }
+    }
+  }
+  else if( CobID > SDO_REQUEST_COB_ID_BASE && CobID < SDO_REQUEST_COB_ID_BASE + 0x80 )
+  {
+    ServeSdoRequest( bus, CobID - SDO_REQUEST_COB_ID_BASE, data );
+  }
+  else if( CobID >= RPDO1_COB_ID_BASE && CobID < RPDO4_COB_ID_BASE + 0x80 && ( CobID & 0x7F ) != 0 )
+  {
+    std::map<unsigned short, SimulatedNode>::iterator node = bus->nodes.find( CobID & 0x7F );
+    if( node != bus->nodes.end() ) ReceiveRpdo( &(node->second), ( CobID - RPDO1_COB_ID_BASE ) >> 8, CobID, data );
+  }
+  
+  *pErrorCode = 0;
+  return 1;
+}
@@ -0,0 +1,49 @@
+////////////////////////////////////////////////////////////////////////////////
+//                                                                            //
+//  Copyright (c) 2019 Leonardo Consoni <leonardjc@protonmail.com>            //
+//                                                                            //
+//  This file is part of Signal-IO-EposCmd.                                   //
+//                                                                            //
+//  Signal-IO-EposCmd is free software: you can redistribute it and/or modify //
+//  it under the terms of the GNU Lesser General Public License as published  //
+//  by the Free Software Foundation, either version 3 of the License, or      //
+//  (at your option) any later version.                                       //
+//                                                                            //
+//  Signal-IO-EposCmd is distributed in the hope that it will be useful,      //
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of            //
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the              //
+//  GNU Lesser General Public License for more details.                       //
+//                                                                            //
+//  You should have received a copy of the GNU Lesser General Public License  //
+//  along with Signal-IO-EposCmd. If not, see <http://www.gnu.org/licenses/>. //
+//                                                                            //
+////////////////////////////////////////////////////////////////////////////////
+
+// Controls of the simulated EposCmd bus, not present in the vendor library
+
+#ifndef EPOS_SIMULATION_H
+#define EPOS_SIMULATION_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Drives the simulation from an external (e.g. virtual) clock: GetTime( data ) returns seconds, and
+// Delay( duration, data ) is called instead of sleeping for each transaction time. Passing NULL
+// functions restores the system clock. Sharing the clock with the module's SetTimeSource() runs
+// module and bus in lock-step
+void SetSimulationClock( double (*GetTime)( void* ), void (*Delay)( double, void* ), void* data );
+
+// Delivers a CAN frame, as if sent by another bus master, to every open simulated bus, where it is queued
+// by COB-ID (oldest frames dropped past 256) until read by VCS_ReadCANFrame()
+void InjectSimulatedCANFrame( unsigned short cobId, unsigned short length, const void* data );
+
+// Powers the node of the open bus on port portName (e.g. "CAN0") down and up again: position, state and objects
+// go back to their initial values. Buses, and their nodes, only live while some device keeps their port open
+void PowerCycleSimulatedNode( const char* portName, unsigned short nodeId );
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // EPOS_SIMULATION_H
@@ -20,6 +20,7 @@
 //////////////////////////////////////////////////////////////////////////////// 
 
 #include "interface/signal_io.h"
+#include "signal_io_epos.h"
 
 #include "epos/Definitions.h"
 
@@ -27,29 +28,559 @@
 #include <string.h>
 
 #include <list>
+#include <vector>
+#include <map>
+#include <deque>
+#include <unordered_set>
 #include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <algorithm>
+#include <atomic>
+#include <new>
+
+#include <math.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+// Static tracepoints for perf/bpftrace (provider "signal_io_epos"), compiled to single nops
+#ifdef HAVE_SYS_SDT_H
+#include <sys/sdt.h>
+#define TRACEPOINT0( name ) DTRACE_PROBE( signal_io_epos, name )
+#define TRACEPOINT1( name, arg1 ) DTRACE_PROBE1( signal_io_epos, name, arg1 )
+#define TRACEPOINT2( name, arg1, arg2 ) DTRACE_PROBE2( signal_io_epos, name, arg1, arg2 )
+#define TRACEPOINT3( name, arg1, arg2, arg3 ) DTRACE_PROBE3( signal_io_epos, name, arg1, arg2, arg3 )
+#else
+#define TRACEPOINT0( name ) do {} while( 0 )
+#define TRACEPOINT1( name, arg1 ) do {} while( 0 )
+#define TRACEPOINT2( name, arg1, arg2 ) do {} while( 0 )
+#define TRACEPOINT3( name, arg1, arg2, arg3 ) do {} while( 0 )
+#endif
 
 #define ERROR_STRING_MAX_SIZE 128
 
+#define STATUSWORD_INDEX 0x6041
+#define STATUSWORD_TARGET_REACHED 0x0400
+#define CONFIGURATION_STRING_MAX_SIZE 256
+
+#define SYNC_COB_ID 0x080
+#define EMCY_COB_ID_BASE 0x080
+#define RPDO1_COB_ID_BASE 0x200
+#define RPDO_COMMUNICATION_INDEX 0x1400
+#define RPDO_MAPPING_INDEX 0x1600
+#define PDO_COB_ID_INVALID 0x80000000
+#define PDO_TRANSMISSION_SYNCHRONOUS 1
+#define PDO_TRANSMISSION_ASYNCHRONOUS 255
+#define SDO_REQUEST_COB_ID_BASE 0x600
+#define SDO_RESPONSE_COB_ID_BASE 0x580
+#define SDO_ABORT_COMMAND 0x05040001
+#define SDO_ABORT_TIMEOUT 0x05040000
+#define SDO_ABORT_OUT_OF_MEMORY 0x05040005
+#define SDO_BLOCK_SIZE 64
+#define UPLOAD_TIMEOUT 1.0
+#define DEFAULT_UPLOAD_FRAME_BUDGET 16
+#define TPDO1_COB_ID_BASE 0x180
+#define TPDO2_COB_ID_BASE 0x280
+#define TPDO4_COB_ID_BASE 0x480
+#define TPDO_COMMUNICATION_INDEX 0x1800
+#define TPDO_MAPPING_INDEX 0x1A00
+#define STATUSWORD_TPDO_NUMBER 4
+#define STATUSWORD_MAPPING ( ( STATUSWORD_INDEX << 16 ) | 16 )
+#define HEARTBEAT_COB_ID_BASE 0x700
+#define CAN_FRAME_MAX_LENGTH 8
+#define MONITOR_FRAMES_MAX_NUMBER 32
+
+#define WARM_START_PATH_MAX_LENGTH 512
+
 typedef void* HANDLE;
 typedef unsigned short WORD;
 typedef unsigned int DWORD;
 typedef int BOOL;
 
+#define LATENCY_PROBE_TIMEOUT 0.5
+
+typedef struct LatencyProbe
+{
+  int channel;
+  double amplitude, offset;
+  unsigned long remainingSteps;
+  double stepTime, stepFeedback, stepChange;
+  EposLatencyStats results;
+  unsigned long lostSteps;
+}
+LatencyProbe;
+
+typedef struct SetpointTrace
+{
+  int channel;
+  int nextStage;
+  double stageTimes[ SIGNAL_IO_EPOS_TRACE_STAGES_NUMBER ];
+  EposLatencyStats stages[ SIGNAL_IO_EPOS_TRACE_STAGES_NUMBER ];
+  unsigned long droppedTraces;
+}
+SetpointTrace;
+
+// Aggregate of the feedback reads taken in one rollup period
+typedef struct RollupBucket
+{
+  double startTime;
+  unsigned long samplesCount;
+  int minimums[ SIGNAL_IO_EPOS_INPUT_CHANNELS_NUMBER ];
+  int maximums[ SIGNAL_IO_EPOS_INPUT_CHANNELS_NUMBER ];
+  double sums[ SIGNAL_IO_EPOS_INPUT_CHANNELS_NUMBER ];
+}
+RollupBucket;
+
+// Fixed size ring of rollup buckets, the last one still being filled
+typedef struct InputRollup
+{
+  double period;
+  RollupBucket* buckets;
+  size_t length;
+  size_t bucketsCount;
+  size_t currentIndex;
+}
+InputRollup;
+
+// Ring buffer of feedback reads, kept as structure of arrays in the native EposCmd types,
+// which only get converted to double when read, plus coarser rollup tiers for long-term trends
+typedef struct InputHistory
+{
+  double* times;
+  int* positions;
+  int* velocities;
+  short* currents;
+  size_t length;
+  size_t samplesCount;
+  size_t nextIndex;
+  InputRollup rollups[ SIGNAL_IO_EPOS_ROLLUP_TIERS_NUMBER ];
+  std::mutex lock;
+}
+InputHistory;
+
+// Digital and analog output changes, coalesced until the next transfer cycle. Guarded by outputsLock
+typedef struct AuxiliaryOutputs
+{
+  WORD digitalStates, digitalMask;
+  WORD analogValues[ SIGNAL_IO_EPOS_ANALOG_OUTPUTS_NUMBER ];
+  bool isAnalogPending[ SIGNAL_IO_EPOS_ANALOG_OUTPUTS_NUMBER ];
+}
+AuxiliaryOutputs;
+
+typedef struct MonitorMapping
+{
+  WORD cobId;
+  unsigned int offset, size;
+}
+MonitorMapping;
+
+// Frame decoding state of a listen-only device. Mappings and status guarded by lock,
+// raw values only used by the transfer thread
+typedef struct ListenMonitor
+{
+  MonitorMapping mappings[ SIGNAL_IO_EPOS_INPUT_CHANNELS_NUMBER ];
+  EposMonitorStatus status;
+  int rawValues[ SIGNAL_IO_EPOS_INPUT_CHANNELS_NUMBER ];
+  std::mutex lock;
+}
+ListenMonitor;
+
+// Output channel whose setpoints go as RPDO frames. Guarded by outputsLock
+typedef struct SetpointPdo
+{
+  int channel;
+  unsigned int number;
+  WORD cobId;
+}
+SetpointPdo;
+
+enum { UPLOAD_PHASE_START, UPLOAD_PHASE_INITIATE, UPLOAD_PHASE_SEGMENT, UPLOAD_PHASE_BLOCK, UPLOAD_PHASE_BLOCK_END };
+
+// Raw SDO upload into a caller buffer, stepped by the transfer thread. Guarded by lock
+typedef struct ObjectUpload
+{
+  int state, phase;
+  bool isBlock;
+  WORD index;
+  unsigned char subIndex;
+  unsigned char* data;
+  unsigned int size, totalSize, bytesNumber;
+  bool toggle;
+  unsigned char sequenceNumber;
+  double requestTime;
+  DWORD abortCode;
+  std::mutex lock;
+}
+ObjectUpload;
+
+static void* AllocateMemory( size_t size );
+static void ReleaseMemory( void* memory );
+
+// Containers carved from the memory arena when set. As insertions cannot fail, their nodes go to the heap
+// once the arena is full, still counted as failed allocations
+template< typename T >
+struct ArenaAllocator
+{
+  typedef T value_type;
+  
+  ArenaAllocator() {}
+  template< typename U > ArenaAllocator( const ArenaAllocator<U>& ) {}
+  
+  T* allocate( size_t count )
+  {
+    void* memory = AllocateMemory( count * sizeof(T) );
+    if( memory == NULL ) memory = malloc( count * sizeof(T) );
+    if( memory == NULL ) throw std::bad_alloc();
+    return (T*) memory;
+  }
+  
+  void deallocate( T* memory, size_t ) { ReleaseMemory( memory ); }
+};
+
+template< typename T, typename U >
+bool operator==( const ArenaAllocator<T>&, const ArenaAllocator<U>& ) { return true; }
+template< typename T, typename U >
+bool operator!=( const ArenaAllocator<T>&, const ArenaAllocator<U>& ) { return false; }
+
+typedef std::vector<unsigned char, ArenaAllocator<unsigned char>> ObjectBytes;
+typedef std::map<unsigned int, ObjectBytes, std::less<unsigned int>, ArenaAllocator<std::pair<const unsigned int, ObjectBytes>>> ObjectCache;
+
+// Fields shared between consumer threads and the transfer thread without a common lock are atomic.
+// Allocated value-initialized (zeroed), as atomics rule out memset
 typedef struct DeviceData
 {
   HANDLE handle;
   WORD nodeId;
-  double inputValues[ 3 ];
-  double outputValues[ 3 ];
-  BOOL readStatus, writeStatus;
-  DWORD readErrorCode, writeErrorCode;
+  std::atomic<double> inputValues[ SIGNAL_IO_EPOS_INPUT_CHANNELS_NUMBER ];
+  std::atomic<double> inputTimes[ SIGNAL_IO_EPOS_INPUT_CHANNELS_NUMBER ];
+  int rawInputs[ SIGNAL_IO_EPOS_INPUT_CHANNELS_NUMBER ];  // Last values read, held by channels skipped for their rate
+  unsigned long readCyclesCount;
+  std::atomic<double> maxInputAges[ SIGNAL_IO_EPOS_INPUT_CHANNELS_NUMBER ];
+  std::atomic<double> fetchTimeouts[ SIGNAL_IO_EPOS_INPUT_CHANNELS_NUMBER ];
+  double outputValues[ SIGNAL_IO_EPOS_OUTPUT_CHANNELS_NUMBER ];
+  std::atomic<double> lastSetpoints[ SIGNAL_IO_EPOS_OUTPUT_CHANNELS_NUMBER ];
+  std::atomic<bool> isSetpointKnown[ SIGNAL_IO_EPOS_OUTPUT_CHANNELS_NUMBER ];
+  bool isOutputPending[ SIGNAL_IO_EPOS_OUTPUT_CHANNELS_NUMBER ];
+  double commandTime;
+  std::atomic<double> sentCommandTime;
+  EposLatencyStats commandFeedbackDelay;
+  LatencyProbe latencyProbe;
+  std::atomic<bool> isProbeActive;
+  SetpointTrace setpointTrace;
+  std::atomic<bool> isTraceActive;
+  std::atomic<BOOL> readStatus, writeStatus;
+  std::atomic<DWORD> readErrorCode, writeErrorCode;
+  std::atomic<bool> isFaulted;
+  bool isReadFaulted;
+  bool isFetchRequested;
+  unsigned int usersCount;
+  std::atomic<bool> isEnding;
+  std::atomic<bool> isTransferred;  // Still listed, and referenced, by the transfer thread
+  bool isAbandoned;
+  EposDeviceConfig config, pendingConfig;
+  std::atomic<bool> isConfigPending;
+  InputHistory inputHistory;
+  std::atomic<bool> areWindowsEnabled;
+  std::atomic<double> setpointSentTime;
+  double reachedSetpointTime, clearedSetpointTime;
+  EposEvent events[ SIGNAL_IO_EPOS_EVENTS_NUMBER ];
+  std::mutex eventsLock;
+  AuxiliaryOutputs auxiliaryOutputs;
+  std::atomic<WORD> digitalOutputs;
+  bool isDigitalOutputKnown;
+  std::atomic<BOOL> auxiliaryStatus;
+  bool isListenOnly;
+  bool isCANopen;
+  ListenMonitor monitor;
+  char configuration[ CONFIGURATION_STRING_MAX_SIZE ];
+  ObjectCache objectCache;
+  std::mutex objectCacheLock;
+  SetpointPdo setpointPdo;
+  std::atomic<bool> isSyncRequired;
+  ObjectUpload upload;
+  std::atomic<bool> isUploading;
 }
 DeviceData;
 
+#define ARENA_ALIGNMENT 64
+#define HUGE_PAGE_SIZE ( 2 * 1024 * 1024 )
+
+// Header of every arena block, one alignment unit long. Free blocks are linked in address order, so that
+// released neighbours merge back
+typedef struct ArenaBlock
+{
+  size_t size;
+  struct ArenaBlock* next;
+}
+ArenaBlock;
+
+// Preallocated region device data, rings and buffers are carved from, when set. Guarded by arenaLock
+typedef struct MemoryArena
+{
+  unsigned char* base;
+  ArenaBlock* freeBlocks;
+  EposArenaStats stats;
+}
+MemoryArena;
+
+MemoryArena memoryArena = {};
+std::mutex arenaLock;
+
+// Blocking operation queued for a bus command worker. Holds a reference on its device until run
+typedef struct DeviceCommand
+{
+  DeviceData* device;
+  EposCommand command;
+  ObjectBytes data;
+  void (*Complete)( bool, void* );
+  void* completionData;
+}
+DeviceCommand;
+
+// Runs the commands of one bus in submission order, leaving once none is left. Guarded by commandsLock.
+// A retired worker is no longer listed, and frees itself when leaving
+typedef struct CommandWorker
+{
+  std::deque<DeviceCommand, ArenaAllocator<DeviceCommand>> commands;
+  std::thread thread;
+  bool isActive, isRetired;
+}
+CommandWorker;
+
+std::map<HANDLE, CommandWorker*> commandWorkers;
+std::mutex commandsLock;
+
 std::thread readingThread;
 std::list<DeviceData*> runningDevices;
-volatile bool isRunning = false;
+std::mutex devicesLock;
+std::atomic<bool> isRunning( false );
+
+// Registered devices are the valid IDs. Each entry point holds its device registered until 
+// it returns, so that EndDevice() from another thread waits before freeing it. The transfer
+// thread holds its own reference while the device is in the running list
+std::unordered_set<DeviceData*> registeredDevices;
+std::mutex registryLock, lifecycleLock;
+std::condition_variable registryEvent;
+
+#define DEFAULT_SHUTDOWN_TIMEOUT 1.0
+
+std::atomic<double> shutdownTimeout( DEFAULT_SHUTDOWN_TIMEOUT );
+// Empty when warm start records are disabled. Guarded by configLock
+char warmStartDirectory[ WARM_START_PATH_MAX_LENGTH ] = "";
+// Drive object holding the power-up marker of warm start records, index 0 when disabled. Guarded by configLock
+WORD warmStartMarkerIndex = 0;
+unsigned char warmStartMarkerSubIndex = 0;
+size_t endingDevicesNumber = 0;
+
+typedef struct alignas( 64 ) CallCounter
+{
+  std::atomic<unsigned long> count;
+}
+CallCounter;
+
+CallCounter callCounters[ SIGNAL_IO_EPOS_CALLS_NUMBER ];
+
+static inline void CountCall( int call )
+{
+  callCounters[ call ].count.fetch_add( 1, std::memory_order_relaxed );
+}
+
+// Device IDs handed to callers, tracepoints and callbacks are the device data addresses
+static inline long int GetDeviceID( DeviceData* device )
+{
+  return (long int) device;
+}
+
+static DeviceData* AcquireDevice( long int deviceID )
+{
+  if( deviceID == SIGNAL_IO_DEVICE_INVALID_ID ) return NULL;
+  
+  DeviceData* device = (DeviceData*) deviceID;
+  
+  std::lock_guard<std::mutex> lock( registryLock );
+  if( registeredDevices.count( device ) == 0 ) return NULL;
+  device->usersCount++;
+  
+  return device;
+}
+
+static void CloseDevice( DeviceData* device );
+
+// Devices abandoned by a timed out EndDevice() are closed by their last user
+static void ReleaseDevice( DeviceData* device )
+{
+  {
+    std::lock_guard<std::mutex> lock( registryLock );
+    if( --device->usersCount > 0 ) return;
+    if( !device->isAbandoned )
+    {
+      registryEvent.notify_all();
+      return;
+    }
+  }
+  
+  CloseDevice( device );
+}
+
+class DeviceReference
+{
+public:
+  DeviceReference( long int deviceID ) : device( AcquireDevice( deviceID ) ) {}
+  ~DeviceReference() { if( device != NULL ) ReleaseDevice( device ); }
+  DeviceData* const device;
+};
+
+size_t pendingFetchesNumber = 0;
+std::mutex fetchLock;
+std::condition_variable fetchEvent, fetchRequestEvent;
+
+#define PHASE_LOCK_PROPORTIONAL_GAIN 0.2
+#define PHASE_LOCK_INTEGRAL_GAIN 0.02
+
+typedef struct TransferCycle
+{
+  std::atomic<double> period;
+  std::atomic<bool> isPhaseLocked;
+  double phaseLead;
+  std::atomic<double> phaseError, periodCorrection;
+  std::atomic<double> lastAccessTime;
+}
+TransferCycle;
+
+TransferCycle transferCycle = { { 0.0 }, { false }, 0.0, { 0.0 }, { 0.0 }, { 0.0 } };
+
+typedef struct CycleLayout
+{
+  int order;
+  bool isInterleaved;
+  void (*Compute)( long int, void* );
+  void* computeData;
+}
+CycleLayout;
+
+CycleLayout cycleLayout = { SIGNAL_IO_EPOS_CYCLE_IMMEDIATE_WRITES, false, NULL, NULL };
+std::mutex outputsLock;
+
+// Double-buffered configuration: updates only write the pending copies (guarded by configLock), 
+// which the transfer thread swaps in at the start of a cycle
+std::mutex configLock;
+EposCycleConfig pendingCycleConfig = { 0.0, false, 0.0, SIGNAL_IO_EPOS_CYCLE_IMMEDIATE_WRITES, false, NULL, NULL };
+std::atomic<bool> isCycleConfigPending( false );
+
+std::atomic<unsigned int> uploadFrameBudget( DEFAULT_UPLOAD_FRAME_BUDGET );
+
+std::atomic<unsigned long> setpointsCount( 0 );
+std::atomic<unsigned long> setpointTracingInterval( 0 );
+
+#define CAPTURE_FILE_PATH_MAX_LENGTH 256
+#define CAPTURE_TRANSFER_THREAD_ID 1
+#define CAPTURE_CONSUMER_THREAD_ID 2  // First one, each consumer thread getting the next
+
+typedef struct TraceSpan
+{
+  const char* name;
+  WORD nodeId;
+  int threadId;
+  double startTime, endTime;
+}
+TraceSpan;
+
+typedef struct CycleCapture
+{
+  std::atomic<bool> isActive;
+  TraceSpan* spans;
+  size_t maxSpansNumber;
+  std::atomic<size_t> spansCount;
+  std::atomic<unsigned int> writersCount;
+  bool isHandoffPending;
+  unsigned long remainingCycles;
+  char filePath[ CAPTURE_FILE_PATH_MAX_LENGTH ];
+  bool isWriterActive;
+}
+CycleCapture;
+
+// Guards the capture buffer handoff and writer, so that capture control never waits for a cycle.
+// The writer thread is detached, and signals its end through captureEvent
+CycleCapture cycleCapture;
+std::mutex captureLock;
+std::condition_variable captureEvent;
+
+// Transfer statistics and command feedback delays have their own lock, taken briefly by the transfer thread
+// to record samples, so that readers never wait for a cycle (and its bus transactions) to end
+EposTransferStats transferStats;
+std::mutex statsLock;
+// Counted by the transfer thread after the cycle, so kept apart from transferStats
+std::atomic<unsigned long> overrunsCount( 0 );
+thread_local bool isTransferThread = false;
+// Capture thread IDs of consumer threads, given on their first span
+thread_local int captureThreadId = 0;
+std::atomic<int> nextCaptureThreadId( CAPTURE_CONSUMER_THREAD_ID );
+
+#define VIRTUAL_CLOCK_POLLING_INTERVAL 0.001
+
+typedef struct TimeSource
+{
+  double (*GetTime)( void* );
+  void* data;
+}
+TimeSource;
+
+// Sources are published whole through an atomic pointer: a new one is written to the slot not in use
+TimeSource timeSourceSlots[ 2 ] = { { NULL, NULL }, { NULL, NULL } };
+std::atomic<const TimeSource*> timeSource( NULL );
+
+// Lock-step state of the transfer thread for virtual clocks (see GetTransferWaitState()), guarded by fetchLock
+typedef struct TransferWait
+{
+  bool isWaiting;
+  double deadline;
+  unsigned long count;
+}
+TransferWait;
+
+TransferWait transferWait = { false, 0.0, 0 };
+
+static double GetTime( void )
+{
+  const TimeSource* source = timeSource.load( std::memory_order_acquire );
+  if( source != NULL ) return source->GetTime( source->data );
+  return std::chrono::duration<double>( std::chrono::steady_clock::now().time_since_epoch() ).count();
+}
+
+// Waits for the condition or the deadline on the module clock. An injected clock may jump at any moment, 
+// so it is also checked on NotifyTimeChange() calls, or periodically as a fallback
+template< typename Predicate >
+static bool WaitUntil( std::condition_variable& event, std::unique_lock<std::mutex>& lock, double deadline, Predicate IsReady )
+{
+  if( timeSource.load( std::memory_order_acquire ) == NULL )
+  {
+    std::chrono::duration<double> deadlineTime( deadline );
+    std::chrono::steady_clock::time_point steadyDeadline( std::chrono::duration_cast<std::chrono::steady_clock::duration>( deadlineTime ) );
+    return event.wait_until( lock, steadyDeadline, IsReady );
+  }
+  
+  while( !IsReady() )
+  {
+    if( GetTime() >= deadline ) return false;
+    event.wait_for( lock, std::chrono::duration<double>( VIRTUAL_CLOCK_POLLING_INTERVAL ) );
+  }
+  
+  return true;
+}
+
+static void AddLatencySample( EposLatencyStats* stats, double latency )
+{
+  if( stats->count == 0 || latency < stats->minimum ) stats->minimum = latency;
+  if( stats->count == 0 || latency > stats->maximum ) stats->maximum = latency;
+  stats->mean += ( latency - stats->mean ) / ++stats->count;
+  
+  size_t binIndex = 0;
+  for( double binLimit = 2e-6; latency >= binLimit && binIndex < SIGNAL_IO_EPOS_LATENCY_BINS_NUMBER - 1; binLimit *= 2 )
+    binIndex++;
+  stats->bins[ binIndex ]++;
+}
 
 void PrintError( DWORD errorCode )
 {
@@ -59,11 +590,90 @@ void PrintError( DWORD errorCode )
 }
 
 static void AsyncTransfer( void );
+static bool UpdateCycleCapture( double cycleStartTime );
+static void RegisterConsumerAccess( void );
+
+// Spans are only timed while a capture is running, so start time 0 marks an untraced call
+static inline double StartSpan( void )
+{
+  return cycleCapture.isActive.load( std::memory_order_relaxed ) ? GetTime() : 0.0;
+}
+
+static void EndSpan( const char* name, WORD nodeId, double startTime )
+{
+  if( startTime == 0.0 ) return;
+  
+  double endTime = GetTime();
+  if( !isTransferThread && captureThreadId == 0 ) captureThreadId = nextCaptureThreadId.fetch_add( 1 );
+  
+  // Counted in before the capture is checked, so that its buffer is only handed off once no span is being written
+  cycleCapture.writersCount.fetch_add( 1 );
+  if( cycleCapture.isActive.load() )
+  {
+    size_t spanIndex = cycleCapture.spansCount.fetch_add( 1 );
+    if( spanIndex < cycleCapture.maxSpansNumber ) 
+    {
+      TraceSpan* span = &(cycleCapture.spans[ spanIndex ]);
+      span->name = name;
+      span->nodeId = nodeId;
+      span->threadId = isTransferThread ? CAPTURE_TRANSFER_THREAD_ID : captureThreadId;
+      span->startTime = startTime;
+      span->endTime = endTime;
+    }
+    else TRACEPOINT2( queue__overflow, "capture", spanIndex );
+  }
+  cycleCapture.writersCount.fetch_sub( 1 );
+}
+
+static inline double StartTransaction( const char* name, WORD nodeId )
+{
+  TRACEPOINT2( transaction__start, name, nodeId );
+  return StartSpan();
+}
+
+static inline void EndTransaction( const char* name, WORD nodeId, double startTime )
+{
+  TRACEPOINT2( transaction__end, name, nodeId );
+  EndSpan( name, nodeId, startTime );
+}
+static void StampSetpointTrace( DeviceData* device, int channel, int stage );
+static BOOL SendSetpoint( DeviceData* device, unsigned int channel, double value, DWORD* ref_errorCode );
+static double LimitSetpoint( DeviceData* device, unsigned int channel, double value );
+static void ReadTargetEvents( DeviceData* device );
+static bool MapStatusWordPdo( DeviceData* device, bool isEnabled );
+static bool StartRemoteNode( DeviceData* device );
+static void ReadMonitorFrames( DeviceData* device );
+static int DecodeFrameField( const unsigned char* frame, unsigned int offset, unsigned int size );
+static void SendSyncFrames( void );
+static void StepObjectUpload( DeviceData* device, unsigned int* ref_framesBudget );
+static void EndObjectUpload( DeviceData* device, int state, DWORD abortCode );
+static bool LockSdoServer( DeviceData* device, std::unique_lock<std::mutex>& ref_lock );
+static char GetChannelOperationMode( unsigned int channel );
+static void AcquireBusChannels( DeviceData** devices, const unsigned int* channels, const std::vector<size_t>* deviceIndexes, bool isConfirmed, char* ref_results );
+static void RunDeviceCommands( CommandWorker* worker );
+static bool RunDeviceCommand( const DeviceCommand* command );
+static void JoinCommandWorkers( void );
+static bool IsDeviceFaulted( DeviceData* device );
+static void ResetDevice( DeviceData* device );
+static bool EnableOutputChannel( DeviceData* device, unsigned int channel );
+static void DisableOutputChannel( DeviceData* device, unsigned int channel );
+static bool RestoreDeviceWarmStart( DeviceData* device );
+static bool WriteDeviceObject( DeviceData* device, unsigned short index, unsigned char subIndex, const void* data, unsigned int size );
+static bool RestoreDeviceParameters( DeviceData* device );
+static void WriteAuxiliaryOutputs( DeviceData* device );
+static void FreeInputHistory( InputHistory* history );
+static void UpdateInputRollup( InputRollup* rollup, double time, const int* values );
+static bool QueueCycleConfig( EposCycleConfig config );
+static bool QueueDeviceConfig( DeviceData* device, const EposDeviceConfig& config );
+static void ApplyPendingConfigs( void );
+static void SaveWarmStart( DeviceData* device );
+static bool GetWarmStartPath( const DeviceData* device, char* ref_path );
+static unsigned int GetWarmStartToken( const char* configuration, int position, unsigned int marker );
 
 
 DECLARE_MODULE_INTERFACE( SIGNAL_IO_INTERFACE );
 
-// String on the form "<device>:<protocol>:<interface>:<port>:<node_id>:<baudrate>"
+// String on the form "<device>:<protocol>:<interface>:<port>:<node_id>:<baudrate>[:listen]"
 // Configuration Options:
 // -Devices: EPOS, EPOS2, EPOS4
 // -Protocols: MAXON_RS232, MAXON SERIAL V2, CANopen
@@ -71,14 +681,32 @@ DECLARE_MODULE_INTERFACE( SIGNAL_IO_INTERFACE );
 // -Ports: COM1, COM2, ... USB0, USB1, ... CAN0, CAN1, ...
 // -Node IDs: 1, 2, 3, 4, ...
 // -Baudrates: Interface dependent
+// -listen: CAN only. Nodes driven by another master are monitored from received frames, without ever transmitting
 long int InitDevice( const char* configuration )
 {  
-  char* deviceName = strtok( (char*) configuration, ":" );
-  char* protocolName = strtok( NULL, ":" );
-  char* interfaceName = strtok( NULL, ":" );
-  char* portName = strtok( NULL, ":" );
-  unsigned short nodeId = (unsigned short) strtoul( strtok( NULL, ":" ), NULL, 0 );
-  unsigned int baudrate = (unsigned int) strtoul( strtok( NULL, ":" ), NULL, 0 );
+  CountCall( SIGNAL_IO_EPOS_CALL_INIT_DEVICE );
+  
+  if( configuration == NULL ) return SIGNAL_IO_DEVICE_INVALID_ID;
+  
+  // Parsed from a local copy with the reentrant strtok, as devices may be initialized concurrently
+  char configurationString[ CONFIGURATION_STRING_MAX_SIZE ];
+  strncpy( configurationString, configuration, CONFIGURATION_STRING_MAX_SIZE - 1 );
+  configurationString[ CONFIGURATION_STRING_MAX_SIZE - 1 ] = '\0';
+  char* parserState = NULL;
+  char* deviceName = strtok_r( configurationString, ":", &parserState );
+  char* protocolName = strtok_r( NULL, ":", &parserState );
+  char* interfaceName = strtok_r( NULL, ":", &parserState );
+  char* portName = strtok_r( NULL, ":", &parserState );
+  char* nodeIdString = strtok_r( NULL, ":", &parserState );
+  char* baudrateString = strtok_r( NULL, ":", &parserState );
+  char* optionString = strtok_r( NULL, ":", &parserState );
+  if( baudrateString == NULL || ( optionString != NULL && strcmp( optionString, "listen" ) != 0 ) )
+  {
+    fprintf( stderr, "error: invalid configuration string %s\n", configuration );
+    return SIGNAL_IO_DEVICE_INVALID_ID;
+  }
+  unsigned short nodeId = (unsigned short) strtoul( nodeIdString, NULL, 0 );
+  unsigned int baudrate = (unsigned int) strtoul( baudrateString, NULL, 0 );
   
   DWORD errorCode;
   HANDLE deviceHandle = VCS_OpenDevice( deviceName, protocolName, interfaceName, portName, &errorCode );
@@ -95,194 +723,3013 @@ long int InitDevice( const char* configuration )
     if( VCS_SetProtocolStackSettings( deviceHandle, baudrate, timeout, &errorCode ) == 0 )
     {
       PrintError( errorCode );
+      VCS_CloseDevice( deviceHandle, &errorCode );
       return SIGNAL_IO_DEVICE_INVALID_ID;
     }
   }
   
-  DeviceData* newDevice = new DeviceData;
+  void* deviceMemory = AllocateMemory( sizeof(DeviceData) );
+  if( deviceMemory == NULL )
+  {
+    fprintf( stderr, "error: memory arena exhausted by %s\n", configuration );
+    VCS_CloseDevice( deviceHandle, &errorCode );
+    return SIGNAL_IO_DEVICE_INVALID_ID;
+  }
+  DeviceData* newDevice = new (deviceMemory) DeviceData();
   newDevice->handle = deviceHandle;
   newDevice->nodeId = nodeId;
+  newDevice->readStatus = newDevice->writeStatus = newDevice->auxiliaryStatus = 1;
+  newDevice->latencyProbe.channel = -1;
+  newDevice->isProbeActive = false;
+  newDevice->setpointTrace.channel = -1;
+  newDevice->setpointPdo.channel = -1;
+  snprintf( newDevice->configuration, CONFIGURATION_STRING_MAX_SIZE, "%s", configuration );
+  newDevice->isListenOnly = ( optionString != NULL );
+  newDevice->isCANopen = ( strcmp( protocolName, "CANopen" ) == 0 );
+  newDevice->isTransferred = true;
+  if( newDevice->isListenOnly )
+  {
+    MonitorMapping* mappings = newDevice->monitor.mappings;
+    mappings[ 0 ].cobId = mappings[ 1 ].cobId = TPDO1_COB_ID_BASE + nodeId;
+    mappings[ 1 ].offset = 4;
+    mappings[ 0 ].size = mappings[ 1 ].size = 4;
+    mappings[ 2 ].cobId = TPDO2_COB_ID_BASE + nodeId;
+    mappings[ 2 ].size = 2;
+  }
+
+  std::lock_guard<std::mutex> lifecycleGuard( lifecycleLock );
+  bool isFirstDevice;
+  {
+    std::lock_guard<std::mutex> lock( devicesLock );
+    isFirstDevice = !isRunning;
+    runningDevices.push_back( newDevice );
+  }
+  if( isFirstDevice ) 
+  {
+    // A previous transfer thread stops by itself once its device list gets empty
+    if( readingThread.joinable() ) readingThread.join();
+    isRunning = true;
+    readingThread = std::thread( AsyncTransfer );
+  }
   
-  if( runningDevices.empty() ) readingThread = std::thread( AsyncTransfer );
-  runningDevices.push_back( newDevice );
+  std::lock_guard<std::mutex> lock( registryLock );
+  registeredDevices.insert( newDevice );
+  newDevice->usersCount++;
   
-  return (long int) newDevice;
+  return GetDeviceID( newDevice );
 }
 
 void EndDevice( long int deviceID )
 {
+  CountCall( SIGNAL_IO_EPOS_CALL_END_DEVICE );
+  
   if( deviceID == SIGNAL_IO_DEVICE_INVALID_ID ) return;
   
   DeviceData* device = (DeviceData*) deviceID;
   
-  DWORD errorCode;
-  if( VCS_CloseDevice( device->handle, &errorCode ) == 0 ) 
-    PrintError( errorCode );
+  // Unregistering first makes new calls fail. Calls in progress, including the transfer thread's, 
+  // stop at their next transaction boundary, and pending fetches are cancelled
+  {
+    std::lock_guard<std::mutex> lock( registryLock );
+    if( registeredDevices.erase( device ) == 0 ) return;
+    device->isEnding = true;
+  }
+  {
+    std::lock_guard<std::mutex> lock( fetchLock );
+    if( device->isFetchRequested ) pendingFetchesNumber--;
+    device->isFetchRequested = false;
+    endingDevicesNumber++;
+  }
+  fetchEvent.notify_all();
+  fetchRequestEvent.notify_all();
   
-  runningDevices.remove( device );
+  // A transaction blocked on the bus may outlast the shutdown timeout: its caller then closes the device
+  bool isAbandoned = false, isTransferBlocked = false;
+  {
+    std::unique_lock<std::mutex> lock( registryLock );
+    if( !WaitUntil( registryEvent, lock, GetTime() + shutdownTimeout.load(), [ device ]{ return device->usersCount == 0; } ) )
+    {
+      fprintf( stderr, "warning: device 0x%lx still busy at shutdown timeout, closing deferred\n", deviceID );
+      device->isAbandoned = isAbandoned = true;
+      // The transfer thread drops ending devices at every cycle start, so still listing this one means it is 
+      // blocked itself, and is not waited for either. Otherwise it stays joinable, for the last EndDevice()
+      isTransferBlocked = device->isTransferred;
+    }
+  }
   
-  if( runningDevices.empty() )
+  if( !isAbandoned )
   {
-    isRunning = false;
-    readingThread.join();
+    if( !device->isListenOnly ) SaveWarmStart( device );
+    CloseDevice( device );
   }
   
-  delete device;
+  std::lock_guard<std::mutex> lifecycleGuard( lifecycleLock );
+  if( isTransferBlocked && readingThread.joinable() ) readingThread.detach();
+  // Once the transfer thread released its last device it is already leaving
+  if( !isRunning && readingThread.joinable() ) readingThread.join();
+  
+  // Command workers and the capture writer only depend on the devices left, not on the transfer thread.
+  // New devices are registered under lifecycleLock, so none can show up meanwhile
+  {
+    std::lock_guard<std::mutex> lock( registryLock );
+    if( !registeredDevices.empty() ) return;
+  }
+  JoinCommandWorkers();
+  std::unique_lock<std::mutex> lock( captureLock );
+  if( !WaitUntil( captureEvent, lock, GetTime() + shutdownTimeout.load(), []{ return !cycleCapture.isWriterActive; } ) )
+    fprintf( stderr, "warning: capture file %s still being written at shutdown timeout\n", cycleCapture.filePath );
   
   return;
 }
 
-size_t GetMaxInputSamplesNumber( long int deviceID )
+bool SetShutdownTimeout( double timeout )
 {
-  return 1;
+  if( timeout < 0.0 ) return false;
+  
+  shutdownTimeout = timeout;
+  
+  return true;
 }
 
-size_t Read( long int deviceID, unsigned int channel, double* ref_value )
+bool SetMemoryArena( size_t size, bool useHugePages, bool lockPages )
 {
-  *ref_value = 0.0;
+  std::lock_guard<std::mutex> lock( arenaLock );
   
-  if( deviceID == SIGNAL_IO_DEVICE_INVALID_ID ) return 0;
+  // Blocks still in use would outlive their arena
+  if( memoryArena.stats.usedSize > 0 ) return false;
   
-  DeviceData* device = (DeviceData*) deviceID;
+  if( memoryArena.base != NULL ) munmap( memoryArena.base, memoryArena.stats.size );
+  memoryArena = {};
+  if( size == 0 ) return true;
   
-  if( device->readStatus == 0 ) 
+  size_t pageSize = (size_t) sysconf( _SC_PAGESIZE );
+  size_t mappedSize = ( ( size + pageSize - 1 ) / pageSize ) * pageSize;
+  void* base = MAP_FAILED;
+  if( useHugePages )
   {
-    PrintError( device->readErrorCode );
-    return 0;
+    size_t hugeMappedSize = ( ( size + HUGE_PAGE_SIZE - 1 ) / HUGE_PAGE_SIZE ) * HUGE_PAGE_SIZE;
+    base = mmap( NULL, hugeMappedSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0 );
+    if( base != MAP_FAILED ) 
+    {
+      mappedSize = hugeMappedSize;
+      memoryArena.stats.isHugePageBacked = true;
+    }
+  }
+  if( base == MAP_FAILED )
+  {
+    base = mmap( NULL, mappedSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0 );
+    if( base == MAP_FAILED ) 
+    {
+      fprintf( stderr, "error: cannot map a %zu bytes memory arena\n", mappedSize );
+      return false;
+    }
+    // Without reserved hugepages, transparent ones may still back the region
+    if( useHugePages ) madvise( base, mappedSize, MADV_HUGEPAGE );
   }
   
-  *ref_value = device->inputValues[ channel ];
-  
-  return 1;
-}
-
-bool HasError( long int deviceID )
-{
-  if( deviceID == SIGNAL_IO_DEVICE_INVALID_ID ) return true;
-
-  DeviceData* device = (DeviceData*) deviceID;
+  if( lockPages )
+  {
+    if( mlock( base, mappedSize ) != 0 )
+    {
+      fprintf( stderr, "error: cannot lock the memory arena pages (see RLIMIT_MEMLOCK)\n" );
+      munmap( base, mappedSize );
+      memoryArena.stats = {};
+      return false;
+    }
+    memoryArena.stats.isLocked = true;
+  }
   
-  WORD state;
-  DWORD errorCode;
-  if( VCS_GetState( device->handle, device->nodeId, &state, &errorCode ) == 0 )
-    PrintError( errorCode );
+  // Every page is faulted in here, so that carving blocks afterwards never faults
+  memset( base, 0, mappedSize );
   
-  if( state == ST_FAULT ) return true;
+  memoryArena.base = (unsigned char*) base;
+  memoryArena.freeBlocks = (ArenaBlock*) base;
+  memoryArena.freeBlocks->size = mappedSize;
+  memoryArena.freeBlocks->next = NULL;
+  memoryArena.stats.size = mappedSize;
   
-  return false;
+  return true;
 }
 
-void Reset( long int deviceID )
+bool GetMemoryArenaStats( EposArenaStats* ref_stats )
 {
-  if( deviceID == SIGNAL_IO_DEVICE_INVALID_ID ) return;
-
-  DeviceData* device = (DeviceData*) deviceID;
+  if( ref_stats == NULL ) return false;
   
-  DWORD errorCode;
-  if( VCS_ClearFault( device->handle, device->nodeId, &errorCode ) == 0 )
-    PrintError( errorCode );
-
-  return;
+  std::lock_guard<std::mutex> lock( arenaLock );
+  *ref_stats = memoryArena.stats;
+  
+  return true;
 }
 
-bool CheckInputChannel( long int deviceID, unsigned int channel )
+bool SetWarmStartDirectory( const char* directoryPath )
 {
-  if( deviceID == SIGNAL_IO_DEVICE_INVALID_ID ) return false;
+  if( directoryPath != NULL && strlen( directoryPath ) >= WARM_START_PATH_MAX_LENGTH - CONFIGURATION_STRING_MAX_SIZE - 8 ) return false;
   
-  if( channel > 2 ) return false;
+  std::lock_guard<std::mutex> lock( configLock );
+  strcpy( warmStartDirectory, ( directoryPath != NULL ) ? directoryPath : "" );
   
   return true;
 }
 
-bool Write( long int deviceID, unsigned int channel, double value )
+bool SetWarmStartMarker( unsigned short index, unsigned char subIndex )
 {
-  if( deviceID == SIGNAL_IO_DEVICE_INVALID_ID ) return false;
-  
-  DeviceData* device = (DeviceData*) deviceID;
-  
-  //device->outputValues[ channel ] = value;
-
-  BOOL status = 0;
-  DWORD errorCode;
-  if( channel == 0 ) status = VCS_SetPositionMust( device->handle, device->nodeId, (long) value, &errorCode );
-  else if( channel == 1 ) status = VCS_SetVelocityMust( device->handle, device->nodeId, (long) value, &errorCode );
-  else if( channel == 2 ) status = VCS_SetCurrentMust( device->handle, device->nodeId, (short) value, &errorCode );
-
-  //if( device->writeStatus == 0 ) 
-  if( status == 0 )
-  {
-    //PrintError( device->writeErrorCode );
-    PrintError( errorCode );
-    return false;
-  }
+  std::lock_guard<std::mutex> lock( configLock );
+  warmStartMarkerIndex = index;
+  warmStartMarkerSubIndex = subIndex;
   
   return true;
 }
 
-bool AcquireOutputChannel( long int deviceID, unsigned int channel )
+bool RestoreWarmStart( long int deviceID )
 {
+  DeviceReference deviceReference( deviceID );
+  DeviceData* device = deviceReference.device;
+  if( device == NULL ) return false;
+  
+  return RestoreDeviceWarmStart( device );
+}
+
+static bool RestoreDeviceWarmStart( DeviceData* device )
+{
+  std::unique_lock<std::mutex> sdoLock;
+  if( device->isListenOnly || !LockSdoServer( device, sdoLock ) ) return false;
+  
+  char filePath[ WARM_START_PATH_MAX_LENGTH ];
+  if( !GetWarmStartPath( device, filePath ) ) return false;
+  
+  // Records are single use: whatever happens next, a later start has to be preceded by a new clean shutdown
+  FILE* warmStartFile = fopen( filePath, "r" );
+  if( warmStartFile == NULL ) return false;
+  char configuration[ CONFIGURATION_STRING_MAX_SIZE ] = "";
+  int position = 0;
+  unsigned int token = 0, marker = 0;
+  bool isRecordValid = ( fgets( configuration, CONFIGURATION_STRING_MAX_SIZE, warmStartFile ) != NULL && fscanf( warmStartFile, "%d %x %x", &position, &marker, &token ) == 3 );
+  fclose( warmStartFile );
+  remove( filePath );
+  
+  configuration[ strcspn( configuration, "\n" ) ] = '\0';
+  if( !isRecordValid || strcmp( configuration, device->configuration ) != 0 ) return false;
+  if( token != GetWarmStartToken( configuration, position, marker ) ) return false;
+  
+  WORD markerIndex;
+  unsigned char markerSubIndex;
+  {
+    std::lock_guard<std::mutex> lock( configLock );
+    markerIndex = warmStartMarkerIndex;
+    markerSubIndex = warmStartMarkerSubIndex;
+  }
+  
+  DWORD errorCode;
+  double spanStartTime;
+  // A drive powered down since the record has its volatile marker back to the stored value
+  if( markerIndex != 0 )
+  {
+    unsigned int driveMarker = 0;
+    DWORD bytesNumber = 0;
+    spanStartTime = StartTransaction( "VCS_GetObject", device->nodeId );
+    BOOL status = VCS_GetObject( device->handle, device->nodeId, markerIndex, markerSubIndex, &driveMarker, sizeof(driveMarker), &bytesNumber, &errorCode );
+    EndTransaction( "VCS_GetObject", device->nodeId, spanStartTime );
+    if( status == 0 ) PrintError( errorCode );
+    if( status == 0 || marker == 0 || driveMarker != marker ) return false;
+  }
+  
+  // Logged errors (undervoltage included) or motion mean the axis may have been moved since the record
+  int isInFault = 1, velocity = 1;
+  unsigned char errorsNumber = 1;
+  spanStartTime = StartTransaction( "VCS_GetFaultState", device->nodeId );
+  BOOL status = VCS_GetFaultState( device->handle, device->nodeId, &isInFault, &errorCode );
+  EndTransaction( "VCS_GetFaultState", device->nodeId, spanStartTime );
+  if( status != 0 )
+  {
+    spanStartTime = StartTransaction( "VCS_GetNbOfDeviceError", device->nodeId );
+    status = VCS_GetNbOfDeviceError( device->handle, device->nodeId, &errorsNumber, &errorCode );
+    EndTransaction( "VCS_GetNbOfDeviceError", device->nodeId, spanStartTime );
+  }
+  if( status != 0 )
+  {
+    spanStartTime = StartTransaction( "VCS_GetVelocityIs", device->nodeId );
+    status = VCS_GetVelocityIs( device->handle, device->nodeId, &velocity, &errorCode );
+    EndTransaction( "VCS_GetVelocityIs", device->nodeId, spanStartTime );
+  }
+  if( status == 0 )
+  {
+    PrintError( errorCode );
+    return false;
+  }
+  if( isInFault != 0 || errorsNumber > 0 || velocity != 0 ) return false;
+  
+  spanStartTime = StartTransaction( "VCS_DefinePosition", device->nodeId );
+  status = VCS_DefinePosition( device->handle, device->nodeId, position, &errorCode );
+  EndTransaction( "VCS_DefinePosition", device->nodeId, spanStartTime );
+  if( status == 0 )
+  {
+    PrintError( errorCode );
+    return false;
+  }
+  
+  return true;
+}
+
+size_t GetMaxInputSamplesNumber( long int deviceID )
+{
+  CountCall( SIGNAL_IO_EPOS_CALL_GET_MAX_INPUT_SAMPLES_NUMBER );
+  
+  return 1;
+}
+
+size_t Read( long int deviceID, unsigned int channel, double* ref_value )
+{
+  CountCall( SIGNAL_IO_EPOS_CALL_READ );
+  
+  *ref_value = 0.0;
+  
+  if( deviceID == SIGNAL_IO_DEVICE_INVALID_ID ) return 0;
+  
+  if( channel >= SIGNAL_IO_EPOS_INPUT_CHANNELS_NUMBER ) return 0;
+  
+  DeviceReference deviceReference( deviceID );
+  DeviceData* device = deviceReference.device;
+  if( device == NULL ) return 0;
+  
+  TRACEPOINT2( read, deviceID, channel );
+  
+  RegisterConsumerAccess();
+  
+  // Feedback reads are deferred while a raw upload holds the drive SDO server, so cached values are stale
+  if( device->isUploading ) return 0;
+  
+  if( device->maxInputAges[ channel ] > 0.0 )
+  {
+    double requestTime = GetTime();
+    if( requestTime - device->inputTimes[ channel ] > device->maxInputAges[ channel ] )
+    {
+      std::unique_lock<std::mutex> lock( fetchLock );
+      if( !device->isFetchRequested ) pendingFetchesNumber++;
+      device->isFetchRequested = true;
+      TRACEPOINT2( fetch__request, deviceID, channel );
+      fetchRequestEvent.notify_one();
+      WaitUntil( fetchEvent, lock, requestTime + device->fetchTimeouts[ channel ], 
+                 [ device, channel, requestTime ]{ return device->inputTimes[ channel ] >= requestTime || device->isEnding || !isRunning; } );
+      bool isFetched = ( device->inputTimes[ channel ] >= requestTime );
+      lock.unlock();
+      {
+        std::lock_guard<std::mutex> statsGuard( statsLock );
+        AddLatencySample( &(transferStats.fetchLatencies), GetTime() - requestTime );
+        if( !isFetched ) transferStats.fetchTimeoutsCount++;
+      }
+      if( !isFetched ) return 0;
+    }
+  }
+  
+  if( device->readStatus == 0 ) 
+  {
+    PrintError( device->readErrorCode );
+    return 0;
+  }
+  
+  *ref_value = device->inputValues[ channel ];
+  
+  return 1;
+}
+
+const void* GetInputSnapshot( long int deviceID )
+{
+  DeviceReference deviceReference( deviceID );
+  DeviceData* device = deviceReference.device;
+  if( device == NULL ) return NULL;
+  
+  return device->inputValues;
+}
+
+bool SetInputChannelMaxAge( long int deviceID, unsigned int channel, double maxAge, double fetchTimeout )
+{
+  if( deviceID == SIGNAL_IO_DEVICE_INVALID_ID ) return false;
+  
+  if( channel >= SIGNAL_IO_EPOS_INPUT_CHANNELS_NUMBER ) return false;
+  
+  if( maxAge < 0.0 || fetchTimeout < 0.0 ) return false;
+  
+  DeviceReference deviceReference( deviceID );
+  DeviceData* device = deviceReference.device;
+  if( device == NULL ) return false;
+  
+  std::lock_guard<std::mutex> lock( configLock );
+  EposDeviceConfig config = device->pendingConfig;
+  config.maxInputAges[ channel ] = maxAge;
+  config.fetchTimeouts[ channel ] = fetchTimeout;
+  
+  return QueueDeviceConfig( device, config );
+}
+
+bool SetTransferCycle( double period, bool isPhaseLocked, double phaseLead )
+{
+  std::lock_guard<std::mutex> lock( configLock );
+  EposCycleConfig config = pendingCycleConfig;
+  config.period = period;
+  config.isPhaseLocked = isPhaseLocked;
+  config.phaseLead = phaseLead;
+  
+  return QueueCycleConfig( config );
+}
+
+bool GetTransferCyclePhase( double* ref_phaseError, double* ref_periodCorrection )
+{
+  if( !transferCycle.isPhaseLocked ) return false;
+  
+  if( ref_phaseError != NULL ) *ref_phaseError = transferCycle.phaseError;
+  if( ref_periodCorrection != NULL ) *ref_periodCorrection = transferCycle.periodCorrection;
+  
+  return true;
+}
+
+bool StartLatencyProbe( long int deviceID, unsigned int channel, double amplitude, unsigned long stepsNumber )
+{
+  if( deviceID == SIGNAL_IO_DEVICE_INVALID_ID ) return false;
+  
+  if( channel >= SIGNAL_IO_EPOS_OUTPUT_CHANNELS_NUMBER ) return false;
+  
+  if( amplitude == 0.0 || stepsNumber == 0 ) return false;
+  
+  DeviceReference deviceReference( deviceID );
+  DeviceData* device = deviceReference.device;
+  if( device == NULL || device->isListenOnly ) return false;
+  
+  // Offsets are added to the last setpoint, which would otherwise default to 0 (e.g. the position origin)
+  if( !device->isSetpointKnown[ channel ] ) return false;
+  
+  std::lock_guard<std::mutex> lock( outputsLock );
+  
+  if( device->latencyProbe.channel >= 0 ) return false;
+  
+  memset( &(device->latencyProbe), 0, sizeof(LatencyProbe) );
+  device->latencyProbe.amplitude = amplitude;
+  device->latencyProbe.remainingSteps = stepsNumber;
+  device->latencyProbe.channel = (int) channel;
+  device->isProbeActive = true;
+  
+  return true;
+}
+
+bool GetLatencyProbeResults( long int deviceID, EposLatencyStats* ref_stats, unsigned long* ref_lostSteps )
+{
+  DeviceReference deviceReference( deviceID );
+  DeviceData* device = deviceReference.device;
+  if( device == NULL ) return false;
+  
+  std::lock_guard<std::mutex> lock( outputsLock );
+  
+  if( ref_stats != NULL ) *ref_stats = device->latencyProbe.results;
+  if( ref_lostSteps != NULL ) *ref_lostSteps = device->latencyProbe.lostSteps;
+  
+  return ( device->latencyProbe.channel < 0 );
+}
+
+bool SetSetpointTracing( unsigned long interval )
+{
+  // Registered devices are the running ones not yet ended, listed without waiting for the transfer thread
+  std::lock_guard<std::mutex> lock( registryLock );
+  
+  setpointTracingInterval = interval;
+  
+  std::lock_guard<std::mutex> outputsGuard( outputsLock );
+  for( DeviceData* device : registeredDevices )
+  {
+    memset( &(device->setpointTrace), 0, sizeof(SetpointTrace) );
+    device->setpointTrace.channel = -1;
+    device->isTraceActive = false;
+  }
+  
+  return true;
+}
+
+bool GetSetpointTraceStats( long int deviceID, EposLatencyStats* ref_stages, unsigned long* ref_droppedTraces )
+{
+  DeviceReference deviceReference( deviceID );
+  DeviceData* device = deviceReference.device;
+  if( device == NULL ) return false;
+  
+  std::lock_guard<std::mutex> lock( outputsLock );
+  
+  if( ref_stages != NULL ) memcpy( ref_stages, device->setpointTrace.stages, sizeof(device->setpointTrace.stages) );
+  if( ref_droppedTraces != NULL ) *ref_droppedTraces = device->setpointTrace.droppedTraces;
+  
+  return true;
+}
+
+bool StartCycleCapture( unsigned long cyclesNumber, size_t maxSpansNumber, const char* filePath )
+{
+  if( cyclesNumber == 0 || maxSpansNumber == 0 || filePath == NULL ) return false;
+  
+  if( strlen( filePath ) >= CAPTURE_FILE_PATH_MAX_LENGTH ) return false;
+  
+  std::lock_guard<std::mutex> lock( captureLock );
+  
+  if( cycleCapture.isActive.load() || cycleCapture.isHandoffPending || cycleCapture.isWriterActive || !isRunning ) return false;
+  
+  // Preallocated and touched up front, so that recording never faults nor allocates
+  cycleCapture.spans = (TraceSpan*) AllocateMemory( maxSpansNumber * sizeof(TraceSpan) );
+  if( cycleCapture.spans == NULL ) return false;
+  memset( cycleCapture.spans, 0, maxSpansNumber * sizeof(TraceSpan) );
+  cycleCapture.maxSpansNumber = maxSpansNumber;
+  cycleCapture.spansCount.store( 0 );
+  cycleCapture.remainingCycles = cyclesNumber;
+  strcpy( cycleCapture.filePath, filePath );
+  cycleCapture.isActive.store( true );
+  
+  return true;
+}
+
+bool IsCycleCaptureDone( void )
+{
+  std::lock_guard<std::mutex> lock( captureLock );
+  
+  return !( cycleCapture.isActive.load() || cycleCapture.isHandoffPending || cycleCapture.isWriterActive );
+}
+
+bool GetTransferStats( EposTransferStats* ref_stats, bool reset )
+{
+  if( ref_stats == NULL ) return false;
+  
+  std::lock_guard<std::mutex> lock( statsLock );
+  
+  *ref_stats = transferStats;
+  ref_stats->overrunsCount = reset ? overrunsCount.exchange( 0 ) : overrunsCount.load();
+  if( reset ) memset( &transferStats, 0, sizeof(EposTransferStats) );
+  
+  return true;
+}
+
+bool SetTimeSource( double (*GetTime)( void* ), void* data )
+{
+  std::lock_guard<std::mutex> lock( devicesLock );
+  
+  // Swapping clocks under running devices would mix timestamps from both
+  if( !runningDevices.empty() ) return false;
+  
+  TimeSource* source = ( timeSource.load() == &(timeSourceSlots[ 0 ]) ) ? &(timeSourceSlots[ 1 ]) : &(timeSourceSlots[ 0 ]);
+  source->GetTime = GetTime;
+  source->data = data;
+  timeSource.store( ( GetTime != NULL ) ? source : NULL, std::memory_order_release );
+  
+  return true;
+}
+
+bool GetTransferWaitState( double* ref_deadline, unsigned long* ref_waitsCount )
+{
+  if( ref_deadline == NULL || ref_waitsCount == NULL ) return false;
+  
+  std::lock_guard<std::mutex> lock( fetchLock );
+  
+  if( !isRunning )
+  {
+    *ref_deadline = HUGE_VAL;
+    *ref_waitsCount = transferWait.count;
+    return true;
+  }
+  
+  if( !transferWait.isWaiting ) return false;
+  
+  *ref_deadline = transferWait.deadline;
+  *ref_waitsCount = transferWait.count;
+  
+  return true;
+}
+
+void NotifyTimeChange( void )
+{
+  {
+    std::lock_guard<std::mutex> lock( fetchLock );
+  }
+  fetchEvent.notify_all();
+  fetchRequestEvent.notify_all();
+  {
+    std::lock_guard<std::mutex> lock( registryLock );
+  }
+  registryEvent.notify_all();
+}
+
+bool GetCallCounts( unsigned long* ref_counts )
+{
+  if( ref_counts == NULL ) return false;
+  
+  for( int call = 0; call < SIGNAL_IO_EPOS_CALLS_NUMBER; call++ )
+    ref_counts[ call ] = callCounters[ call ].count.load();
+  
+  return true;
+}
+
+bool HasError( long int deviceID )
+{
+  CountCall( SIGNAL_IO_EPOS_CALL_HAS_ERROR );
+  
+  if( deviceID == SIGNAL_IO_DEVICE_INVALID_ID ) return true;
+
+  DeviceReference deviceReference( deviceID );
+  DeviceData* device = deviceReference.device;
+  if( device == NULL ) return true;
+  
+  return IsDeviceFaulted( device );
+}
+
+static bool IsDeviceFaulted( DeviceData* device )
+{
+  // Listen-only devices only know the faults their nodes broadcast, and uploading ones the last one read
+  std::unique_lock<std::mutex> sdoLock;
+  if( device->isListenOnly || !LockSdoServer( device, sdoLock ) ) return device->isFaulted;
+  
+  WORD state = ST_DISABLED;
+  DWORD errorCode;
+  double spanStartTime = StartTransaction( "VCS_GetState", device->nodeId );
+  if( VCS_GetState( device->handle, device->nodeId, &state, &errorCode ) == 0 )
+    PrintError( errorCode );
+  EndTransaction( "VCS_GetState", device->nodeId, spanStartTime );
+  
+  bool isFaulted = ( state == ST_FAULT );
+  if( device->isFaulted.exchange( isFaulted ) != isFaulted ) TRACEPOINT2( fault, GetDeviceID( device ), isFaulted );
+  
+  return isFaulted;
+}
+
+void Reset( long int deviceID )
+{
+  CountCall( SIGNAL_IO_EPOS_CALL_RESET );
+  
+  if( deviceID == SIGNAL_IO_DEVICE_INVALID_ID ) return;
+
+  DeviceReference deviceReference( deviceID );
+  DeviceData* device = deviceReference.device;
+  if( device == NULL ) return;
+  
+  ResetDevice( device );
+  
+  return;
+}
+
+static void ResetDevice( DeviceData* device )
+{
+  std::unique_lock<std::mutex> sdoLock;
+  if( device->isListenOnly || !LockSdoServer( device, sdoLock ) ) return;
+  
+  // A reset may come with reconfiguration of the drive
+  {
+    std::lock_guard<std::mutex> lock( device->objectCacheLock );
+    device->objectCache.clear();
+  }
+  
+  DWORD errorCode;
+  double spanStartTime = StartTransaction( "VCS_ClearFault", device->nodeId );
+  if( VCS_ClearFault( device->handle, device->nodeId, &errorCode ) == 0 )
+    PrintError( errorCode );
+  EndTransaction( "VCS_ClearFault", device->nodeId, spanStartTime );
+
+  return;
+}
+
+bool CheckInputChannel( long int deviceID, unsigned int channel )
+{
+  CountCall( SIGNAL_IO_EPOS_CALL_CHECK_INPUT_CHANNEL );
+  
+  if( deviceID == SIGNAL_IO_DEVICE_INVALID_ID ) return false;
+  
+  if( channel >= SIGNAL_IO_EPOS_INPUT_CHANNELS_NUMBER ) return false;
+  
+  return true;
+}
+
+bool Write( long int deviceID, unsigned int channel, double value )
+{
+  CountCall( SIGNAL_IO_EPOS_CALL_WRITE );
+  
+  if( deviceID == SIGNAL_IO_DEVICE_INVALID_ID ) return false;
+  
+  if( channel >= SIGNAL_IO_EPOS_OUTPUT_CHANNELS_NUMBER ) return false;
+  
+  DeviceReference deviceReference( deviceID );
+  DeviceData* device = deviceReference.device;
+  if( device == NULL ) return false;
+  
+  if( device->isListenOnly ) return false;
+  
+  TRACEPOINT2( write, deviceID, channel );
+  
+  RegisterConsumerAccess();
+  
+  // Only one setpoint out of each tracing interval gets its lifecycle stamped
+  bool isTraced = false;
+  double entryTime = 0.0;
+  unsigned long tracingInterval = setpointTracingInterval.load( std::memory_order_relaxed );
+  if( tracingInterval > 0 && ( setpointsCount++ % tracingInterval ) == 0 )
+  {
+    entryTime = GetTime();
+    isTraced = true;
+  }
+  
+  // Setpoints keep the probe perturbation superimposed while it runs
+  device->lastSetpoints[ channel ] = value;
+  device->isSetpointKnown[ channel ] = true;
+  std::unique_lock<std::mutex> lock( outputsLock );
+  if( device->latencyProbe.channel == (int) channel ) value += device->latencyProbe.offset;
+  value = LimitSetpoint( device, channel, value );
+  
+  // Buffered layouts leave the setpoint for the transfer thread, reporting the last transmission status. So do setpoints
+  // mapped to a PDO, whose frames are only sent by the transfer thread, to be latched by the SYNC of the same cycle
+  if( cycleLayout.order != SIGNAL_IO_EPOS_CYCLE_IMMEDIATE_WRITES || device->setpointPdo.channel == (int) channel )
+  {
+    SetpointTrace* trace = &(device->setpointTrace);
+    // A traced setpoint overwritten before transmission never reaches the drive
+    if( trace->channel == (int) channel && trace->nextStage == SIGNAL_IO_EPOS_TRACE_DEQUEUE )
+    {
+      trace->channel = -1;
+      trace->droppedTraces++;
+      device->isTraceActive = false;
+    }
+    if( isTraced && trace->channel < 0 )
+    {
+      trace->channel = (int) channel;
+      device->isTraceActive = true;
+      trace->stageTimes[ SIGNAL_IO_EPOS_TRACE_ENTRY ] = entryTime;
+      trace->nextStage = SIGNAL_IO_EPOS_TRACE_ENQUEUE;
+    }
+    // Setpoint buffers hold a single value per channel, so unsent ones are overwritten
+    if( device->isOutputPending[ channel ] ) TRACEPOINT2( queue__overflow, "setpoint", deviceID );
+    device->outputValues[ channel ] = value;
+    device->isOutputPending[ channel ] = true;
+    if( device->commandTime == 0.0 ) device->commandTime = GetTime();
+    StampSetpointTrace( device, channel, SIGNAL_IO_EPOS_TRACE_ENQUEUE );
+    return ( device->writeStatus != 0 );
+  }
+  
+  if( isTraced && device->setpointTrace.channel < 0 )
+  {
+    SetpointTrace* trace = &(device->setpointTrace);
+    trace->channel = (int) channel;
+    device->isTraceActive = true;
+    // Immediate writes have no queue, so enqueue and dequeue stages take no time
+    for( int stage = SIGNAL_IO_EPOS_TRACE_ENTRY; stage < SIGNAL_IO_EPOS_TRACE_TRANSFER_START; stage++ )
+      trace->stageTimes[ stage ] = entryTime;
+    trace->nextStage = SIGNAL_IO_EPOS_TRACE_TRANSFER_START;
+  }
+  lock.unlock();
+  
+  std::unique_lock<std::mutex> sdoLock;
+  if( !LockSdoServer( device, sdoLock ) )
+  {
+    StampSetpointTrace( device, channel, -1 );
+    return false;
+  }
+  
+  double commandTime = GetTime();
+  DWORD errorCode;
+  StampSetpointTrace( device, channel, SIGNAL_IO_EPOS_TRACE_TRANSFER_START );
+  if( SendSetpoint( device, channel, value, &errorCode ) == 0 )
+  {
+    StampSetpointTrace( device, channel, -1 );
+    PrintError( errorCode );
+    return false;
+  }
+  StampSetpointTrace( device, channel, SIGNAL_IO_EPOS_TRACE_TRANSFER_END );
+  
+  device->sentCommandTime = commandTime;
+  
+  return true;
+}
+
+bool SetTransferCycleLayout( int order, bool isInterleaved, void (*Compute)( long int, void* ), void* computeData )
+{
+  std::lock_guard<std::mutex> lock( configLock );
+  EposCycleConfig config = pendingCycleConfig;
+  config.order = order;
+  config.isInterleaved = isInterleaved;
+  config.Compute = Compute;
+  config.computeData = computeData;
+  
+  return QueueCycleConfig( config );
+}
+
+bool UpdateCycleConfig( const EposCycleConfig* config )
+{
+  if( config == NULL ) return false;
+  
+  std::lock_guard<std::mutex> lock( configLock );
+  return QueueCycleConfig( *config );
+}
+
+bool GetCycleConfig( EposCycleConfig* ref_config )
+{
+  if( ref_config == NULL ) return false;
+  
+  std::lock_guard<std::mutex> lock( configLock );
+  *ref_config = pendingCycleConfig;
+  
+  return true;
+}
+
+bool UpdateDeviceConfig( long int deviceID, const EposDeviceConfig* config )
+{
+  if( config == NULL ) return false;
+  
+  DeviceReference deviceReference( deviceID );
+  DeviceData* device = deviceReference.device;
+  if( device == NULL ) return false;
+  
+  std::lock_guard<std::mutex> lock( configLock );
+  return QueueDeviceConfig( device, *config );
+}
+
+bool GetDeviceConfig( long int deviceID, EposDeviceConfig* ref_config )
+{
+  if( ref_config == NULL ) return false;
+  
+  DeviceReference deviceReference( deviceID );
+  DeviceData* device = deviceReference.device;
+  if( device == NULL ) return false;
+  
+  std::lock_guard<std::mutex> lock( configLock );
+  *ref_config = device->pendingConfig;
+  
+  return true;
+}
+
+bool SetInputHistoryLength( long int deviceID, size_t samplesNumber )
+{
+  DeviceReference deviceReference( deviceID );
+  DeviceData* device = deviceReference.device;
+  if( device == NULL ) return false;
+  
+  // Buffers are allocated and released outside the lock, so that the transfer thread is barely held
+  InputHistory newHistory = {};
+  if( samplesNumber > 0 )
+  {
+    newHistory.times = (double*) AllocateMemory( samplesNumber * sizeof(double) );
+    newHistory.positions = (int*) AllocateMemory( samplesNumber * sizeof(int) );
+    newHistory.velocities = (int*) AllocateMemory( samplesNumber * sizeof(int) );
+    newHistory.currents = (short*) AllocateMemory( samplesNumber * sizeof(short) );
+    if( newHistory.times == NULL || newHistory.positions == NULL || newHistory.velocities == NULL || newHistory.currents == NULL )
+    {
+      FreeInputHistory( &newHistory );
+      return false;
+    }
+  }
+  
+  InputHistory* history = &(device->inputHistory);
+  {
+    std::lock_guard<std::mutex> lock( history->lock );
+    std::swap( history->times, newHistory.times );
+    std::swap( history->positions, newHistory.positions );
+    std::swap( history->velocities, newHistory.velocities );
+    std::swap( history->currents, newHistory.currents );
+    history->length = samplesNumber;
+    history->samplesCount = history->nextIndex = 0;
+  }
+  FreeInputHistory( &newHistory );
+  
+  return true;
+}
+
+// Position, from the oldest entry of a time ordered ring, of the first entry whose time is after startTime
+template< typename GetEntryTime >
+static size_t FindFirstNewer( size_t oldestIndex, size_t entriesCount, size_t length, double startTime, GetEntryTime EntryTime )
+{
+  size_t firstEntry = 0, lastEntry = entriesCount;
+  while( firstEntry < lastEntry )
+  {
+    size_t middleEntry = ( firstEntry + lastEntry ) / 2;
+    if( EntryTime( ( oldestIndex + middleEntry ) % length ) <= startTime ) firstEntry = middleEntry + 1;
+    else lastEntry = middleEntry;
+  }
+  
+  return firstEntry;
+}
+
+template< typename SampleType >
+static void ConvertSamples( const SampleType* samples, double* ref_values, size_t samplesNumber )
+{
+  for( size_t sampleIndex = 0; sampleIndex < samplesNumber; sampleIndex++ )
+    ref_values[ sampleIndex ] = (double) samples[ sampleIndex ];
+}
+
+size_t ReadInputHistory( long int deviceID, unsigned int channel, double startTime, double* ref_times, double* ref_values, size_t maxSamplesNumber )
+{
+  if( channel >= SIGNAL_IO_EPOS_INPUT_CHANNELS_NUMBER || ref_values == NULL ) return 0;
+  
+  DeviceReference deviceReference( deviceID );
+  DeviceData* device = deviceReference.device;
+  if( device == NULL ) return 0;
+  
+  InputHistory* history = &(device->inputHistory);
+  std::lock_guard<std::mutex> lock( history->lock );
+  if( history->samplesCount == 0 ) return 0;
+  
+  size_t oldestIndex = ( history->nextIndex + history->length - history->samplesCount ) % history->length;
+  size_t firstSample = FindFirstNewer( oldestIndex, history->samplesCount, history->length, startTime, 
+                                       [ history ]( size_t index ){ return history->times[ index ]; } );
+  
+  size_t samplesNumber = std::min( history->samplesCount - firstSample, maxSamplesNumber );
+  size_t sampleIndex = ( oldestIndex + firstSample ) % history->length;
+  // Converted in at most two contiguous batches, split where the ring wraps
+  for( size_t copiedNumber = 0; copiedNumber < samplesNumber; )
+  {
+    size_t batchLength = std::min( samplesNumber - copiedNumber, history->length - sampleIndex );
+    if( ref_times != NULL ) memcpy( ref_times + copiedNumber, history->times + sampleIndex, batchLength * sizeof(double) );
+    if( channel == 0 ) ConvertSamples( history->positions + sampleIndex, ref_values + copiedNumber, batchLength );
+    else if( channel == 1 ) ConvertSamples( history->velocities + sampleIndex, ref_values + copiedNumber, batchLength );
+    else ConvertSamples( history->currents + sampleIndex, ref_values + copiedNumber, batchLength );
+    copiedNumber += batchLength;
+    sampleIndex = 0;
+  }
+  
+  return samplesNumber;
+}
+
+bool SetInputRollup( long int deviceID, int tier, double period, size_t bucketsNumber )
+{
+  if( tier < 0 || tier >= SIGNAL_IO_EPOS_ROLLUP_TIERS_NUMBER ) return false;
+  
+  if( bucketsNumber > 0 && period <= 0.0 ) return false;
+  
+  DeviceReference deviceReference( deviceID );
+  DeviceData* device = deviceReference.device;
+  if( device == NULL ) return false;
+  
+  RollupBucket* buckets = NULL;
+  if( bucketsNumber > 0 )
+  {
+    buckets = (RollupBucket*) AllocateMemory( bucketsNumber * sizeof(RollupBucket) );
+    if( buckets == NULL ) return false;
+  }
+  
+  InputHistory* history = &(device->inputHistory);
+  {
+    std::lock_guard<std::mutex> lock( history->lock );
+    InputRollup* rollup = &(history->rollups[ tier ]);
+    std::swap( rollup->buckets, buckets );
+    rollup->period = period;
+    rollup->length = bucketsNumber;
+    rollup->bucketsCount = rollup->currentIndex = 0;
+  }
+  ReleaseMemory( buckets );
+  
+  return true;
+}
+
+size_t ReadInputRollup( long int deviceID, int tier, unsigned int channel, double startTime, EposInputRollup* ref_rollups, size_t maxRollupsNumber )
+{
+  if( tier < 0 || tier >= SIGNAL_IO_EPOS_ROLLUP_TIERS_NUMBER ) return 0;
+  
+  if( channel >= SIGNAL_IO_EPOS_INPUT_CHANNELS_NUMBER || ref_rollups == NULL ) return 0;
+  
+  DeviceReference deviceReference( deviceID );
+  DeviceData* device = deviceReference.device;
+  if( device == NULL ) return 0;
+  
+  InputHistory* history = &(device->inputHistory);
+  std::lock_guard<std::mutex> lock( history->lock );
+  InputRollup* rollup = &(history->rollups[ tier ]);
+  if( rollup->bucketsCount == 0 ) return 0;
+  
+  // Buckets still covering startTime are included
+  size_t oldestIndex = ( rollup->currentIndex + 1 + rollup->length - rollup->bucketsCount ) % rollup->length;
+  size_t firstBucket = FindFirstNewer( oldestIndex, rollup->bucketsCount, rollup->length, startTime, 
+                                       [ rollup ]( size_t index ){ return rollup->buckets[ index ].startTime + rollup->period; } );
+  
+  size_t rollupsNumber = std::min( rollup->bucketsCount - firstBucket, maxRollupsNumber );
+  for( size_t rollupIndex = 0; rollupIndex < rollupsNumber; rollupIndex++ )
+  {
+    const RollupBucket* bucket = &(rollup->buckets[ ( oldestIndex + firstBucket + rollupIndex ) % rollup->length ]);
+    ref_rollups[ rollupIndex ].startTime = bucket->startTime;
+    ref_rollups[ rollupIndex ].samplesCount = bucket->samplesCount;
+    ref_rollups[ rollupIndex ].minimum = (double) bucket->minimums[ channel ];
+    ref_rollups[ rollupIndex ].maximum = (double) bucket->maximums[ channel ];
+    ref_rollups[ rollupIndex ].mean = bucket->sums[ channel ] / bucket->samplesCount;
+  }
+  
+  return rollupsNumber;
+}
+
+bool SetTargetWindows( long int deviceID, unsigned int positionWindow, unsigned short positionWindowTime, unsigned int velocityWindow, unsigned short velocityWindowTime )
+{
+  DeviceReference deviceReference( deviceID );
+  DeviceData* device = deviceReference.device;
+  if( device == NULL || device->isListenOnly ) return false;
+  
+  // The status word only comes without polling as a TPDO
+  bool areWindowsEnabled = ( positionWindow > 0 || velocityWindow > 0 );
+  if( areWindowsEnabled && !device->isCANopen )
+  {
+    fprintf( stderr, "error: target windows need a CANopen device, to receive its status word by TPDO\n" );
+    return false;
+  }
+  
+  // Stale status words are not decoded anymore while the windows change
+  device->areWindowsEnabled = false;
+  
+  {
+    std::unique_lock<std::mutex> sdoLock;
+    if( !LockSdoServer( device, sdoLock ) ) return false;
+    
+    DWORD errorCode;
+    const char* callName = ( positionWindow > 0 ) ? "VCS_EnablePositionWindow" : "VCS_DisablePositionWindow";
+    double spanStartTime = StartTransaction( callName, device->nodeId );
+    BOOL status = ( positionWindow > 0 ) ? VCS_EnablePositionWindow( device->handle, device->nodeId, positionWindow, positionWindowTime, &errorCode )
+                                         : VCS_DisablePositionWindow( device->handle, device->nodeId, &errorCode );
+    EndTransaction( callName, device->nodeId, spanStartTime );
+    if( status != 0 )
+    {
+      callName = ( velocityWindow > 0 ) ? "VCS_EnableVelocityWindow" : "VCS_DisableVelocityWindow";
+      spanStartTime = StartTransaction( callName, device->nodeId );
+      status = ( velocityWindow > 0 ) ? VCS_EnableVelocityWindow( device->handle, device->nodeId, velocityWindow, velocityWindowTime, &errorCode )
+                                      : VCS_DisableVelocityWindow( device->handle, device->nodeId, &errorCode );
+      EndTransaction( callName, device->nodeId, spanStartTime );
+    }
+    if( status == 0 )
+    {
+      PrintError( errorCode );
+      return false;
+    }
+  }
+  
+  if( device->isCANopen && !MapStatusWordPdo( device, areWindowsEnabled ) ) return false;
+  
+  std::lock_guard<std::mutex> lock( device->eventsLock );
+  memset( device->events, 0, sizeof(device->events) );
+  device->reachedSetpointTime = device->clearedSetpointTime = 0.0;
+  device->areWindowsEnabled = areWindowsEnabled;
+  
+  return true;
+}
+
+// Standard CANopen sequence on TPDO4: invalidate the PDO, map the status word, make it sent on change, then validate it. 
+// Disabling only invalidates it
+static bool MapStatusWordPdo( DeviceData* device, bool isEnabled )
+{
+  const WORD COMMUNICATION_INDEX = TPDO_COMMUNICATION_INDEX + STATUSWORD_TPDO_NUMBER - 1;
+  const WORD MAPPING_INDEX = TPDO_MAPPING_INDEX + STATUSWORD_TPDO_NUMBER - 1;
+  
+  unsigned int cobId = TPDO4_COB_ID_BASE + device->nodeId;
+  unsigned int invalidCobId = PDO_COB_ID_INVALID | cobId;
+  if( !WriteDeviceObject( device, COMMUNICATION_INDEX, 0x01, &invalidCobId, sizeof(invalidCobId) ) ) return false;
+  if( !isEnabled ) return true;
+  
+  unsigned char transmissionType = PDO_TRANSMISSION_ASYNCHRONOUS;
+  unsigned char mappingsNumber = 0;
+  unsigned int mapping = STATUSWORD_MAPPING;
+  if( !WriteDeviceObject( device, COMMUNICATION_INDEX, 0x02, &transmissionType, sizeof(transmissionType) )
+      || !WriteDeviceObject( device, MAPPING_INDEX, 0x00, &mappingsNumber, sizeof(mappingsNumber) )
+      || !WriteDeviceObject( device, MAPPING_INDEX, 0x01, &mapping, sizeof(mapping) ) ) 
+    return false;
+  mappingsNumber = 1;
+  if( !WriteDeviceObject( device, MAPPING_INDEX, 0x00, &mappingsNumber, sizeof(mappingsNumber) )
+      || !WriteDeviceObject( device, COMMUNICATION_INDEX, 0x01, &cobId, sizeof(cobId) ) ) 
+    return false;
+  
+  return StartRemoteNode( device );
+}
+
+// PDOs are only processed and sent in the operational state
+static bool StartRemoteNode( DeviceData* device )
+{
+  std::unique_lock<std::mutex> sdoLock;
+  if( !LockSdoServer( device, sdoLock ) ) return false;
+  
+  DWORD errorCode;
+  double spanStartTime = StartTransaction( "VCS_SendNMTService", device->nodeId );
+  BOOL status = VCS_SendNMTService( device->handle, device->nodeId, NCS_START_REMOTE_NODE, &errorCode );
+  EndTransaction( "VCS_SendNMTService", device->nodeId, spanStartTime );
+  if( status == 0 ) PrintError( errorCode );
+  
+  return ( status != 0 );
+}
+
+bool WriteDigitalOutputs( long int deviceID, unsigned short mask, unsigned short states )
+{
+  DeviceReference deviceReference( deviceID );
+  DeviceData* device = deviceReference.device;
+  if( device == NULL || device->isListenOnly ) return false;
+  
+  std::lock_guard<std::mutex> lock( outputsLock );
+  AuxiliaryOutputs* outputs = &(device->auxiliaryOutputs);
+  outputs->digitalStates = ( outputs->digitalStates & ~mask ) | ( states & mask );
+  outputs->digitalMask |= mask;
+  
+  return ( device->auxiliaryStatus != 0 );
+}
+
+bool ReadDigitalOutputs( long int deviceID, unsigned short* ref_states )
+{
+  if( ref_states == NULL ) return false;
+  
+  DeviceReference deviceReference( deviceID );
+  DeviceData* device = deviceReference.device;
+  if( device == NULL ) return false;
+  
+  *ref_states = device->digitalOutputs;
+  
+  return true;
+}
+
+bool WriteAnalogOutput( long int deviceID, unsigned int output, unsigned short value )
+{
+  if( output >= SIGNAL_IO_EPOS_ANALOG_OUTPUTS_NUMBER ) return false;
+  
+  DeviceReference deviceReference( deviceID );
+  DeviceData* device = deviceReference.device;
+  if( device == NULL || device->isListenOnly ) return false;
+  
+  std::lock_guard<std::mutex> lock( outputsLock );
+  device->auxiliaryOutputs.analogValues[ output ] = value;
+  device->auxiliaryOutputs.isAnalogPending[ output ] = true;
+  
+  return ( device->auxiliaryStatus != 0 );
+}
+
+bool SetMonitorMapping( long int deviceID, unsigned int channel, unsigned short cobId, unsigned int offset, unsigned int size )
+{
+  if( channel >= SIGNAL_IO_EPOS_INPUT_CHANNELS_NUMBER ) return false;
+  
+  if( size != 1 && size != 2 && size != 4 ) return false;
+  
+  if( offset + size > CAN_FRAME_MAX_LENGTH || cobId > 0x7FF ) return false;
+  
+  DeviceReference deviceReference( deviceID );
+  DeviceData* device = deviceReference.device;
+  if( device == NULL || !device->isListenOnly ) return false;
+  
+  std::lock_guard<std::mutex> lock( device->monitor.lock );
+  MonitorMapping* mapping = &(device->monitor.mappings[ channel ]);
+  mapping->cobId = cobId;
+  mapping->offset = offset;
+  mapping->size = size;
+  
+  return true;
+}
+
+bool GetMonitorStatus( long int deviceID, EposMonitorStatus* ref_status )
+{
+  if( ref_status == NULL ) return false;
+  
+  DeviceReference deviceReference( deviceID );
+  DeviceData* device = deviceReference.device;
+  if( device == NULL || !device->isListenOnly ) return false;
+  
+  std::lock_guard<std::mutex> lock( device->monitor.lock );
+  *ref_status = device->monitor.status;
+  
+  return true;
+}
+
+#define OBJECT_CACHE_KEY( index, subIndex ) ( ( (unsigned int) (index) << 8 ) | (subIndex) )
+
+bool ReadDriveObject( long int deviceID, unsigned short index, unsigned char subIndex, void* ref_data, unsigned int size, unsigned int* ref_bytesNumber, bool useCache )
+{
+  if( ref_data == NULL ) return false;
+  
+  DeviceReference deviceReference( deviceID );
+  DeviceData* device = deviceReference.device;
+  if( device == NULL || device->isListenOnly ) return false;
+  
+  unsigned int bytesNumber = 0;
+  if( useCache )
+  {
+    // Smaller cached values may come from shorter reads or writes of the object
+    std::lock_guard<std::mutex> lock( device->objectCacheLock );
+    ObjectCache::iterator object = device->objectCache.find( OBJECT_CACHE_KEY( index, subIndex ) );
+    if( object != device->objectCache.end() && object->second.size() >= size )
+    {
+      memcpy( ref_data, object->second.data(), size );
+      if( ref_bytesNumber != NULL ) *ref_bytesNumber = size;
+      return true;
+    }
+  }
+  
+  // Misses are read outside the cache lock: a concurrent miss on the same object just reads it twice
+  std::unique_lock<std::mutex> sdoLock;
+  if( !LockSdoServer( device, sdoLock ) ) return false;
+  DWORD errorCode;
+  double spanStartTime = StartTransaction( "VCS_GetObject", device->nodeId );
+  BOOL status = VCS_GetObject( device->handle, device->nodeId, index, subIndex, ref_data, size, &bytesNumber, &errorCode );
+  EndTransaction( "VCS_GetObject", device->nodeId, spanStartTime );
+  sdoLock.unlock();
+  if( status == 0 )
+  {
+    PrintError( errorCode );
+    return false;
+  }
+  
+  if( ref_bytesNumber != NULL ) *ref_bytesNumber = bytesNumber;
+  
+  // A short read may be a truncated value, which later reads would get as well
+  if( !useCache || bytesNumber < size ) return true;
+  
+  const unsigned char* data = (const unsigned char*) ref_data;
+  std::lock_guard<std::mutex> lock( device->objectCacheLock );
+  device->objectCache[ OBJECT_CACHE_KEY( index, subIndex ) ].assign( data, data + bytesNumber );
+  
+  return true;
+}
+
+bool WriteDriveObject( long int deviceID, unsigned short index, unsigned char subIndex, const void* data, unsigned int size )
+{
+  if( data == NULL ) return false;
+  
+  DeviceReference deviceReference( deviceID );
+  DeviceData* device = deviceReference.device;
+  if( device == NULL ) return false;
+  
+  return WriteDeviceObject( device, index, subIndex, data, size );
+}
+
+static bool WriteDeviceObject( DeviceData* device, unsigned short index, unsigned char subIndex, const void* data, unsigned int size )
+{
+  std::unique_lock<std::mutex> sdoLock;
+  if( device->isListenOnly || !LockSdoServer( device, sdoLock ) ) return false;
+  
+  DWORD bytesNumber = 0, errorCode;
+  double spanStartTime = StartTransaction( "VCS_SetObject", device->nodeId );
+  BOOL status = VCS_SetObject( device->handle, device->nodeId, index, subIndex, (void*) data, size, &bytesNumber, &errorCode );
+  EndTransaction( "VCS_SetObject", device->nodeId, spanStartTime );
+  
+  // The drive value is unknown after a failed write, so it is read again next time
+  std::lock_guard<std::mutex> lock( device->objectCacheLock );
+  if( status == 0 ) 
+  {
+    device->objectCache.erase( OBJECT_CACHE_KEY( index, subIndex ) );
+    PrintError( errorCode );
+    return false;
+  }
+  const unsigned char* bytes = (const unsigned char*) data;
+  device->objectCache[ OBJECT_CACHE_KEY( index, subIndex ) ].assign( bytes, bytes + bytesNumber );
+  
+  return true;
+}
+
+bool SetSetpointPdo( long int deviceID, int channel, unsigned int pdoNumber, unsigned short objectIndex, unsigned char objectSubIndex, bool isSynchronous )
+{
+  const unsigned int SETPOINT_BITS[ SIGNAL_IO_EPOS_OUTPUT_CHANNELS_NUMBER ] = { 32, 32, 16 };
+  
+  if( channel >= SIGNAL_IO_EPOS_OUTPUT_CHANNELS_NUMBER ) return false;
+  
+  if( channel >= 0 && ( pdoNumber < 1 || pdoNumber > 4 ) ) return false;
+  
+  DeviceReference deviceReference( deviceID );
+  DeviceData* device = deviceReference.device;
+  if( device == NULL || device->isListenOnly ) return false;
+  
+  // Setpoints go back to SDO transactions before the previous PDO is invalidated
+  SetpointPdo lastPdo;
+  {
+    std::lock_guard<std::mutex> lock( outputsLock );
+    lastPdo = device->setpointPdo;
+    device->setpointPdo.channel = -1;
+  }
+  device->isSyncRequired = false;
+  
+  unsigned int invalidCobId = PDO_COB_ID_INVALID;
+  if( lastPdo.channel >= 0 ) 
+  {
+    invalidCobId |= lastPdo.cobId;
+    WriteDeviceObject( device, RPDO_COMMUNICATION_INDEX + lastPdo.number - 1, 0x01, &invalidCobId, sizeof(invalidCobId) );
+  }
+  if( channel < 0 ) return true;
+  
+  // Standard CANopen sequence: invalidate the PDO, set its transmission type and mapping, then validate it
+  SetpointPdo pdo = { channel, pdoNumber, (WORD) ( RPDO1_COB_ID_BASE + 0x100 * ( pdoNumber - 1 ) + device->nodeId ) };
+  WORD communicationIndex = RPDO_COMMUNICATION_INDEX + pdoNumber - 1;
+  WORD mappingIndex = RPDO_MAPPING_INDEX + pdoNumber - 1;
+  invalidCobId = PDO_COB_ID_INVALID | pdo.cobId;
+  unsigned char transmissionType = isSynchronous ? PDO_TRANSMISSION_SYNCHRONOUS : PDO_TRANSMISSION_ASYNCHRONOUS;
+  unsigned char mappingsNumber = 0;
+  unsigned int mapping = ( (unsigned int) objectIndex << 16 ) | ( (unsigned int) objectSubIndex << 8 ) | SETPOINT_BITS[ channel ];
+  unsigned int cobId = pdo.cobId;
+  if( !WriteDeviceObject( device, communicationIndex, 0x01, &invalidCobId, sizeof(invalidCobId) )
+      || !WriteDeviceObject( device, communicationIndex, 0x02, &transmissionType, sizeof(transmissionType) )
+      || !WriteDeviceObject( device, mappingIndex, 0x00, &mappingsNumber, sizeof(mappingsNumber) )
+      || !WriteDeviceObject( device, mappingIndex, 0x01, &mapping, sizeof(mapping) ) ) 
+    return false;
+  mappingsNumber = 1;
+  if( !WriteDeviceObject( device, mappingIndex, 0x00, &mappingsNumber, sizeof(mappingsNumber) )
+      || !WriteDeviceObject( device, communicationIndex, 0x01, &cobId, sizeof(cobId) ) ) 
+    return false;
+  
+  if( !StartRemoteNode( device ) ) return false;
+  
+  device->isSyncRequired = isSynchronous;
+  std::lock_guard<std::mutex> lock( outputsLock );
+  device->setpointPdo = pdo;
+  
+  return true;
+}
+
+bool StartObjectUpload( long int deviceID, unsigned short index, unsigned char subIndex, void* ref_data, unsigned int size, bool isBlock )
+{
+  if( ref_data == NULL || size == 0 ) return false;
+  
+  DeviceReference deviceReference( deviceID );
+  DeviceData* device = deviceReference.device;
+  if( device == NULL || device->isListenOnly ) return false;
+  
+  ObjectUpload* upload = &(device->upload);
+  std::lock_guard<std::mutex> lock( upload->lock );
+  if( upload->state == SIGNAL_IO_EPOS_UPLOAD_RUNNING ) return false;
+  
+  // Even the initiate request is left to the transfer thread, within its frame budget
+  upload->state = SIGNAL_IO_EPOS_UPLOAD_RUNNING;
+  upload->phase = UPLOAD_PHASE_START;
+  upload->isBlock = isBlock;
+  upload->index = index;
+  upload->subIndex = subIndex;
+  upload->data = (unsigned char*) ref_data;
+  upload->size = upload->totalSize = size;
+  upload->bytesNumber = 0;
+  upload->abortCode = 0;
+  upload->requestTime = GetTime();
+  device->isUploading = true;
+  
+  return true;
+}
+
+int GetObjectUploadState( long int deviceID, unsigned int* ref_bytesNumber, unsigned int* ref_abortCode )
+{
+  DeviceReference deviceReference( deviceID );
+  DeviceData* device = deviceReference.device;
+  if( device == NULL ) return SIGNAL_IO_EPOS_UPLOAD_IDLE;
+  
+  ObjectUpload* upload = &(device->upload);
+  std::lock_guard<std::mutex> lock( upload->lock );
+  if( ref_bytesNumber != NULL ) *ref_bytesNumber = std::min( upload->bytesNumber, upload->totalSize );
+  if( ref_abortCode != NULL ) *ref_abortCode = upload->abortCode;
+  
+  return upload->state;
+}
+
+bool CancelObjectUpload( long int deviceID )
+{
+  DeviceReference deviceReference( deviceID );
+  DeviceData* device = deviceReference.device;
+  if( device == NULL ) return false;
+  
+  std::lock_guard<std::mutex> lock( device->upload.lock );
+  if( device->upload.state != SIGNAL_IO_EPOS_UPLOAD_RUNNING ) return false;
+  
+  EndObjectUpload( device, SIGNAL_IO_EPOS_UPLOAD_IDLE, SDO_ABORT_COMMAND );
+  device->upload.abortCode = 0;
+  
+  return true;
+}
+
+bool SetUploadFrameBudget( unsigned int framesNumber )
+{
+  if( framesNumber == 0 ) return false;
+  
+  uploadFrameBudget = framesNumber;
+  
+  return true;
+}
+
+// Consumer SDO transactions are refused while a raw upload runs, as the drive would abort it for them, and hold
+// the upload lock, so that none starts under them
+static bool LockSdoServer( DeviceData* device, std::unique_lock<std::mutex>& ref_lock )
+{
+  ref_lock = std::unique_lock<std::mutex>( device->upload.lock );
+  if( device->upload.state != SIGNAL_IO_EPOS_UPLOAD_RUNNING ) return true;
+  
+  ref_lock.unlock();
+  return false;
+}
+
+bool RestoreDriveParameters( long int deviceID )
+{
+  DeviceReference deviceReference( deviceID );
+  DeviceData* device = deviceReference.device;
+  if( device == NULL ) return false;
+  
+  return RestoreDeviceParameters( device );
+}
+
+static bool RestoreDeviceParameters( DeviceData* device )
+{
+  std::unique_lock<std::mutex> sdoLock;
+  if( device->isListenOnly || !LockSdoServer( device, sdoLock ) ) return false;
+  
+  DWORD errorCode;
+  double spanStartTime = StartTransaction( "VCS_Restore", device->nodeId );
+  BOOL status = VCS_Restore( device->handle, device->nodeId, &errorCode );
+  EndTransaction( "VCS_Restore", device->nodeId, spanStartTime );
+  
+  {
+    std::lock_guard<std::mutex> lock( device->objectCacheLock );
+    device->objectCache.clear();
+  }
+  
+  if( status == 0 ) PrintError( errorCode );
+  
+  return ( status != 0 );
+}
+
+bool InvalidateObjectCache( long int deviceID )
+{
+  DeviceReference deviceReference( deviceID );
+  DeviceData* device = deviceReference.device;
+  if( device == NULL ) return false;
+  
+  std::lock_guard<std::mutex> lock( device->objectCacheLock );
+  device->objectCache.clear();
+  
+  return true;
+}
+
+bool ReadEvent( long int deviceID, unsigned int channel, EposEvent* ref_event )
+{
+  if( channel >= SIGNAL_IO_EPOS_EVENTS_NUMBER || ref_event == NULL ) return false;
+  
+  DeviceReference deviceReference( deviceID );
+  DeviceData* device = deviceReference.device;
+  if( device == NULL ) return false;
+  
+  std::lock_guard<std::mutex> lock( device->eventsLock );
+  *ref_event = device->events[ channel ];
+  // A setpoint sent since the last status read already invalidates the reached target
+  if( channel == SIGNAL_IO_EPOS_EVENT_TARGET_REACHED ) ref_event->isActive = ( device->reachedSetpointTime == device->setpointSentTime );
+  
+  return device->areWindowsEnabled;
+}
+
+bool GetCommandFeedbackDelay( long int deviceID, EposLatencyStats* ref_stats )
+{
+  if( ref_stats == NULL ) return false;
+  
+  DeviceReference deviceReference( deviceID );
+  DeviceData* device = deviceReference.device;
+  if( device == NULL ) return false;
+  
+  std::lock_guard<std::mutex> lock( statsLock );
+  *ref_stats = device->commandFeedbackDelay;
+  
+  return true;
+}
+
+bool AcquireOutputChannel( long int deviceID, unsigned int channel )
+{
+  CountCall( SIGNAL_IO_EPOS_CALL_ACQUIRE_OUTPUT_CHANNEL );
+  
   if( deviceID == SIGNAL_IO_DEVICE_INVALID_ID ) return false;
   
   if( channel > 2 ) return false;
   
-  DeviceData* device = (DeviceData*) deviceID;
+  DeviceReference deviceReference( deviceID );
+  DeviceData* device = deviceReference.device;
+  if( device == NULL ) return false;
+  
+  return EnableOutputChannel( device, channel );
+}
+
+static bool EnableOutputChannel( DeviceData* device, unsigned int channel )
+{
+  if( channel > 2 ) return false;
+  
+  std::unique_lock<std::mutex> sdoLock;
+  if( device->isListenOnly || !LockSdoServer( device, sdoLock ) ) return false;
+
+  char mode = GetChannelOperationMode( channel );
+  
+  // Setpoints written for a previous acquisition no longer hold
+  device->isSetpointKnown[ channel ] = false;
+  
+  DWORD errorCode;
+  double spanStartTime = StartTransaction( "VCS_SetEnableState", device->nodeId );
+  if( VCS_SetEnableState( device->handle, device->nodeId, &errorCode ) == 0 )
+    PrintError( errorCode );
+  EndTransaction( "VCS_SetEnableState", device->nodeId, spanStartTime );
+  spanStartTime = StartTransaction( "VCS_SetOperationMode", device->nodeId );
+  if( VCS_SetOperationMode( device->handle, device->nodeId, mode, &errorCode ) == 0 )
+    PrintError( errorCode );
+  EndTransaction( "VCS_SetOperationMode", device->nodeId, spanStartTime );
+
+  return true;
+}
+
+void ReleaseOutputChannel( long int deviceID, unsigned int channel )
+{
+  CountCall( SIGNAL_IO_EPOS_CALL_RELEASE_OUTPUT_CHANNEL );
+  
+  if( deviceID == SIGNAL_IO_DEVICE_INVALID_ID ) return;
+
+  if( channel > 2 ) return;
+
+  DeviceReference deviceReference( deviceID );
+  DeviceData* device = deviceReference.device;
+  if( device == NULL ) return;
+  
+  DisableOutputChannel( device, channel );
+  
+  return;
+}
+
+static void DisableOutputChannel( DeviceData* device, unsigned int channel )
+{
+  if( channel > 2 ) return;
+  
+  std::unique_lock<std::mutex> sdoLock;
+  if( device->isListenOnly || !LockSdoServer( device, sdoLock ) ) return;
+  
+  device->isSetpointKnown[ channel ] = false;
+
+  DWORD errorCode;
+  double spanStartTime = StartTransaction( "VCS_SetDisableState", device->nodeId );
+  if( VCS_SetDisableState( device->handle, device->nodeId, &errorCode ) == 0 )
+    PrintError( errorCode );
+  EndTransaction( "VCS_SetDisableState", device->nodeId, spanStartTime );
+  
+  return;
+} 
+
+bool SubmitCommand( long int deviceID, const EposCommand* command, void (*Complete)( bool, void* ), void* completionData )
+{
+  if( command == NULL || command->type < 0 || command->type >= SIGNAL_IO_EPOS_COMMANDS_NUMBER ) return false;
+  
+  if( command->type == SIGNAL_IO_EPOS_COMMAND_WRITE_OBJECT && ( command->data == NULL || command->size == 0 ) ) return false;
+  
+  // Given back by the worker, so that the device outlives its queued commands
+  DeviceData* device = AcquireDevice( deviceID );
+  if( device == NULL ) return false;
+  
+  DeviceCommand newCommand = { device, *command, ObjectBytes(), Complete, completionData };
+  if( command->type == SIGNAL_IO_EPOS_COMMAND_WRITE_OBJECT )
+  {
+    const unsigned char* data = (const unsigned char*) command->data;
+    newCommand.data.assign( data, data + command->size );
+  }
+  newCommand.command.data = NULL;
+  
+  std::lock_guard<std::mutex> lock( commandsLock );
+  CommandWorker*& worker = commandWorkers[ device->handle ];
+  if( worker == NULL ) worker = new CommandWorker();
+  worker->commands.push_back( std::move( newCommand ) );
+  if( !worker->isActive )
+  {
+    // An inactive worker is already leaving
+    if( worker->thread.joinable() ) worker->thread.join();
+    worker->isActive = true;
+    worker->thread = std::thread( RunDeviceCommands, worker );
+  }
+  
+  return true;
+}
+
+size_t AcquireOutputChannels( const long int* deviceIDs, const unsigned int* channels, size_t devicesNumber, bool isConfirmed, bool* ref_results )
+{
+  if( deviceIDs == NULL || channels == NULL ) return 0;
+  
+  // Devices are held for the whole sequence, and grouped by bus handle
+  std::vector<DeviceData*> devices( devicesNumber, NULL );
+  std::vector<char> results( devicesNumber, 0 );
+  std::map<HANDLE, std::vector<size_t>> busDevices;
+  for( size_t deviceIndex = 0; deviceIndex < devicesNumber; deviceIndex++ )
+  {
+    if( channels[ deviceIndex ] >= SIGNAL_IO_EPOS_OUTPUT_CHANNELS_NUMBER ) continue;
+    DeviceData* device = AcquireDevice( deviceIDs[ deviceIndex ] );
+    if( device == NULL ) continue;
+    devices[ deviceIndex ] = device;
+    if( !device->isListenOnly ) busDevices[ device->handle ].push_back( deviceIndex );
+  }
+  
+  // Buses are sequenced concurrently, the calling thread taking the first one
+  std::vector<std::thread> busThreads;
+  if( !busDevices.empty() )
+  {
+    for( std::map<HANDLE, std::vector<size_t>>::iterator bus = std::next( busDevices.begin() ); bus != busDevices.end(); bus++ )
+      busThreads.emplace_back( AcquireBusChannels, devices.data(), channels, &(bus->second), isConfirmed, results.data() );
+    AcquireBusChannels( devices.data(), channels, &(busDevices.begin()->second), isConfirmed, results.data() );
+  }
+  for( std::thread& busThread : busThreads )
+    busThread.join();
+  
+  size_t acquiredNumber = 0;
+  for( size_t deviceIndex = 0; deviceIndex < devicesNumber; deviceIndex++ )
+  {
+    if( devices[ deviceIndex ] != NULL ) ReleaseDevice( devices[ deviceIndex ] );
+    if( ref_results != NULL ) ref_results[ deviceIndex ] = ( results[ deviceIndex ] != 0 );
+    if( results[ deviceIndex ] != 0 ) acquiredNumber++;
+  }
+  
+  return acquiredNumber;
+}
+
+static void ServeFetchRequests( void );
+static void UpdateLatencyProbe( DeviceData* device );
+
+static char GetChannelOperationMode( unsigned int channel )
+{
+  if( channel == 1 ) return OMD_VELOCITY_MODE;
+  if( channel == 2 ) return OMD_CURRENT_MODE;
+  return OMD_POSITION_MODE;
+}
+
+// Blocking transactions on a bus are issued phase by phase over all its devices (modes, enables, then 
+// confirmations), so that each drive completes its state transition while the others are addressed.
+// Mode writes are confirmed by their SDO acknowledgement, so that only the enable state is read back
+static void AcquireBusChannels( DeviceData** devices, const unsigned int* channels, const std::vector<size_t>* deviceIndexes, bool isConfirmed, char* ref_results )
+{
+  DWORD errorCode;
+  for( size_t deviceIndex : *deviceIndexes )
+  {
+    DeviceData* device = devices[ deviceIndex ];
+    std::unique_lock<std::mutex> sdoLock;
+    if( device->isEnding || !LockSdoServer( device, sdoLock ) ) continue;
+    device->isSetpointKnown[ channels[ deviceIndex ] ] = false;
+    double spanStartTime = StartTransaction( "VCS_SetOperationMode", device->nodeId );
+    if( VCS_SetOperationMode( device->handle, device->nodeId, GetChannelOperationMode( channels[ deviceIndex ] ), &errorCode ) == 0 )
+      PrintError( errorCode );
+    else
+      ref_results[ deviceIndex ] = 1;
+    EndTransaction( "VCS_SetOperationMode", device->nodeId, spanStartTime );
+  }
+  
+  for( size_t deviceIndex : *deviceIndexes )
+  {
+    DeviceData* device = devices[ deviceIndex ];
+    if( ref_results[ deviceIndex ] == 0 ) continue;
+    ref_results[ deviceIndex ] = 0;
+    std::unique_lock<std::mutex> sdoLock;
+    if( device->isEnding || !LockSdoServer( device, sdoLock ) ) continue;
+    double spanStartTime = StartTransaction( "VCS_SetEnableState", device->nodeId );
+    if( VCS_SetEnableState( device->handle, device->nodeId, &errorCode ) == 0 )
+      PrintError( errorCode );
+    else
+      ref_results[ deviceIndex ] = 1;
+    EndTransaction( "VCS_SetEnableState", device->nodeId, spanStartTime );
+  }
+  
+  if( !isConfirmed ) return;
+  
+  for( size_t deviceIndex : *deviceIndexes )
+  {
+    DeviceData* device = devices[ deviceIndex ];
+    if( ref_results[ deviceIndex ] == 0 ) continue;
+    ref_results[ deviceIndex ] = 0;
+    std::unique_lock<std::mutex> sdoLock;
+    if( device->isEnding || !LockSdoServer( device, sdoLock ) ) continue;
+    BOOL isEnabled = 0;
+    double spanStartTime = StartTransaction( "VCS_GetEnableState", device->nodeId );
+    if( VCS_GetEnableState( device->handle, device->nodeId, &isEnabled, &errorCode ) == 0 )
+      PrintError( errorCode );
+    EndTransaction( "VCS_GetEnableState", device->nodeId, spanStartTime );
+    ref_results[ deviceIndex ] = ( isEnabled != 0 ) ? 1 : 0;
+  }
+}
+
+// Completions are called with the device released, as they may end it
+static void RunDeviceCommands( CommandWorker* worker )
+{
+  std::unique_lock<std::mutex> lock( commandsLock );
+  while( !worker->commands.empty() )
+  {
+    DeviceCommand command = std::move( worker->commands.front() );
+    worker->commands.pop_front();
+    lock.unlock();
+    
+    bool result = RunDeviceCommand( &command );
+    ReleaseDevice( command.device );
+    if( command.Complete != NULL ) command.Complete( result, command.completionData );
+    
+    lock.lock();
+  }
+  worker->isActive = false;
+  if( worker->isRetired ) 
+  {
+    lock.unlock();
+    delete worker;
+  }
+}
+
+// On the referenced device, without going through the counted entry points. Fails at once for a device ended in the meantime
+static bool RunDeviceCommand( const DeviceCommand* command )
+{
+  DeviceData* device = command->device;
+  if( device->isEnding ) return false;
+  
+  switch( command->command.type )
+  {
+    case SIGNAL_IO_EPOS_COMMAND_ACQUIRE:
+      return EnableOutputChannel( device, command->command.channel );
+    case SIGNAL_IO_EPOS_COMMAND_RELEASE:
+      DisableOutputChannel( device, command->command.channel );
+      return true;
+    case SIGNAL_IO_EPOS_COMMAND_RESET:
+      ResetDevice( device );
+      return !IsDeviceFaulted( device );
+    case SIGNAL_IO_EPOS_COMMAND_RESTORE_WARM_START:
+      return RestoreDeviceWarmStart( device );
+    case SIGNAL_IO_EPOS_COMMAND_WRITE_OBJECT:
+      return WriteDeviceObject( device, command->command.index, command->command.subIndex, command->data.data(), (unsigned int) command->data.size() );
+    case SIGNAL_IO_EPOS_COMMAND_RESTORE_PARAMETERS:
+      return RestoreDeviceParameters( device );
+  }
+  
+  return false;
+}
+
+// Called once the last device ended, as bus handles may be reused. Workers still blocked on an abandoned device 
+// are left behind, retired
+static void JoinCommandWorkers( void )
+{
+  std::lock_guard<std::mutex> lock( commandsLock );
+  for( std::map<HANDLE, CommandWorker*>::iterator worker = commandWorkers.begin(); worker != commandWorkers.end(); worker++ )
+  {
+    if( worker->second->isActive ) 
+    {
+      worker->second->thread.detach();
+      worker->second->isRetired = true;
+      continue;
+    }
+    if( worker->second->thread.joinable() ) worker->second->thread.join();
+    delete worker->second;
+  }
+  commandWorkers.clear();
+}
+
+// Target reached bit of the status words sent by the drive on change (TPDO4), which it sets from its position or velocity 
+// window. Frames are only taken from the receive queue, without any bus transaction. A target counts as reached when 
+// the bit is set again after a status word with the bit cleared, read since the setpoint transmission
+static void ReadTargetEvents( DeviceData* device )
+{
+  WORD cobId = TPDO4_COB_ID_BASE + device->nodeId;
+  for( int frameIndex = 0; frameIndex < MONITOR_FRAMES_MAX_NUMBER; frameIndex++ )
+  {
+    if( device->isEnding ) return;
+    
+    unsigned char frame[ CAN_FRAME_MAX_LENGTH ] = { 0 };
+    DWORD errorCode = 0;
+    double setpointSentTime = device->setpointSentTime;
+    double spanStartTime = StartTransaction( "VCS_ReadCANFrame", device->nodeId );
+    BOOL status = VCS_ReadCANFrame( device->handle, cobId, CAN_FRAME_MAX_LENGTH, frame, 0, &errorCode );
+    EndTransaction( "VCS_ReadCANFrame", device->nodeId, spanStartTime );
+    // Failing reads just mean no status change since the last cycle
+    if( status == 0 ) return;
+    
+    double statusTime = GetTime();
+    bool isInWindow = ( ( DecodeFrameField( frame, 0, 2 ) & STATUSWORD_TARGET_REACHED ) != 0 );
+    
+    std::lock_guard<std::mutex> lock( device->eventsLock );
+    EposEvent* windowEvent = &(device->events[ SIGNAL_IO_EPOS_EVENT_IN_WINDOW ]);
+    if( isInWindow && !windowEvent->isActive )
+    {
+      windowEvent->count++;
+      windowEvent->lastTime = statusTime;
+    }
+    windowEvent->isActive = isInWindow;
+    
+    EposEvent* targetEvent = &(device->events[ SIGNAL_IO_EPOS_EVENT_TARGET_REACHED ]);
+    if( !isInWindow ) device->clearedSetpointTime = setpointSentTime;
+    else if( setpointSentTime > device->reachedSetpointTime && device->clearedSetpointTime == setpointSentTime )
+    {
+      device->reachedSetpointTime = setpointSentTime;
+      targetEvent->count++;
+      targetEvent->lastTime = statusTime;
+    }
+  }
+}
+
+// Raw samples (unfiltered) of successful reads, stamped with the read completion time
+static void RecordInputHistory( DeviceData* device, double time, int position, int velocity, short current )
+{
+  InputHistory* history = &(device->inputHistory);
+  std::lock_guard<std::mutex> lock( history->lock );
+  
+  if( history->length > 0 )
+  {
+    size_t sampleIndex = history->nextIndex;
+    history->times[ sampleIndex ] = time;
+    history->positions[ sampleIndex ] = position;
+    history->velocities[ sampleIndex ] = velocity;
+    history->currents[ sampleIndex ] = current;
+    history->nextIndex = ( sampleIndex + 1 ) % history->length;
+    if( history->samplesCount < history->length ) history->samplesCount++;
+  }
+  
+  const int values[ SIGNAL_IO_EPOS_INPUT_CHANNELS_NUMBER ] = { position, velocity, (int) current };
+  for( int tier = 0; tier < SIGNAL_IO_EPOS_ROLLUP_TIERS_NUMBER; tier++ )
+    UpdateInputRollup( &(history->rollups[ tier ]), time, values );
+}
+
+// Samples are aggregated into the bucket of their period, a new bucket overwriting the oldest one
+static void UpdateInputRollup( InputRollup* rollup, double time, const int* values )
+{
+  if( rollup->length == 0 ) return;
+  
+  double startTime = floor( time / rollup->period ) * rollup->period;
+  RollupBucket* bucket = &(rollup->buckets[ rollup->currentIndex ]);
+  if( rollup->bucketsCount == 0 || startTime > bucket->startTime )
+  {
+    if( rollup->bucketsCount > 0 ) rollup->currentIndex = ( rollup->currentIndex + 1 ) % rollup->length;
+    if( rollup->bucketsCount < rollup->length ) rollup->bucketsCount++;
+    bucket = &(rollup->buckets[ rollup->currentIndex ]);
+    bucket->startTime = startTime;
+    bucket->samplesCount = 0;
+  }
+  
+  for( int channel = 0; channel < SIGNAL_IO_EPOS_INPUT_CHANNELS_NUMBER; channel++ )
+  {
+    if( bucket->samplesCount == 0 )
+    {
+      bucket->minimums[ channel ] = bucket->maximums[ channel ] = values[ channel ];
+      bucket->sums[ channel ] = 0.0;
+    }
+    bucket->minimums[ channel ] = std::min( bucket->minimums[ channel ], values[ channel ] );
+    bucket->maximums[ channel ] = std::max( bucket->maximums[ channel ], values[ channel ] );
+    bucket->sums[ channel ] += values[ channel ];
+  }
+  bucket->samplesCount++;
+}
+
+static void FreeInputHistory( InputHistory* history )
+{
+  ReleaseMemory( history->times );
+  ReleaseMemory( history->positions );
+  ReleaseMemory( history->velocities );
+  ReleaseMemory( history->currents );
+  for( int tier = 0; tier < SIGNAL_IO_EPOS_ROLLUP_TIERS_NUMBER; tier++ )
+    ReleaseMemory( history->rollups[ tier ].buckets );
+}
+
+// First fit, in whole alignment units, from the arena when set and from the heap otherwise.
+// Returns NULL when the arena has no free block large enough
+static void* AllocateMemory( size_t size )
+{
+  std::lock_guard<std::mutex> lock( arenaLock );
+  
+  if( memoryArena.base == NULL ) return malloc( size );
+  
+  size_t blockSize = ARENA_ALIGNMENT + ( ( size + ARENA_ALIGNMENT - 1 ) / ARENA_ALIGNMENT ) * ARENA_ALIGNMENT;
+  for( ArenaBlock** link = &(memoryArena.freeBlocks); *link != NULL; link = &((*link)->next) )
+  {
+    ArenaBlock* block = *link;
+    if( block->size < blockSize ) continue;
+    // Remainders too small for a header and some data stay in the block
+    if( block->size - blockSize >= 2 * ARENA_ALIGNMENT )
+    {
+      ArenaBlock* remainder = (ArenaBlock*) ( (unsigned char*) block + blockSize );
+      remainder->size = block->size - blockSize;
+      remainder->next = block->next;
+      block->size = blockSize;
+      *link = remainder;
+    }
+    else *link = block->next;
+    
+    memoryArena.stats.usedSize += block->size;
+    memoryArena.stats.peakUsedSize = std::max( memoryArena.stats.peakUsedSize, memoryArena.stats.usedSize );
+    return (unsigned char*) block + ARENA_ALIGNMENT;
+  }
+  
+  memoryArena.stats.failedAllocationsCount++;
+  return NULL;
+}
+
+static void ReleaseMemory( void* memory )
+{
+  if( memory == NULL ) return;
+  
+  std::lock_guard<std::mutex> lock( arenaLock );
+  
+  // Memory taken from the heap before the arena was set goes back there
+  unsigned char* address = (unsigned char*) memory;
+  if( memoryArena.base == NULL || address < memoryArena.base || address >= memoryArena.base + memoryArena.stats.size )
+  {
+    free( memory );
+    return;
+  }
+  
+  ArenaBlock* block = (ArenaBlock*) ( address - ARENA_ALIGNMENT );
+  memoryArena.stats.usedSize -= block->size;
+  
+  ArenaBlock* previousBlock = NULL;
+  ArenaBlock* nextBlock = memoryArena.freeBlocks;
+  while( nextBlock != NULL && nextBlock < block )
+  {
+    previousBlock = nextBlock;
+    nextBlock = nextBlock->next;
+  }
+  
+  block->next = nextBlock;
+  if( nextBlock != NULL && (unsigned char*) block + block->size == (unsigned char*) nextBlock )
+  {
+    block->size += nextBlock->size;
+    block->next = nextBlock->next;
+  }
+  if( previousBlock == NULL ) memoryArena.freeBlocks = block;
+  else if( (unsigned char*) previousBlock + previousBlock->size == (unsigned char*) block )
+  {
+    previousBlock->size += block->size;
+    previousBlock->next = block->next;
+  }
+  else previousBlock->next = block;
+}
+
+// Validates and stores a cycle configuration for the next swap. Called with configLock held
+static bool QueueCycleConfig( EposCycleConfig config )
+{
+  if( config.period < 0.0 || config.phaseLead < 0.0 ) return false;
+  
+  if( config.isPhaseLocked && ( config.period == 0.0 || config.phaseLead >= config.period ) ) return false;
+  
+  if( config.order < SIGNAL_IO_EPOS_CYCLE_IMMEDIATE_WRITES || config.order > SIGNAL_IO_EPOS_CYCLE_READS_COMPUTE_WRITES ) return false;
+  
+  if( config.order != SIGNAL_IO_EPOS_CYCLE_READS_COMPUTE_WRITES ) config.Compute = NULL;
+  
+  pendingCycleConfig = config;
+  isCycleConfigPending = true;
+  
+  return true;
+}
+
+// Validates and stores a device configuration for the next swap. Called with configLock held
+static bool QueueDeviceConfig( DeviceData* device, const EposDeviceConfig& config )
+{
+  for( unsigned int channel = 0; channel < SIGNAL_IO_EPOS_INPUT_CHANNELS_NUMBER; channel++ )
+  {
+    if( config.maxInputAges[ channel ] < 0.0 || config.fetchTimeouts[ channel ] < 0.0 ) return false;
+    if( config.inputFilterTimes[ channel ] < 0.0 ) return false;
+  }
+  
+  for( unsigned int channel = 0; channel < SIGNAL_IO_EPOS_OUTPUT_CHANNELS_NUMBER; channel++ )
+  {
+    if( config.areOutputLimitsEnabled[ channel ] && config.outputMinimums[ channel ] > config.outputMaximums[ channel ] ) return false;
+  }
+  
+  device->pendingConfig = config;
+  device->isConfigPending = true;
+  
+  return true;
+}
+
+// Swaps pending configurations in. Called by the transfer thread with devicesLock held, between cycles
+static void ApplyPendingConfigs( void )
+{
+  if( isCycleConfigPending.load() )
+  {
+    std::lock_guard<std::mutex> lock( configLock );
+    const EposCycleConfig& config = pendingCycleConfig;
+    
+    if( config.period != transferCycle.period || config.isPhaseLocked != transferCycle.isPhaseLocked || config.phaseLead != transferCycle.phaseLead )
+    {
+      transferCycle.period = config.period;
+      transferCycle.isPhaseLocked = config.isPhaseLocked;
+      transferCycle.phaseLead = config.phaseLead;
+      transferCycle.phaseError = transferCycle.periodCorrection = 0.0;
+    }
+    
+    // Delay statistics are only meaningful for a single layout
+    if( config.order != cycleLayout.order || config.isInterleaved != cycleLayout.isInterleaved )
+    {
+      std::lock_guard<std::mutex> statsGuard( statsLock );
+      for( DeviceData* device : runningDevices )
+      {
+        memset( &(device->commandFeedbackDelay), 0, sizeof(EposLatencyStats) );
+        device->writeStatus = 1;
+      }
+    }
+    
+    // Write() checks the layout with only the outputs lock held
+    {
+      std::lock_guard<std::mutex> outputsGuard( outputsLock );
+      cycleLayout.order = config.order;
+    }
+    cycleLayout.isInterleaved = config.isInterleaved;
+    cycleLayout.Compute = config.Compute;
+    cycleLayout.computeData = config.computeData;
+    
+    isCycleConfigPending = false;
+  }
+  
+  for( DeviceData* device : runningDevices )
+  {
+    if( !device->isConfigPending.load() ) continue;
+    
+    std::lock_guard<std::mutex> lock( configLock );
+    std::lock_guard<std::mutex> outputsGuard( outputsLock );
+    device->config = device->pendingConfig;
+    for( unsigned int channel = 0; channel < SIGNAL_IO_EPOS_INPUT_CHANNELS_NUMBER; channel++ )
+    {
+      device->maxInputAges[ channel ] = device->config.maxInputAges[ channel ];
+      device->fetchTimeouts[ channel ] = device->config.fetchTimeouts[ channel ];
+    }
+    device->isConfigPending = false;
+  }
+}
+
+// Clamps setpoints to the configured limits. Called with outputsLock held or from the transfer thread
+static double LimitSetpoint( DeviceData* device, unsigned int channel, double value )
+{
+  if( !device->config.areOutputLimitsEnabled[ channel ] ) return value;
+  
+  return std::max( device->config.outputMinimums[ channel ], std::min( value, device->config.outputMaximums[ channel ] ) );
+}
+
+// Applies the configured first-order low-pass filter over the time elapsed since the previous sample
+static void StoreInput( DeviceData* device, unsigned int channel, double value )
+{
+  double sampleTime = GetTime();
+  double filterTime = device->config.inputFilterTimes[ channel ];
+  double lastSampleTime = device->inputTimes[ channel ];
+  if( filterTime > 0.0 && lastSampleTime > 0.0 )
+  {
+    double lastValue = device->inputValues[ channel ];
+    double elapsedTime = sampleTime - lastSampleTime;
+    value = lastValue + elapsedTime / ( filterTime + elapsedTime ) * ( value - lastValue );
+  }
+  device->inputValues[ channel ] = value;
+  device->inputTimes[ channel ] = sampleTime;
+}
+
+// Ending devices are left at the next transaction boundary. Channels with a rate divider are only read every that many
+// cycles, except for priority fetches (isFetch), which read them all without counting a cycle
+static void ReadInputs( DeviceData* device, bool isFetch )
+{
+  if( device->isEnding ) return;
+  
+  if( device->isListenOnly ) 
+  {
+    ReadMonitorFrames( device );
+    return;
+  }
+  
+  // Feedback transactions would take the drive SDO server over from a raw upload
+  if( device->isUploading ) return;
+  
+  bool isChannelRead[ SIGNAL_IO_EPOS_INPUT_CHANNELS_NUMBER ];
+  bool isAnyChannelRead = false;
+  unsigned long cycleIndex = isFetch ? 0 : device->readCyclesCount++;
+  for( unsigned int channel = 0; channel < SIGNAL_IO_EPOS_INPUT_CHANNELS_NUMBER; channel++ )
+  {
+    unsigned int rateDivider = device->config.inputRateDividers[ channel ];
+    isChannelRead[ channel ] = ( isFetch || rateDivider <= 1 || cycleIndex % rateDivider == 0 );
+    isAnyChannelRead = isAnyChannelRead || isChannelRead[ channel ];
+  }
+  if( !isAnyChannelRead ) return;
+  
+  int position = device->rawInputs[ 0 ], velocity = device->rawInputs[ 1 ];
+  short current = (short) device->rawInputs[ 2 ];
+  DWORD errorCode = 0;
+  
+  double spanStartTime;
+  if( isChannelRead[ 0 ] )
+  {
+    spanStartTime = StartTransaction( "VCS_GetPositionIs", device->nodeId );
+    device->readStatus = VCS_GetPositionIs( device->handle, device->nodeId, &position, &errorCode );
+    EndTransaction( "VCS_GetPositionIs", device->nodeId, spanStartTime );
+    StoreInput( device, 0, (double) position );
+    if( device->isEnding ) return;
+  }
+  if( isChannelRead[ 1 ] )
+  {
+    spanStartTime = StartTransaction( "VCS_GetVelocityIs", device->nodeId );
+    device->readStatus = VCS_GetVelocityIs( device->handle, device->nodeId, &velocity, &errorCode );
+    EndTransaction( "VCS_GetVelocityIs", device->nodeId, spanStartTime );
+    StoreInput( device, 1, (double) velocity );
+    if( device->isEnding ) return;
+  }
+  if( isChannelRead[ 2 ] )
+  {
+    spanStartTime = StartTransaction( "VCS_GetCurrentIsAveraged", device->nodeId );
+    device->readStatus = VCS_GetCurrentIsAveraged( device->handle, device->nodeId, &current, &errorCode );
+    EndTransaction( "VCS_GetCurrentIsAveraged", device->nodeId, spanStartTime );
+    StoreInput( device, 2, (double) current );
+  }
+  device->rawInputs[ 0 ] = position;
+  device->rawInputs[ 1 ] = velocity;
+  device->rawInputs[ 2 ] = current;
+  // Samples of the cycle are stamped with the last channel read
+  unsigned int lastChannel = SIGNAL_IO_EPOS_INPUT_CHANNELS_NUMBER - 1;
+  while( !isChannelRead[ lastChannel ] ) lastChannel--;
+  double readTime = device->inputTimes[ lastChannel ];
+  
+  if( ( device->readStatus == 0 ) != device->isReadFaulted ) TRACEPOINT2( fault, GetDeviceID( device ), device->readStatus == 0 );
+  device->isReadFaulted = ( device->readStatus == 0 );
+  
+  if( device->areWindowsEnabled && !device->isEnding ) ReadTargetEvents( device );
+  
+  if( device->readStatus != 0 ) RecordInputHistory( device, readTime, position, velocity, current );
+  else
+  {
+    spanStartTime = StartTransaction( "VCS_ClearFault", device->nodeId );
+    device->readErrorCode = errorCode;
+    VCS_ClearFault( device->handle, device->nodeId, &errorCode );
+    EndTransaction( "VCS_ClearFault", device->nodeId, spanStartTime );
+  }
+  
+  // First feedback completed after a setpoint transmission closes its command-to-feedback delay
+  if( device->sentCommandTime > 0.0 )
+  {
+    std::lock_guard<std::mutex> lock( statsLock );
+    AddLatencySample( &(device->commandFeedbackDelay), readTime - device->sentCommandTime );
+    device->sentCommandTime = 0.0;
+  }
+  
+  StampSetpointTrace( device, -1, SIGNAL_IO_EPOS_TRACE_READBACK );
+  
+  UpdateLatencyProbe( device );
+}
+
+// Signed little endian field of a CAN frame
+static int DecodeFrameField( const unsigned char* frame, unsigned int offset, unsigned int size )
+{
+  unsigned int field = 0;
+  for( unsigned int byteIndex = 0; byteIndex < size; byteIndex++ )
+    field |= (unsigned int) frame[ offset + byteIndex ] << ( 8 * byteIndex );
+  
+  if( size == 1 ) return (signed char) field;
+  if( size == 2 ) return (short) field;
+  return (int) field;
+}
+
+// Takes the frames of the monitored node received since the last cycle, without a timeout, so that only 
+// the receive queue is polled and nothing is ever transmitted
+static void ReadMonitorFrames( DeviceData* device )
+{
+  MonitorMapping mappings[ SIGNAL_IO_EPOS_INPUT_CHANNELS_NUMBER ];
+  {
+    std::lock_guard<std::mutex> lock( device->monitor.lock );
+    memcpy( mappings, device->monitor.mappings, sizeof(mappings) );
+  }
+  
+  WORD cobIds[ SIGNAL_IO_EPOS_INPUT_CHANNELS_NUMBER + 2 ] = { (WORD) ( EMCY_COB_ID_BASE + device->nodeId ), (WORD) ( HEARTBEAT_COB_ID_BASE + device->nodeId ) };
+  size_t cobIdsNumber = 2;
+  for( unsigned int channel = 0; channel < SIGNAL_IO_EPOS_INPUT_CHANNELS_NUMBER; channel++ )
+  {
+    if( std::find( cobIds, cobIds + cobIdsNumber, mappings[ channel ].cobId ) == cobIds + cobIdsNumber ) 
+      cobIds[ cobIdsNumber++ ] = mappings[ channel ].cobId;
+  }
+  
+  bool isDecoded = false;
+  for( size_t cobIdIndex = 0; cobIdIndex < cobIdsNumber; cobIdIndex++ )
+  {
+    // Frames queued since the last cycle are taken in order, the last one setting the channel values
+    WORD cobId = cobIds[ cobIdIndex ];
+    for( int frameIndex = 0; frameIndex < MONITOR_FRAMES_MAX_NUMBER; frameIndex++ )
+    {
+      if( device->isEnding ) return;
+      
+      unsigned char frame[ CAN_FRAME_MAX_LENGTH ] = { 0 };
+      DWORD errorCode = 0;
+      double spanStartTime = StartTransaction( "VCS_ReadCANFrame", device->nodeId );
+      BOOL status = VCS_ReadCANFrame( device->handle, cobId, CAN_FRAME_MAX_LENGTH, frame, 0, &errorCode );
+      EndTransaction( "VCS_ReadCANFrame", device->nodeId, spanStartTime );
+      // Failing reads just mean no more frames with that identifier
+      if( status == 0 ) break;
+      
+      double frameTime = GetTime();
+      if( cobIdIndex == 0 )
+      {
+        WORD emergencyCode = (WORD) DecodeFrameField( frame, 0, 2 );
+        std::lock_guard<std::mutex> lock( device->monitor.lock );
+        EposMonitorStatus* monitorStatus = &(device->monitor.status);
+        monitorStatus->emergencyCode = emergencyCode;
+        monitorStatus->errorRegister = frame[ 2 ];
+        monitorStatus->emergenciesCount++;
+        monitorStatus->emergencyTime = frameTime;
+        bool isFaulted = ( emergencyCode != 0 );
+        if( device->isFaulted.exchange( isFaulted ) != isFaulted ) TRACEPOINT2( fault, GetDeviceID( device ), isFaulted );
+      }
+      else if( cobIdIndex == 1 )
+      {
+        std::lock_guard<std::mutex> lock( device->monitor.lock );
+        device->monitor.status.nmtState = frame[ 0 ] & 0x7F;
+        device->monitor.status.heartbeatTime = frameTime;
+      }
+    
+      for( unsigned int channel = 0; channel < SIGNAL_IO_EPOS_INPUT_CHANNELS_NUMBER; channel++ )
+      {
+        if( mappings[ channel ].cobId != cobId ) continue;
+        int value = DecodeFrameField( frame, mappings[ channel ].offset, mappings[ channel ].size );
+        device->monitor.rawValues[ channel ] = value;
+        StoreInput( device, channel, (double) value );
+        isDecoded = true;
+      }
+    }
+  }
+  
+  // History samples hold the last value of every channel, whichever PDO updated them
+  if( isDecoded ) 
+  {
+    const int* rawValues = device->monitor.rawValues;
+    RecordInputHistory( device, GetTime(), rawValues[ 0 ], rawValues[ 1 ], (short) rawValues[ 2 ] );
+  }
+}
 
-  short mode = OMD_POSITION_MODE;
-  if( channel == 1 ) mode = OMD_VELOCITY_MODE;
-  if( channel == 2 ) mode = OMD_CURRENT_MODE;
+// Alternates the probe offset between 0 and amplitude, timing how long each step takes to cross half
+// amplitude in the matching feedback channel. Runs on the transfer thread after every feedback read
+static void UpdateLatencyProbe( DeviceData* device )
+{
+  // Set under the lock when the probe starts, so that reads without a probe running never take it here
+  if( !device->isProbeActive.load() ) return;
+  
+  LatencyProbe* probe = &(device->latencyProbe);
+  std::unique_lock<std::mutex> lock( outputsLock );
+  int channel = probe->channel;
+  if( probe->stepTime > 0.0 )
+  {
+    double feedbackChange = device->inputValues[ channel ] - probe->stepFeedback;
+    if( feedbackChange * probe->stepChange >= probe->stepChange * probe->stepChange / 2 )
+      AddLatencySample( &(probe->results), device->inputTimes[ channel ] - probe->stepTime );
+    else if( GetTime() - probe->stepTime > LATENCY_PROBE_TIMEOUT )
+      probe->lostSteps++;
+    else 
+      return;
+    
+    probe->stepTime = 0.0;
+    if( probe->remainingSteps > 0 ) probe->remainingSteps--;
+  }
   
+  // The last step always brings the setpoint back to its unperturbed value. 
+  // A released channel stops the probe, with no setpoint left to perturb
+  double nextOffset = ( probe->offset == 0.0 ) ? probe->amplitude : 0.0;
+  if( ( probe->remainingSteps == 0 && probe->offset == 0.0 ) || !device->isSetpointKnown[ channel ] )
+  {
+    probe->channel = -1;
+    device->isProbeActive = false;
+    return;
+  }
+  
+  probe->stepChange = nextOffset - probe->offset;
+  probe->stepFeedback = device->inputValues[ channel ];
+  probe->offset = nextOffset;
+  probe->stepTime = GetTime();
+  double setpoint = LimitSetpoint( device, channel, device->lastSetpoints[ channel ] + probe->offset );
+  lock.unlock();
   DWORD errorCode;
-  if( VCS_SetEnableState( device->handle, device->nodeId, &errorCode ) == 0 )
-    PrintError( errorCode );
-  if( VCS_SetOperationMode( device->handle, device->nodeId, mode, &errorCode ) == 0 )
+  if( SendSetpoint( device, channel, setpoint, &errorCode ) == 0 )
     PrintError( errorCode );
+}
 
-  return true;
+// Stage -1 drops the trace after a failed transmission. Stage statistics hold the time
+// since the previous stage, and the entry stage slot the whole entry-to-readback time.
+// Channel -1 matches the traced setpoint of any channel
+static void StampSetpointTrace( DeviceData* device, int channel, int stage )
+{
+  // Set under the lock before any stage is stamped, so that untraced setpoints and reads never take it here
+  if( !device->isTraceActive.load() ) return;
+  
+  // Enqueue is stamped by Write() with the lock already held
+  std::unique_lock<std::mutex> lock( outputsLock, std::defer_lock );
+  if( stage != SIGNAL_IO_EPOS_TRACE_ENQUEUE ) lock.lock();
+  
+  SetpointTrace* trace = &(device->setpointTrace);
+  if( trace->channel < 0 || ( channel >= 0 && trace->channel != channel ) ) return;
+  
+  if( stage < 0 )
+  {
+    trace->channel = -1;
+    trace->droppedTraces++;
+    device->isTraceActive = false;
+    return;
+  }
+  
+  if( trace->nextStage != stage ) return;
+  
+  trace->stageTimes[ stage ] = GetTime();
+  trace->nextStage = stage + 1;
+  
+  if( stage == SIGNAL_IO_EPOS_TRACE_READBACK )
+  {
+    for( int stageIndex = SIGNAL_IO_EPOS_TRACE_ENQUEUE; stageIndex < SIGNAL_IO_EPOS_TRACE_STAGES_NUMBER; stageIndex++ )
+      AddLatencySample( &(trace->stages[ stageIndex ]), trace->stageTimes[ stageIndex ] - trace->stageTimes[ stageIndex - 1 ] );
+    AddLatencySample( &(trace->stages[ SIGNAL_IO_EPOS_TRACE_ENTRY ]), trace->stageTimes[ stage ] - trace->stageTimes[ SIGNAL_IO_EPOS_TRACE_ENTRY ] );
+    trace->channel = -1;
+    device->isTraceActive = false;
+  }
 }
 
-void ReleaseOutputChannel( long int deviceID, unsigned int channel )
+static BOOL SendSetpoint( DeviceData* device, unsigned int channel, double value, DWORD* ref_errorCode )
 {
-  if( deviceID == SIGNAL_IO_DEVICE_INVALID_ID ) return;
+  const char* SETPOINT_CALL_NAMES[ SIGNAL_IO_EPOS_OUTPUT_CHANNELS_NUMBER ] = { "VCS_SetPositionMust", "VCS_SetVelocityMust", "VCS_SetCurrentMust" };
+  
+  if( channel >= SIGNAL_IO_EPOS_OUTPUT_CHANNELS_NUMBER ) return 0;
+  
+  SetpointPdo pdo;
+  {
+    std::lock_guard<std::mutex> lock( outputsLock );
+    pdo = device->setpointPdo;
+  }
+  
+  BOOL status = 0;
+  // Mapped setpoints are a single unconfirmed frame, little endian as the mapped object
+  if( pdo.channel == (int) channel )
+  {
+    unsigned char frame[ 4 ];
+    unsigned int setpoint = ( channel == 2 ) ? (unsigned short) (short) value : (unsigned int) (int) value;
+    WORD frameLength = ( channel == 2 ) ? 2 : 4;
+    for( WORD byteIndex = 0; byteIndex < frameLength; byteIndex++ )
+      frame[ byteIndex ] = (unsigned char) ( setpoint >> ( 8 * byteIndex ) );
+    double spanStartTime = StartTransaction( "VCS_SendCANFrame", device->nodeId );
+    status = VCS_SendCANFrame( device->handle, pdo.cobId, frameLength, frame, ref_errorCode );
+    EndTransaction( "VCS_SendCANFrame", device->nodeId, spanStartTime );
+    if( status != 0 ) device->setpointSentTime = GetTime();
+    return status;
+  }
+  
+  double spanStartTime = StartTransaction( SETPOINT_CALL_NAMES[ channel ], device->nodeId );
+  if( channel == 0 ) status = VCS_SetPositionMust( device->handle, device->nodeId, (long) value, ref_errorCode );
+  else if( channel == 1 ) status = VCS_SetVelocityMust( device->handle, device->nodeId, (long) value, ref_errorCode );
+  else if( channel == 2 ) status = VCS_SetCurrentMust( device->handle, device->nodeId, (short) value, ref_errorCode );
+  EndTransaction( SETPOINT_CALL_NAMES[ channel ], device->nodeId, spanStartTime );
+  
+  // Status words read from now on reflect the new target
+  if( status != 0 ) device->setpointSentTime = GetTime();
+  
+  return status;
+}
 
-  if( channel > 2 ) return;
+static void WriteOutputs( DeviceData* device )
+{
+  double outputValues[ SIGNAL_IO_EPOS_OUTPUT_CHANNELS_NUMBER ];
+  bool isOutputPending[ SIGNAL_IO_EPOS_OUTPUT_CHANNELS_NUMBER ];
+  double commandTime;
+  bool isUploading = device->isUploading;
+  {
+    std::lock_guard<std::mutex> lock( outputsLock );
+    memcpy( outputValues, device->outputValues, sizeof(outputValues) );
+    // Setpoints sent over SDO stay pending until a raw upload, which they would abort, ends
+    bool isOutputDeferred = false, isOutputTaken = false;
+    for( unsigned int channel = 0; channel < SIGNAL_IO_EPOS_OUTPUT_CHANNELS_NUMBER; channel++ )
+    {
+      isOutputPending[ channel ] = device->isOutputPending[ channel ];
+      if( isUploading && isOutputPending[ channel ] && device->setpointPdo.channel != (int) channel ) 
+      {
+        isOutputPending[ channel ] = false;
+        isOutputDeferred = true;
+      }
+      else device->isOutputPending[ channel ] = false;
+      if( isOutputPending[ channel ] ) isOutputTaken = true;
+    }
+    commandTime = device->commandTime;
+    if( !isOutputDeferred ) device->commandTime = 0.0;
+    else if( !isOutputTaken ) return;
+    int tracedChannel = device->setpointTrace.channel;
+    if( device->setpointTrace.nextStage == SIGNAL_IO_EPOS_TRACE_DEQUEUE && tracedChannel >= 0 && isOutputPending[ tracedChannel ] ) 
+    {
+      device->setpointTrace.stageTimes[ SIGNAL_IO_EPOS_TRACE_DEQUEUE ] = GetTime();
+      device->setpointTrace.nextStage = SIGNAL_IO_EPOS_TRACE_TRANSFER_START;
+    }
+  }
+  
+  if( commandTime == 0.0 ) return;
+  
+  for( unsigned int channel = 0; channel < SIGNAL_IO_EPOS_OUTPUT_CHANNELS_NUMBER; channel++ )
+  {
+    if( !isOutputPending[ channel ] ) continue;
+    if( device->isEnding ) return;
+    StampSetpointTrace( device, channel, SIGNAL_IO_EPOS_TRACE_TRANSFER_START );
+    DWORD errorCode = 0;
+    BOOL status = SendSetpoint( device, channel, outputValues[ channel ], &errorCode );
+    device->writeStatus = status;
+    StampSetpointTrace( device, channel, ( status != 0 ) ? SIGNAL_IO_EPOS_TRACE_TRANSFER_END : -1 );
+    if( status == 0 ) 
+    {
+      device->writeErrorCode = errorCode;
+      PrintError( errorCode );
+    }
+  }
+  
+  device->sentCommandTime = commandTime;
+}
 
-  DeviceData* device = (DeviceData*) deviceID;
+static void TransferDevice( DeviceData* device )
+{
+  ServeFetchRequests();
+  
+  if( device->isEnding ) return;
+  
+  // Only setpoints mapped to a PDO are left pending in the immediate writes layout
+  if( cycleLayout.order == SIGNAL_IO_EPOS_CYCLE_WRITES_READS || cycleLayout.order == SIGNAL_IO_EPOS_CYCLE_IMMEDIATE_WRITES ) 
+    WriteOutputs( device );
+  
+  ReadInputs( device, false );
+  
+  if( cycleLayout.order == SIGNAL_IO_EPOS_CYCLE_READS_COMPUTE_WRITES )
+  {
+    if( cycleLayout.Compute != NULL ) cycleLayout.Compute( GetDeviceID( device ), cycleLayout.computeData );
+    WriteOutputs( device );
+  }
+  
+  WriteAuxiliaryOutputs( device );
+}
 
+static BOOL SendUploadRequest( DeviceData* device, unsigned char* request, unsigned int* ref_framesBudget )
+{
   DWORD errorCode;
-  if( VCS_SetDisableState( device->handle, device->nodeId, &errorCode ) == 0 )
+  double spanStartTime = StartTransaction( "VCS_SendCANFrame", device->nodeId );
+  BOOL status = VCS_SendCANFrame( device->handle, SDO_REQUEST_COB_ID_BASE + device->nodeId, CAN_FRAME_MAX_LENGTH, request, &errorCode );
+  EndTransaction( "VCS_SendCANFrame", device->nodeId, spanStartTime );
+  if( status == 0 ) PrintError( errorCode );
+  
+  if( *ref_framesBudget > 0 ) (*ref_framesBudget)--;
+  device->upload.requestTime = GetTime();
+  
+  return status;
+}
+
+// Leaves the running state, telling the drive with an abort frame if abortCode is not 0 and the transfer
+// was already initiated. Called with the upload lock held
+static void EndObjectUpload( DeviceData* device, int state, DWORD abortCode )
+{
+  ObjectUpload* upload = &(device->upload);
+  if( abortCode != 0 && upload->phase != UPLOAD_PHASE_START )
+  {
+    unsigned char request[ CAN_FRAME_MAX_LENGTH ] = { 0x80, (unsigned char) upload->index, (unsigned char) ( upload->index >> 8 ), upload->subIndex };
+    for( int byteIndex = 0; byteIndex < 4; byteIndex++ )
+      request[ 4 + byteIndex ] = (unsigned char) ( abortCode >> ( 8 * byteIndex ) );
+    DWORD errorCode;
+    double spanStartTime = StartTransaction( "VCS_SendCANFrame", device->nodeId );
+    if( VCS_SendCANFrame( device->handle, SDO_REQUEST_COB_ID_BASE + device->nodeId, CAN_FRAME_MAX_LENGTH, request, &errorCode ) == 0 )
+      PrintError( errorCode );
+    EndTransaction( "VCS_SendCANFrame", device->nodeId, spanStartTime );
+  }
+  
+  upload->state = state;
+  upload->abortCode = abortCode;
+  if( state == SIGNAL_IO_EPOS_UPLOAD_DONE ) upload->totalSize = upload->bytesNumber;
+  device->isUploading = false;
+}
+
+// CiA 301 segmented and block upload client. Handles every response received since the last cycle and
+// sends the following requests, as long as frames are left in the cycle budget
+static void StepObjectUpload( DeviceData* device, unsigned int* ref_framesBudget )
+{
+  ObjectUpload* upload = &(device->upload);
+  std::lock_guard<std::mutex> lock( upload->lock );
+  if( upload->state != SIGNAL_IO_EPOS_UPLOAD_RUNNING || device->isEnding ) return;
+  
+  WORD responseCobId = SDO_RESPONSE_COB_ID_BASE + device->nodeId;
+  unsigned char request[ CAN_FRAME_MAX_LENGTH ] = { 0 };
+  DWORD errorCode;
+  if( upload->phase == UPLOAD_PHASE_START )
+  {
+    // Responses left over by a previous transfer would be taken for this one's
+    unsigned char staleResponse[ CAN_FRAME_MAX_LENGTH ];
+    for( int frameIndex = 0; frameIndex < SDO_BLOCK_SIZE; frameIndex++ )
+    {
+      double spanStartTime = StartTransaction( "VCS_ReadCANFrame", device->nodeId );
+      BOOL status = VCS_ReadCANFrame( device->handle, responseCobId, CAN_FRAME_MAX_LENGTH, staleResponse, 0, &errorCode );
+      EndTransaction( "VCS_ReadCANFrame", device->nodeId, spanStartTime );
+      if( status == 0 ) break;
+    }
+    request[ 0 ] = upload->isBlock ? 0xA0 : 0x40;
+    request[ 1 ] = (unsigned char) upload->index;
+    request[ 2 ] = (unsigned char) ( upload->index >> 8 );
+    request[ 3 ] = upload->subIndex;
+    request[ 4 ] = upload->isBlock ? SDO_BLOCK_SIZE : 0;
+    if( SendUploadRequest( device, request, ref_framesBudget ) == 0 ) return;
+    upload->phase = UPLOAD_PHASE_INITIATE;
+  }
+  
+  while( *ref_framesBudget > 0 )
+  {
+    unsigned char response[ CAN_FRAME_MAX_LENGTH ] = { 0 };
+    double spanStartTime = StartTransaction( "VCS_ReadCANFrame", device->nodeId );
+    BOOL status = VCS_ReadCANFrame( device->handle, responseCobId, CAN_FRAME_MAX_LENGTH, response, 0, &errorCode );
+    EndTransaction( "VCS_ReadCANFrame", device->nodeId, spanStartTime );
+    if( status == 0 )
+    {
+      if( GetTime() - upload->requestTime > UPLOAD_TIMEOUT ) EndObjectUpload( device, SIGNAL_IO_EPOS_UPLOAD_ABORTED, SDO_ABORT_TIMEOUT );
+      return;
+    }
+    (*ref_framesBudget)--;
+    
+    unsigned char command = response[ 0 ];
+    // Aborted by the drive
+    if( command == 0x80 )
+    {
+      EndObjectUpload( device, SIGNAL_IO_EPOS_UPLOAD_ABORTED, 0 );
+      upload->abortCode = (DWORD) DecodeFrameField( response, 4, 4 );
+      return;
+    }
+    
+    memset( request, 0, sizeof(request) );
+    if( upload->phase == UPLOAD_PHASE_INITIATE && !upload->isBlock && ( command & 0xE0 ) == 0x40 )
+    {
+      // Expedited responses already hold the whole value
+      if( command & 0x02 )
+      {
+        unsigned int dataLength = ( command & 0x01 ) ? 4 - ( ( command >> 2 ) & 0x03 ) : 4;
+        upload->bytesNumber = std::min( dataLength, upload->size );
+        memcpy( upload->data, response + 4, upload->bytesNumber );
+        EndObjectUpload( device, SIGNAL_IO_EPOS_UPLOAD_DONE, 0 );
+        return;
+      }
+      if( command & 0x01 ) upload->totalSize = (unsigned int) DecodeFrameField( response, 4, 4 );
+      if( upload->totalSize > upload->size )
+      {
+        EndObjectUpload( device, SIGNAL_IO_EPOS_UPLOAD_ABORTED, SDO_ABORT_OUT_OF_MEMORY );
+        return;
+      }
+      upload->toggle = false;
+      upload->phase = UPLOAD_PHASE_SEGMENT;
+      request[ 0 ] = 0x60;
+    }
+    else if( upload->phase == UPLOAD_PHASE_SEGMENT && ( command & 0xE0 ) == 0x00 && ( ( command & 0x10 ) != 0 ) == upload->toggle )
+    {
+      unsigned int dataLength = std::min( 7u - ( ( command >> 1 ) & 0x07 ), upload->size - upload->bytesNumber );
+      memcpy( upload->data + upload->bytesNumber, response + 1, dataLength );
+      upload->bytesNumber += dataLength;
+      if( command & 0x01 ) 
+      {
+        EndObjectUpload( device, SIGNAL_IO_EPOS_UPLOAD_DONE, 0 );
+        return;
+      }
+      upload->toggle = !upload->toggle;
+      request[ 0 ] = 0x60 | ( upload->toggle ? 0x10 : 0x00 );
+    }
+    else if( upload->phase == UPLOAD_PHASE_INITIATE && upload->isBlock && ( command & 0xE0 ) == 0xC0 )
+    {
+      if( command & 0x02 ) upload->totalSize = (unsigned int) DecodeFrameField( response, 4, 4 );
+      if( upload->totalSize > upload->size )
+      {
+        EndObjectUpload( device, SIGNAL_IO_EPOS_UPLOAD_ABORTED, SDO_ABORT_OUT_OF_MEMORY );
+        return;
+      }
+      upload->sequenceNumber = 0;
+      upload->phase = UPLOAD_PHASE_BLOCK;
+      request[ 0 ] = 0xA3;
+    }
+    else if( upload->phase == UPLOAD_PHASE_BLOCK )
+    {
+      // Segments following a lost one are dropped, and sent again by the drive after the acknowledge
+      unsigned char sequenceNumber = command & 0x7F;
+      bool isLast = ( ( command & 0x80 ) != 0 );
+      bool isInOrder = ( sequenceNumber == upload->sequenceNumber + 1 );
+      if( isInOrder )
+      {
+        unsigned int dataLength = std::min( 7u, upload->size - std::min( upload->bytesNumber, upload->size ) );
+        memcpy( upload->data + upload->bytesNumber, response + 1, dataLength );
+        upload->bytesNumber += 7;
+        upload->sequenceNumber = sequenceNumber;
+      }
+      if( !isLast && sequenceNumber < SDO_BLOCK_SIZE ) continue;
+      request[ 0 ] = 0xA2;
+      request[ 1 ] = upload->sequenceNumber;
+      request[ 2 ] = SDO_BLOCK_SIZE;
+      if( isLast && isInOrder ) upload->phase = UPLOAD_PHASE_BLOCK_END;
+      upload->sequenceNumber = 0;
+    }
+    else if( upload->phase == UPLOAD_PHASE_BLOCK_END && ( command & 0xE3 ) == 0xC1 )
+    {
+      upload->bytesNumber = std::min( upload->bytesNumber - ( ( command >> 2 ) & 0x07 ), upload->totalSize );
+      request[ 0 ] = 0xA1;
+      SendUploadRequest( device, request, ref_framesBudget );
+      EndObjectUpload( device, SIGNAL_IO_EPOS_UPLOAD_DONE, 0 );
+      return;
+    }
+    else
+    {
+      EndObjectUpload( device, SIGNAL_IO_EPOS_UPLOAD_ABORTED, SDO_ABORT_COMMAND );
+      return;
+    }
+    
+    if( SendUploadRequest( device, request, ref_framesBudget ) == 0 ) return;
+  }
+}
+
+// Shares the cycle frame budget among the running uploads
+static void StepObjectUploads( void )
+{
+  unsigned int framesBudget = uploadFrameBudget.load();
+  for( DeviceData* device : runningDevices )
+  {
+    if( framesBudget == 0 ) return;
+    if( device->isUploading ) StepObjectUpload( device, &framesBudget );
+  }
+}
+
+// Ends the cycle with one SYNC frame per bus with synchronous setpoint PDOs, so that their
+// setpoints, whenever sent, are latched by all drives at once. Called with devicesLock held
+static void SendSyncFrames( void )
+{
+  for( std::list<DeviceData*>::iterator deviceIterator = runningDevices.begin(); deviceIterator != runningDevices.end(); deviceIterator++ )
+  {
+    DeviceData* device = *deviceIterator;
+    if( !device->isSyncRequired || device->isEnding ) continue;
+    HANDLE handle = device->handle;
+    if( std::find_if( runningDevices.begin(), deviceIterator, [ handle ]( DeviceData* otherDevice ){ return otherDevice->handle == handle && otherDevice->isSyncRequired; } ) != deviceIterator ) 
+      continue;
+    unsigned char emptyData = 0;
+    DWORD errorCode;
+    double spanStartTime = StartTransaction( "VCS_SendCANFrame", device->nodeId );
+    if( VCS_SendCANFrame( handle, SYNC_COB_ID, 0, &emptyData, &errorCode ) == 0 ) PrintError( errorCode );
+    EndTransaction( "VCS_SendCANFrame", device->nodeId, spanStartTime );
+  }
+}
+
+// Sends the digital and analog output changes coalesced since the last cycle, reading digital outputs back
+static void WriteAuxiliaryOutputs( DeviceData* device )
+{
+  // Coalesced changes wait for the end of a raw upload, which their SDO transactions would abort
+  if( device->isUploading ) return;
+  
+  AuxiliaryOutputs outputs;
+  {
+    std::lock_guard<std::mutex> lock( outputsLock );
+    outputs = device->auxiliaryOutputs;
+    device->auxiliaryOutputs.digitalMask = 0;
+    memset( device->auxiliaryOutputs.isAnalogPending, 0, sizeof(device->auxiliaryOutputs.isAnalogPending) );
+  }
+  
+  DWORD errorCode = 0;
+  BOOL status = 1;
+  if( outputs.digitalMask != 0 && !device->isEnding )
+  {
+    // Unchanged bits keep the drive states, read once before the first change
+    WORD digitalStates = device->digitalOutputs;
+    if( !device->isDigitalOutputKnown )
+    {
+      double spanStartTime = StartTransaction( "VCS_GetAllDigitalOutputs", device->nodeId );
+      status = VCS_GetAllDigitalOutputs( device->handle, device->nodeId, &digitalStates, &errorCode );
+      EndTransaction( "VCS_GetAllDigitalOutputs", device->nodeId, spanStartTime );
+      device->isDigitalOutputKnown = ( status != 0 );
+    }
+    digitalStates = ( digitalStates & ~outputs.digitalMask ) | ( outputs.digitalStates & outputs.digitalMask );
+    double spanStartTime = StartTransaction( "VCS_SetAllDigitalOutputs", device->nodeId );
+    if( status != 0 ) status = VCS_SetAllDigitalOutputs( device->handle, device->nodeId, digitalStates, &errorCode );
+    EndTransaction( "VCS_SetAllDigitalOutputs", device->nodeId, spanStartTime );
+    spanStartTime = StartTransaction( "VCS_GetAllDigitalOutputs", device->nodeId );
+    if( status != 0 ) status = VCS_GetAllDigitalOutputs( device->handle, device->nodeId, &digitalStates, &errorCode );
+    EndTransaction( "VCS_GetAllDigitalOutputs", device->nodeId, spanStartTime );
+    if( status != 0 ) device->digitalOutputs = digitalStates;
+  }
+  
+  for( unsigned int output = 0; output < SIGNAL_IO_EPOS_ANALOG_OUTPUTS_NUMBER && status != 0; output++ )
+  {
+    if( !outputs.isAnalogPending[ output ] || device->isEnding ) continue;
+    double spanStartTime = StartTransaction( "VCS_SetAnalogOutput", device->nodeId );
+    status = VCS_SetAnalogOutput( device->handle, device->nodeId, output + 1, outputs.analogValues[ output ], &errorCode );
+    EndTransaction( "VCS_SetAnalogOutput", device->nodeId, spanStartTime );
+  }
+  
+  device->auxiliaryStatus = status;
+  if( status == 0 ) PrintError( errorCode );
+}
+
+// Priority fetches requested by Read() calls on stale channels are served between device transfers
+static void ServeFetchRequests( void )
+{
+  std::unique_lock<std::mutex> lock( fetchLock );
+  if( pendingFetchesNumber == 0 ) return;
+  
+  // Requests are flags on the devices, so that queueing them never allocates
+  for( DeviceData* device : runningDevices )
+  {
+    if( !device->isFetchRequested ) continue;
+    device->isFetchRequested = false;
+    pendingFetchesNumber--;
+    lock.unlock();
+    ReadInputs( device, true );
+    lock.lock();
+  }
+  
+  fetchEvent.notify_all();
+}
+
+// Drops devices ended by EndDevice() from the transfer list, releasing the transfer thread references,
+// and stops the thread once no device is left. Called by the transfer thread with devicesLock held
+static void RemoveEndingDevices( void )
+{
+  {
+    std::lock_guard<std::mutex> lock( fetchLock );
+    if( endingDevicesNumber == 0 ) return;
+    endingDevicesNumber = 0;
+  }
+  
+  for( std::list<DeviceData*>::iterator deviceIterator = runningDevices.begin(); deviceIterator != runningDevices.end(); )
+  {
+    DeviceData* device = *deviceIterator;
+    if( !device->isEnding ) 
+    {
+      deviceIterator++;
+      continue;
+    }
+    deviceIterator = runningDevices.erase( deviceIterator );
+    // Stopping before the release, as EndDevice() only joins stopped threads
+    if( runningDevices.empty() ) isRunning = false;
+    device->isTransferred = false;
+    ReleaseDevice( device );
+  }
+}
+
+// Checksum tying a warm start position and marker to their device configuration
+static unsigned int GetWarmStartToken( const char* configuration, int position, unsigned int marker )
+{
+  char record[ CONFIGURATION_STRING_MAX_SIZE + 32 ];
+  snprintf( record, sizeof(record), "%s\n%d %x", configuration, position, marker );
+  
+  unsigned int token = 2166136261u;
+  for( const char* character = record; *character != '\0'; character++ )
+    token = ( token ^ (unsigned char) *character ) * 16777619u;
+  
+  return token;
+}
+
+// One record per configuration, with the separators replaced to get a file name
+static bool GetWarmStartPath( const DeviceData* device, char* ref_path )
+{
+  std::lock_guard<std::mutex> lock( configLock );
+  if( warmStartDirectory[ 0 ] == '\0' ) return false;
+  
+  int pathLength = snprintf( ref_path, WARM_START_PATH_MAX_LENGTH, "%s/%s.warm", warmStartDirectory, device->configuration );
+  for( char* character = ref_path + strlen( warmStartDirectory ) + 1; character < ref_path + pathLength; character++ )
+  {
+    if( *character == ':' || *character == '/' || *character == '\\' ) *character = '_';
+  }
+  
+  return true;
+}
+
+// Called by EndDevice() once no other call uses the device. The record is written to a temporary file 
+// first, so that an interrupted shutdown never leaves a partial one. Moving axes get no record. The marker, 
+// when enabled, is only left in drive RAM (never stored), and differs from the ones of earlier sessions
+static void SaveWarmStart( DeviceData* device )
+{
+  char filePath[ WARM_START_PATH_MAX_LENGTH ];
+  if( !GetWarmStartPath( device, filePath ) ) return;
+  
+  remove( filePath );
+  
+  int position = 0, velocity = 1;
+  DWORD errorCode;
+  double spanStartTime = StartTransaction( "VCS_GetVelocityIs", device->nodeId );
+  BOOL status = VCS_GetVelocityIs( device->handle, device->nodeId, &velocity, &errorCode );
+  EndTransaction( "VCS_GetVelocityIs", device->nodeId, spanStartTime );
+  if( status != 0 )
+  {
+    spanStartTime = StartTransaction( "VCS_GetPositionIs", device->nodeId );
+    status = VCS_GetPositionIs( device->handle, device->nodeId, &position, &errorCode );
+    EndTransaction( "VCS_GetPositionIs", device->nodeId, spanStartTime );
+  }
+  if( status == 0 )
+  {
     PrintError( errorCode );
+    return;
+  }
+  if( velocity != 0 ) return;
   
-  return;
-} 
+  WORD markerIndex;
+  unsigned char markerSubIndex;
+  {
+    std::lock_guard<std::mutex> lock( configLock );
+    markerIndex = warmStartMarkerIndex;
+    markerSubIndex = warmStartMarkerSubIndex;
+  }
+  unsigned int marker = 0;
+  if( markerIndex != 0 )
+  {
+    marker = GetWarmStartToken( device->configuration, position, (unsigned int) std::chrono::steady_clock::now().time_since_epoch().count() );
+    if( marker == 0 ) marker = 1;
+    DWORD bytesNumber = 0;
+    spanStartTime = StartTransaction( "VCS_SetObject", device->nodeId );
+    status = VCS_SetObject( device->handle, device->nodeId, markerIndex, markerSubIndex, &marker, sizeof(marker), &bytesNumber, &errorCode );
+    EndTransaction( "VCS_SetObject", device->nodeId, spanStartTime );
+    if( status == 0 )
+    {
+      PrintError( errorCode );
+      return;
+    }
+  }
+  
+  char temporaryPath[ WARM_START_PATH_MAX_LENGTH + 4 ];
+  snprintf( temporaryPath, sizeof(temporaryPath), "%s.tmp", filePath );
+  FILE* warmStartFile = fopen( temporaryPath, "w" );
+  if( warmStartFile == NULL )
+  {
+    fprintf( stderr, "error: cannot open warm start file %s\n", temporaryPath );
+    return;
+  }
+  fprintf( warmStartFile, "%s\n%d %x %x\n", device->configuration, position, marker, GetWarmStartToken( device->configuration, position, marker ) );
+  if( fclose( warmStartFile ) != 0 || rename( temporaryPath, filePath ) != 0 ) remove( temporaryPath );
+}
+
+static void CloseDevice( DeviceData* device )
+{
+  DWORD errorCode;
+  if( VCS_CloseDevice( device->handle, &errorCode ) == 0 ) 
+    PrintError( errorCode );
+  
+  FreeInputHistory( &(device->inputHistory) );
+  device->~DeviceData();
+  ReleaseMemory( device );
+}
+
+// Only the first call of each consumer cycle marks its phase, as many channels are usually read at once
+static void RegisterConsumerAccess( void )
+{
+  if( !transferCycle.isPhaseLocked ) return;
+  
+  double accessTime = GetTime();
+  if( accessTime - transferCycle.lastAccessTime.load() > transferCycle.period / 2 )
+    transferCycle.lastAccessTime.store( accessTime );
+}
+
+// PI phase locked loop: shifts the next cycle start so that its samples are ready phaseLead seconds before consumer access
+static double LockCyclePhase( double cycleEndTime )
+{
+  double accessTime = transferCycle.lastAccessTime.load();
+  if( !transferCycle.isPhaseLocked || accessTime == 0.0 ) return 0.0;
+  
+  double period = transferCycle.period;
+  double phaseError = fmod( accessTime - transferCycle.phaseLead - cycleEndTime, period );
+  if( phaseError > period / 2 ) phaseError -= period;
+  else if( phaseError < -period / 2 ) phaseError += period;
+  
+  double periodCorrection = transferCycle.periodCorrection + PHASE_LOCK_INTEGRAL_GAIN * phaseError;
+  periodCorrection = std::max( -period / 4, std::min( periodCorrection, period / 4 ) );
+  transferCycle.phaseError = phaseError;
+  transferCycle.periodCorrection = periodCorrection;
+  
+  double startShift = PHASE_LOCK_PROPORTIONAL_GAIN * phaseError + periodCorrection;
+  return std::max( -period / 4, std::min( startShift, period / 4 ) );
+}
+
+// Sleep until next cycle start, still serving priority fetches meanwhile
+static void WaitCycleStart( double cycleStartTime )
+{
+  while( isRunning )
+  {
+    {
+      std::unique_lock<std::mutex> lock( fetchLock );
+      transferWait.isWaiting = true;
+      transferWait.deadline = cycleStartTime;
+      transferWait.count++;
+      bool isRequested = WaitUntil( fetchRequestEvent, lock, cycleStartTime, []{ return pendingFetchesNumber > 0 || endingDevicesNumber > 0 || !isRunning; } );
+      transferWait.isWaiting = false;
+      if( !isRequested ) return;
+    }
+    std::lock_guard<std::mutex> lock( devicesLock );
+    RemoveEndingDevices();
+    ServeFetchRequests();
+  }
+}
+
+static void EndCaptureWriter( void )
+{
+  std::lock_guard<std::mutex> lock( captureLock );
+  cycleCapture.isWriterActive = false;
+  captureEvent.notify_all();
+}
+
+// Chrome trace event format (JSON array of complete events, in microseconds), loadable by chrome://tracing and Perfetto
+static void WriteCaptureFile( TraceSpan* spans, size_t spansNumber, const char* filePath )
+{
+  FILE* captureFile = fopen( filePath, "w" );
+  if( captureFile == NULL )
+  {
+    fprintf( stderr, "error: cannot open capture file %s\n", filePath );
+    ReleaseMemory( spans );
+    EndCaptureWriter();
+    return;
+  }
+  
+  fprintf( captureFile, "{\"traceEvents\":[\n" );
+  fprintf( captureFile, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"transfer\"}}", CAPTURE_TRANSFER_THREAD_ID );
+  // Each consumer thread gets its own track, so that their overlapping spans do not nest
+  std::vector<int> consumerThreadIds;
+  for( size_t spanIndex = 0; spanIndex < spansNumber; spanIndex++ )
+  {
+    if( spans[ spanIndex ].threadId != CAPTURE_TRANSFER_THREAD_ID ) consumerThreadIds.push_back( spans[ spanIndex ].threadId );
+  }
+  std::sort( consumerThreadIds.begin(), consumerThreadIds.end() );
+  consumerThreadIds.erase( std::unique( consumerThreadIds.begin(), consumerThreadIds.end() ), consumerThreadIds.end() );
+  for( int threadId : consumerThreadIds )
+    fprintf( captureFile, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"consumer %d\"}}", threadId, threadId - CAPTURE_CONSUMER_THREAD_ID + 1 );
+  double originTime = ( spansNumber > 0 ) ? spans[ 0 ].startTime : 0.0;
+  for( size_t spanIndex = 0; spanIndex < spansNumber; spanIndex++ )
+  {
+    TraceSpan* span = &(spans[ spanIndex ]);
+    if( span->startTime < originTime ) originTime = span->startTime;
+  }
+  for( size_t spanIndex = 0; spanIndex < spansNumber; spanIndex++ )
+  {
+    TraceSpan* span = &(spans[ spanIndex ]);
+    fprintf( captureFile, ",\n{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f,\"args\":{\"node\":%u}}",
+             span->name, ( span->nodeId == 0 ) ? "cycle" : "vcs", span->threadId, 
+             ( span->startTime - originTime ) * 1e6, ( span->endTime - span->startTime ) * 1e6, span->nodeId );
+  }
+  fprintf( captureFile, "\n]}\n" );
+  
+  fclose( captureFile );
+  
+  ReleaseMemory( spans );
+  
+  EndCaptureWriter();
+}
+
+// Called by the transfer thread at each cycle end: hands the filled buffer to a writer thread.
+// Consumers that saw the capture active may still be writing their span, in which case the handoff is retried at
+// the next cycle end instead of stalling this one. Only cycles recorded from their start (cycleStartTime > 0) are
+// counted. Returns whether the capture is still pending
+static bool UpdateCycleCapture( double cycleStartTime )
+{
+  if( cycleStartTime > 0.0 ) EndSpan( "cycle", 0, cycleStartTime );
+  
+  std::lock_guard<std::mutex> lock( captureLock );
+  
+  if( cycleCapture.isActive.load( std::memory_order_relaxed ) && cycleStartTime > 0.0 )
+  {
+    if( --cycleCapture.remainingCycles > 0 && cycleCapture.spansCount.load() < cycleCapture.maxSpansNumber ) return true;
+    
+    cycleCapture.isActive.store( false );
+    cycleCapture.isHandoffPending = true;
+  }
+  
+  if( !cycleCapture.isHandoffPending ) return false;
+  if( cycleCapture.writersCount.load() > 0 ) return true;
+  
+  cycleCapture.isHandoffPending = false;
+  cycleCapture.isWriterActive = true;
+  size_t spansNumber = std::min( cycleCapture.spansCount.load(), cycleCapture.maxSpansNumber );
+  std::thread( WriteCaptureFile, cycleCapture.spans, spansNumber, cycleCapture.filePath ).detach();
+  cycleCapture.spans = NULL;
+  
+  return false;
+}
 
 static void AsyncTransfer( void )
 {  
-  int iValue = 0;
-  short sValue = 0;
+  double cycleStartTime = GetTime();
   
-  isRunning = true;
+  isTransferThread = true;
+  
+  double lastTransferStartTime = 0.0;
   
   while( isRunning )
   {
-    for( DeviceData* device : runningDevices )
+    double transferStartTime = GetTime();
+    
+    std::unique_lock<std::mutex> lock( devicesLock );
+    RemoveEndingDevices();
+    TRACEPOINT1( cycle__start, runningDevices.size() );
+    ApplyPendingConfigs();
+    if( cycleLayout.isInterleaved || cycleLayout.order == SIGNAL_IO_EPOS_CYCLE_IMMEDIATE_WRITES )
     {
-      device->readStatus = VCS_GetPositionIs( device->handle, device->nodeId, &iValue, &(device->readErrorCode) );
-      device->inputValues[ 0 ] = (double) iValue;
-      device->readStatus = VCS_GetVelocityIs( device->handle, device->nodeId, &iValue, &(device->readErrorCode) );
-      device->inputValues[ 1 ] = (double) iValue;
-      device->readStatus = VCS_GetCurrentIsAveraged( device->handle, device->nodeId, &sValue, &(device->readErrorCode) );
-      device->inputValues[ 2 ] = (double) sValue;
-      
-      if( device->readStatus == 0 ) VCS_ClearFault( device->handle, device->nodeId, &(device->readErrorCode) );
-      
-      //iValue = (long) device->outputValues[ 0 ];
-      //device->writeStatus = VCS_SetPositionMust( device->handle, device->nodeId, iValue, &(device->writeErrorCode) );
-      //iValue = (long) device->outputValues[ 1 ];
-      //device->writeStatus = VCS_SetVelocityMust( device->handle, device->nodeId, iValue, &(device->writeErrorCode) );
-      //sValue = (short) device->outputValues[ 2 ];
-      //device->writeStatus = VCS_SetCurrentMust( device->handle, device->nodeId, sValue, &(device->writeErrorCode) );
+      for( DeviceData* device : runningDevices )
+        TransferDevice( device );
+    }
+    else
+    {
+      if( cycleLayout.order == SIGNAL_IO_EPOS_CYCLE_WRITES_READS )
+      {
+        for( DeviceData* device : runningDevices )
+          WriteOutputs( device );
+      }
+      for( DeviceData* device : runningDevices )
+      {
+        ServeFetchRequests();
+        ReadInputs( device, false );
+      }
+      if( cycleLayout.order == SIGNAL_IO_EPOS_CYCLE_READS_COMPUTE_WRITES )
+      {
+        if( cycleLayout.Compute != NULL ) cycleLayout.Compute( SIGNAL_IO_DEVICE_INVALID_ID, cycleLayout.computeData );
+        for( DeviceData* device : runningDevices )
+          WriteOutputs( device );
+      }
+      for( DeviceData* device : runningDevices )
+        WriteAuxiliaryOutputs( device );
+    }
+    StepObjectUploads();
+    SendSyncFrames();
+    UpdateCycleCapture( cycleCapture.isActive.load() ? transferStartTime : 0.0 );
+    TRACEPOINT1( cycle__end, runningDevices.size() );
+    
+    lock.unlock();
+    
+    double cycleEndTime = GetTime();
+    std::unique_lock<std::mutex> statsGuard( statsLock );
+    transferStats.cyclesCount++;
+    AddLatencySample( &(transferStats.cycleDurations), cycleEndTime - transferStartTime );
+    if( lastTransferStartTime > 0.0 ) AddLatencySample( &(transferStats.cyclePeriods), transferStartTime - lastTransferStartTime );
+    statsGuard.unlock();
+    lastTransferStartTime = transferStartTime;
+    
+    if( transferCycle.period > 0.0 )
+    {
+      cycleStartTime += transferCycle.period + LockCyclePhase( cycleEndTime );
+      if( cycleStartTime < cycleEndTime ) // Overrun: restart schedule from now
+      {
+        overrunsCount++;
+        cycleStartTime = cycleEndTime; 
+      }
+      WaitCycleStart( cycleStartTime );
+    }
+    else cycleStartTime = cycleEndTime;
+  }
+  
+  // A capture interrupted by the transfer thread end still gets saved. With no later cycle, the spans
+  // still being written are waited for
+  {
+    std::lock_guard<std::mutex> lock( captureLock );
+    if( cycleCapture.isActive.load() ) 
+    {
+      cycleCapture.isActive.store( false );
+      cycleCapture.isHandoffPending = true;
     }
   }
+  while( UpdateCycleCapture( 0.0 ) )
+    std::this_thread::yield();
   
   return;
 }
@@ -0,0 +1,440 @@
+////////////////////////////////////////////////////////////////////////////////
+//                                                                            //
+//  Copyright (c) 2019 Leonardo Consoni <leonardjc@protonmail.com>            //
+//                                                                            //
+//  This file is part of Signal-IO-EposCmd.                                   //
+//                                                                            //
+//  Signal-IO-EposCmd is free software: you can redistribute it and/or modify //
+//  it under the terms of the GNU Lesser General Public License as published  //
+//  by the Free Software Foundation, either version 3 of the License, or      //
+//  (at your option) any later version.                                       //
+//                                                                            //
+//  Signal-IO-EposCmd is distributed in the hope that it will be useful,      //
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of            //
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the              //
+//  GNU Lesser General Public License for more details.                       //
+//                                                                            //
+//  You should have received a copy of the GNU Lesser General Public License  //
+//  along with Signal-IO-EposCmd. If not, see <http://www.gnu.org/licenses/>. //
+//                                                                            //
+////////////////////////////////////////////////////////////////////////////////
+
+// EposCmd specific extensions to the generic Signal I/O interface.
+// Exported with C linkage, so they can also be loaded by name from the module
+
+#ifndef SIGNAL_IO_EPOS_H
+#define SIGNAL_IO_EPOS_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stddef.h>
+#include <stdbool.h>
+
+// Input channels: 0 - position, 1 - velocity, 2 - averaged current
+#define SIGNAL_IO_EPOS_INPUT_CHANNELS_NUMBER 3
+// Output channels: 0 - position setpoint, 1 - velocity setpoint, 2 - current setpoint
+#define SIGNAL_IO_EPOS_OUTPUT_CHANNELS_NUMBER 3
+
+#define SIGNAL_IO_EPOS_LATENCY_BINS_NUMBER 32
+
+// Latency distribution in seconds. Bin 0 counts values below 2us, bin i counts values
+// in [2^i, 2^(i+1)) us, and the last bin everything above
+typedef struct EposLatencyStats
+{
+  unsigned long count;
+  double minimum, maximum, mean;
+  unsigned long bins[ SIGNAL_IO_EPOS_LATENCY_BINS_NUMBER ];
+}
+EposLatencyStats;
+
+// Transfer thread health figures
+typedef struct EposTransferStats
+{
+  unsigned long cyclesCount;
+  unsigned long overrunsCount;          // Cycles that ended after the next one should have started
+  EposLatencyStats cycleDurations;      // Time spent transferring in each cycle
+  EposLatencyStats cyclePeriods;        // Time between consecutive cycle starts
+  EposLatencyStats fetchLatencies;      // Time Read() calls spent waiting for priority fetches
+  unsigned long fetchTimeoutsCount;
+}
+EposTransferStats;
+
+// Maximum age (in seconds) of a cached input sample before Read() requests a priority fetch
+// from the transfer thread, waiting at most fetchTimeout seconds for it. A maxAge of 0 (default)
+// always returns the cached value. Read() returns 0 samples if no fresh value arrived in time
+bool SetInputChannelMaxAge( long int deviceID, unsigned int channel, double maxAge, double fetchTimeout );
+
+// Address of the device's last input values (SIGNAL_IO_EPOS_INPUT_CHANNELS_NUMBER std::atomic<double>, filtered),
+// stored by the transfer thread and valid until EndDevice(). Used by signal_io_epos.hpp for inlined cached reads,
+// which unlike Read() do not fail while an object upload (StartObjectUpload()) holds the last values
+const void* GetInputSnapshot( long int deviceID );
+
+// Fixed transfer cycle period in seconds (0, the default, means free-running transfers).
+// If phase locked, the cycle start is continuously adjusted from the timing of Read()/Write()
+// calls, so that fresh samples get ready phaseLead seconds before the consumer reads them.
+// Applied at the next cycle boundary, as a cycle configuration update
+bool SetTransferCycle( double period, bool isPhaseLocked, double phaseLead );
+
+// Last measured phase error and accumulated period correction (in seconds) of the phase lock
+bool GetTransferCyclePhase( double* ref_phaseError, double* ref_periodCorrection );
+
+// Intra-cycle ordering of setpoint transmission and feedback reading
+enum 
+{ 
+  SIGNAL_IO_EPOS_CYCLE_IMMEDIATE_WRITES,     // Write() transmits from the caller thread (default)
+  SIGNAL_IO_EPOS_CYCLE_WRITES_READS,         // Buffered setpoints are sent before feedback is read
+  SIGNAL_IO_EPOS_CYCLE_READS_COMPUTE_WRITES  // Feedback is read, Compute is called, then setpoints are sent
+};
+
+// Sets the cycle layout. Interleaved layouts run the write/read phases device by device instead of
+// over all devices at once. Compute is called from the transfer thread with the device ID for
+// interleaved layouts, or -1 once per cycle otherwise. It should only use non-blocking (cached) reads
+bool SetTransferCycleLayout( int order, bool isInterleaved, void (*Compute)( long int, void* ), void* computeData );
+
+// Module-wide transfer settings (see SetTransferCycle() and SetTransferCycleLayout())
+typedef struct EposCycleConfig
+{
+  double period;
+  bool isPhaseLocked;
+  double phaseLead;
+  int order;
+  bool isInterleaved;
+  void (*Compute)( long int, void* );
+  void* computeData;
+}
+EposCycleConfig;
+
+// Per device settings. All zero (the default) means no filtering and no limits
+typedef struct EposDeviceConfig
+{
+  double maxInputAges[ SIGNAL_IO_EPOS_INPUT_CHANNELS_NUMBER ];      // See SetInputChannelMaxAge()
+  double fetchTimeouts[ SIGNAL_IO_EPOS_INPUT_CHANNELS_NUMBER ];
+  double inputFilterTimes[ SIGNAL_IO_EPOS_INPUT_CHANNELS_NUMBER ];  // First-order low-pass time constants in seconds (0 disables)
+  unsigned int inputRateDividers[ SIGNAL_IO_EPOS_INPUT_CHANNELS_NUMBER ];  // Channels read every N cycles (0 and 1 read every cycle)
+  bool areOutputLimitsEnabled[ SIGNAL_IO_EPOS_OUTPUT_CHANNELS_NUMBER ];
+  double outputMinimums[ SIGNAL_IO_EPOS_OUTPUT_CHANNELS_NUMBER ];   // If enabled, setpoints are clamped to [minimum, maximum]
+  double outputMaximums[ SIGNAL_IO_EPOS_OUTPUT_CHANNELS_NUMBER ];   // (equal bounds pin the output)
+}
+EposDeviceConfig;
+
+// Configuration updates are validated in the caller thread and swapped in by the transfer thread at the next
+// cycle boundary, as a whole, without interrupting polling. A newer update replaces one not yet swapped in.
+// Get functions return the last accepted configuration, whether already in effect or not
+bool UpdateCycleConfig( const EposCycleConfig* config );
+bool GetCycleConfig( EposCycleConfig* ref_config );
+bool UpdateDeviceConfig( long int deviceID, const EposDeviceConfig* config );
+bool GetDeviceConfig( long int deviceID, EposDeviceConfig* ref_config );
+
+// Keeps the last samplesNumber successful feedback reads of the device in memory (0, the default, disables it).
+// Raw (unfiltered) samples are stored in their native EposCmd types, 18 bytes per read (time included) against 32
+// as doubles, and only converted when read back. Live values, returned by Read() and GetInputSnapshot(), stay doubles
+bool SetInputHistoryLength( long int deviceID, size_t samplesNumber );
+
+// Copies, oldest first, up to maxSamplesNumber history samples of the input channel read after startTime,
+// and their times if ref_times is not NULL. Returns the number of samples copied
+size_t ReadInputHistory( long int deviceID, unsigned int channel, double startTime, double* ref_times, double* ref_values, size_t maxSamplesNumber );
+
+// Rollup tiers of the input history, typically for 10 ms aggregates over minutes and 1 s aggregates over hours
+enum
+{
+  SIGNAL_IO_EPOS_ROLLUP_FINE,
+  SIGNAL_IO_EPOS_ROLLUP_COARSE,
+  SIGNAL_IO_EPOS_ROLLUP_TIERS_NUMBER
+};
+
+// Feedback aggregate over one rollup period
+typedef struct EposInputRollup
+{
+  double startTime;
+  unsigned long samplesCount;
+  double minimum, maximum, mean;
+}
+EposInputRollup;
+
+// Keeps the last bucketsNumber aggregates (minimum, maximum and mean) of feedback reads over consecutive periods
+// of the given length in seconds (0 buckets, the default, disables the tier). Updated on every successful read,
+// independently of the full rate history length, and with fixed memory
+bool SetInputRollup( long int deviceID, int tier, double period, size_t bucketsNumber );
+
+// Copies, oldest first, up to maxRollupsNumber aggregates of the input channel ending after startTime.
+// The last one is still being filled. Periods without successful reads have no aggregate
+size_t ReadInputRollup( long int deviceID, int tier, unsigned int channel, double startTime, EposInputRollup* ref_rollups, size_t maxRollupsNumber );
+
+// Event channels derived from the drive status word, received by the transfer thread while target windows are enabled
+enum
+{
+  SIGNAL_IO_EPOS_EVENT_IN_WINDOW,       // Actual value kept inside the window of the drive operation mode for the window time
+  SIGNAL_IO_EPOS_EVENT_TARGET_REACHED,  // Window entered again after being left for the last setpoint transmitted
+  SIGNAL_IO_EPOS_EVENTS_NUMBER
+};
+
+typedef struct EposEvent
+{
+  bool isActive;          // Current state
+  unsigned long count;    // Activations since the windows were set
+  double lastTime;        // Time of the last activation
+}
+EposEvent;
+
+// Configures the drive position and velocity windows (in drive units, with window times in ms; 0 disables them),
+// so that the drive itself detects arrival and flags it in its status word, instead of the host comparing positions.
+// The status word is mapped to TPDO4, sent on change, and the node started, so that no transaction is added to the
+// cycle: only CANopen devices are supported, and TPDO4 is taken over while windows are enabled
+bool SetTargetWindows( long int deviceID, unsigned int positionWindow, unsigned short positionWindowTime, unsigned int velocityWindow, unsigned short velocityWindowTime );
+
+// Copies the state of the event channel. Returns false if no target window is enabled
+bool ReadEvent( long int deviceID, unsigned int channel, EposEvent* ref_event );
+
+#define SIGNAL_IO_EPOS_ANALOG_OUTPUTS_NUMBER 2
+
+// Sets the drive digital outputs selected by mask to the matching bits of states. Changes made in the same
+// cycle are coalesced and sent by the transfer thread (VCS_SetAllDigitalOutputs), followed by a readback.
+// Returns false if the last digital or analog output transmission failed
+bool WriteDigitalOutputs( long int deviceID, unsigned short mask, unsigned short states );
+
+// Digital output states last read back from the drive
+bool ReadDigitalOutputs( long int deviceID, unsigned short* ref_states );
+
+// Sets the raw value of analog output 0 or 1 (drive outputs 1 and 2), sent by the transfer thread at
+// the end of the cycle (VCS_SetAnalogOutput). Only the last value written in a cycle is sent
+bool WriteAnalogOutput( long int deviceID, unsigned int output, unsigned short value );
+
+// Bus state of a listen-only node, decoded from its emergency (0x80 + node ID) and heartbeat (0x700 + node ID) frames
+typedef struct EposMonitorStatus
+{
+  unsigned char nmtState;           // Last heartbeat state (0x00 boot-up, 0x04 stopped, 0x05 operational, 0x7F pre-operational)
+  double heartbeatTime;             // Time of the last heartbeat (0 if none received yet)
+  unsigned short emergencyCode;     // Last emergency error code (0 after an error reset emergency)
+  unsigned char errorRegister;      // Error register of the last emergency
+  unsigned long emergenciesCount;   // Emergencies received since initialization
+  double emergencyTime;             // Time of the last emergency
+}
+EposMonitorStatus;
+
+// Maps an input channel of a listen-only device (configuration string ending in ":listen") to a signed little endian
+// field of the PDO with the given COB-ID (any TPDO or RPDO), at byte offset with size 1, 2 or 4 bytes.
+// Defaults: position from TPDO1 (0x180 + node ID) bytes 0-3, velocity from TPDO1 bytes 4-7 and current from TPDO2
+// (0x280 + node ID) bytes 0-1. Channels are updated, and timestamped, whenever their PDO is received
+bool SetMonitorMapping( long int deviceID, unsigned int channel, unsigned short cobId, unsigned int offset, unsigned int size );
+
+// Copies the bus state of a listen-only device. HasError() also reports its last emergency as a fault
+bool GetMonitorStatus( long int deviceID, EposMonitorStatus* ref_status );
+
+// Acquires the output channel channels[ i ] of each device deviceIDs[ i ] at once, as for AcquireOutputChannel(),
+// sequencing the devices of different buses concurrently. Each device costs 2 transactions (operation mode and enable
+// writes, checked by their acknowledgements), plus an enable state read back if isConfirmed.
+// Returns the number of channels acquired, ref_results (devicesNumber entries, optional) telling which ones
+size_t AcquireOutputChannels( const long int* deviceIDs, const unsigned int* channels, size_t devicesNumber, bool isConfirmed, bool* ref_results );
+
+// Reads a drive object (VCS_GetObject). With useCache, meant for static parameters only (e.g. motor data, encoder
+// resolution, velocity units, max following error), the first read of the object goes to the bus and later ones of
+// at most the same size are served from memory, as values changed by the drive itself are never seen again until
+// the cache is invalidated. Only reads filling the whole buffer are cached. Without useCache the bus is always read
+bool ReadDriveObject( long int deviceID, unsigned short index, unsigned char subIndex, void* ref_data, unsigned int size, unsigned int* ref_bytesNumber, bool useCache );
+
+// Writes the drive object (VCS_SetObject), updating its cached value
+bool WriteDriveObject( long int deviceID, unsigned short index, unsigned char subIndex, const void* data, unsigned int size );
+
+// CANopen only. Sends the setpoints of the output channel (-1 reverts to SDO transactions) through RPDO pdoNumber
+// (1 to 4, COB-ID 0x200, 0x300, 0x400 or 0x500 + node ID), as single unconfirmed frames (VCS_SendCANFrame) instead of
+// SDO round trips. The PDO is mapped here to the drive object receiving the setpoints (e.g. 0x2062:00, position mode
+// setting value on EPOS2, or 0x607A:00, target position on EPOS4), and the node is started. Synchronous PDOs are only
+// latched by the drives on the SYNC frame the transfer thread sends to each bus at every cycle end, so that all
+// axes move together. These setpoints are always sent by the transfer thread, at its next cycle, even in the
+// SIGNAL_IO_EPOS_CYCLE_IMMEDIATE_WRITES layout. As frames are not confirmed, Write() success only means the last one was sent
+bool SetSetpointPdo( long int deviceID, int channel, unsigned int pdoNumber, unsigned short objectIndex, unsigned char objectSubIndex, bool isSynchronous );
+
+// States of raw SDO uploads
+enum
+{
+  SIGNAL_IO_EPOS_UPLOAD_IDLE,
+  SIGNAL_IO_EPOS_UPLOAD_RUNNING,
+  SIGNAL_IO_EPOS_UPLOAD_DONE,
+  SIGNAL_IO_EPOS_UPLOAD_ABORTED
+};
+
+// CANopen only. Starts reading a large drive object (e.g. recorder buffer, error history, parameter table) into
+// ref_data, which must stay valid until the upload ends, with a segmented or block SDO upload run by the transfer
+// thread over raw frames (VCS_SendCANFrame/VCS_ReadCANFrame). Each cycle it only handles the responses already
+// received, within the cycle frame budget, so other devices keep their usual cycle. As the drive SDO server is shared
+// with EposCmd transactions, which would make the drive abort the upload, the device feedback reads are deferred until
+// it ends, Read() failing meanwhile, and buffered setpoints and auxiliary outputs stay pending. Calls addressing the
+// device over SDO (e.g. Reset(), immediate Write(), ReadDriveObject() bus reads, WriteDriveObject()) fail meanwhile,
+// HasError() returning the last fault state read, and uploads only start once those in progress ended. Setpoints sent
+// through RPDOs are not held back
+bool StartObjectUpload( long int deviceID, unsigned short index, unsigned char subIndex, void* ref_data, unsigned int size, bool isBlock );
+
+// Returns the upload state, with the bytes received so far and, for aborted uploads, the SDO abort code
+int GetObjectUploadState( long int deviceID, unsigned int* ref_bytesNumber, unsigned int* ref_abortCode );
+
+// Aborts the running upload of the device, after which its data buffer is no longer used
+bool CancelObjectUpload( long int deviceID );
+
+// Maximum number of frames, sent and received, all uploads exchange in one transfer cycle (16 by default)
+bool SetUploadFrameBudget( unsigned int framesNumber );
+
+// Restores the drive default parameters (VCS_Restore). Like Reset(), drops every cached object
+bool RestoreDriveParameters( long int deviceID );
+
+// Drops every cached object of the device, e.g. after parameters were changed by other tools
+bool InvalidateObjectCache( long int deviceID );
+
+// Blocking configuration operations that can be submitted for asynchronous completion
+enum
+{
+  SIGNAL_IO_EPOS_COMMAND_ACQUIRE,             // AcquireOutputChannel()
+  SIGNAL_IO_EPOS_COMMAND_RELEASE,             // ReleaseOutputChannel(), always succeeding
+  SIGNAL_IO_EPOS_COMMAND_RESET,               // Reset(), succeeding once the drive left its fault state
+  SIGNAL_IO_EPOS_COMMAND_RESTORE_WARM_START,  // RestoreWarmStart(), the homing alternative
+  SIGNAL_IO_EPOS_COMMAND_WRITE_OBJECT,        // WriteDriveObject()
+  SIGNAL_IO_EPOS_COMMAND_RESTORE_PARAMETERS,  // RestoreDriveParameters()
+  SIGNAL_IO_EPOS_COMMANDS_NUMBER
+};
+
+typedef struct EposCommand
+{
+  int type;
+  unsigned int channel;       // Output channel to acquire or release
+  unsigned short index;       // Object to write
+  unsigned char subIndex;
+  const void* data;           // Copied on submission
+  unsigned int size;
+}
+EposCommand;
+
+// Queues the command and returns at once. Commands run in submission order on a worker thread of the device's
+// bus, started on demand, so that one supervisory thread can drive many axes at once. Complete( result,
+// completionData ), if not NULL, is then called from that worker, which it holds from running the next command
+// of the bus. A queued command keeps its device from being freed, and fails if the device was ended meanwhile
+bool SubmitCommand( long int deviceID, const EposCommand* command, void (*Complete)( bool, void* ), void* completionData );
+
+// Delay from a Write() call to the first feedback completed after its transmission.
+// Statistics are restarted whenever the cycle layout changes
+bool GetCommandFeedbackDelay( long int deviceID, EposLatencyStats* ref_stats );
+
+// Closed-loop latency probe: alternately adds and removes a known offset (amplitude) to the setpoints
+// of the given output channel, for stepsNumber steps, and measures how long each step takes to show
+// up in the matching feedback channel (position, velocity or current). Fails unless a setpoint was written to the
+// channel since it was acquired, as offsets apply to it. Releasing the channel stops the probe
+bool StartLatencyProbe( long int deviceID, unsigned int channel, double amplitude, unsigned long stepsNumber );
+
+// Command-to-feedback latency distribution measured by the probe, and steps not detected within
+// the timeout. Returns true once the probe is finished
+bool GetLatencyProbeResults( long int deviceID, EposLatencyStats* ref_stats, unsigned long* ref_lostSteps );
+
+// Stages stamped on a traced setpoint
+enum
+{
+  SIGNAL_IO_EPOS_TRACE_ENTRY,           // Write() called
+  SIGNAL_IO_EPOS_TRACE_ENQUEUE,         // Setpoint buffered for the transfer thread
+  SIGNAL_IO_EPOS_TRACE_DEQUEUE,         // Setpoint taken by the transfer thread
+  SIGNAL_IO_EPOS_TRACE_TRANSFER_START,  // EposCmd call started
+  SIGNAL_IO_EPOS_TRACE_TRANSFER_END,    // EposCmd call returned
+  SIGNAL_IO_EPOS_TRACE_READBACK,        // Next feedback read completed
+  SIGNAL_IO_EPOS_TRACE_STAGES_NUMBER
+};
+
+// Traces one setpoint out of every interval Write() calls (0, the default, disables tracing).
+// Per device, only one setpoint is traced at a time. Changing the interval resets the statistics.
+// Untraced setpoints cost an atomic increment, and feedback reads an atomic load, on top of their usual locking
+bool SetSetpointTracing( unsigned long interval );
+
+// Fills ref_stages (SIGNAL_IO_EPOS_TRACE_STAGES_NUMBER entries) with the time distribution from the previous
+// stage to each stage. The entry slot holds the total entry-to-readback time instead. Traces of setpoints that
+// failed or were overwritten before transmission are counted in ref_droppedTraces
+bool GetSetpointTraceStats( long int deviceID, EposLatencyStats* ref_stages, unsigned long* ref_droppedTraces );
+
+// Records a span for every EposCmd transaction and transfer cycle over the next cyclesNumber cycles (or until
+// maxSpansNumber spans, preallocated here, are used), then writes them from a separate thread to filePath,
+// in Chrome trace event format (viewable with chrome://tracing or ui.perfetto.dev)
+bool StartCycleCapture( unsigned long cyclesNumber, size_t maxSpansNumber, const char* filePath );
+
+// Returns true when no capture is running and the last capture file was completely written
+bool IsCycleCaptureDone( void );
+
+// Copies the transfer statistics gathered since module start or the last reset
+bool GetTransferStats( EposTransferStats* ref_stats, bool reset );
+
+// Replaces the monotonic system clock used for every module timestamp, period and timeout by
+// GetTime( data ), in seconds (NULL restores the system clock). Only allowed with no device running.
+// The clock must be monotonic and may be virtual: NotifyTimeChange() should then be called whenever
+// it advances, so that pending waits are reevaluated immediately
+bool SetTimeSource( double (*GetTime)( void* ), void* data );
+void NotifyTimeChange( void );
+
+// Lock-step support for virtual clocks, which should only be advanced while the transfer thread is idle.
+// Returns true if it waits for the clock to reach ref_deadline before its next cycle, or is stopped
+// (ref_deadline set to infinity), and false while it runs. ref_waitsCount gets the number of waits entered
+// so far, telling whether the thread went through a cycle since the last call. Needs a cycle period
+bool GetTransferWaitState( double* ref_deadline, unsigned long* ref_waitsCount );
+
+// Maximum time in seconds (1 by default) EndDevice() waits for calls in progress on the device, the transfer
+// thread's included, to stop at their next transaction boundary. Past it, for instance with a transaction blocked
+// on the bus, EndDevice() returns anyway: the device is then closed by whichever call releases it last. The transfer
+// thread is only detached if it is the one blocked, and otherwise still joined once the last device ends. Ending the
+// last device also stops the idle command workers (leaving blocked ones behind) and waits as long for a capture file
+bool SetShutdownTimeout( double timeout );
+
+// Memory arena figures, in bytes
+typedef struct EposArenaStats
+{
+  size_t size;                          // Mapped size, rounded up to whole pages
+  size_t usedSize;                      // Blocks in use, with their 64 bytes headers
+  size_t peakUsedSize;
+  unsigned long failedAllocationsCount; // Requests that did not fit, failing the call that made them (container nodes go to the heap)
+  bool isHugePageBacked;                // Reserved hugepages. Otherwise transparent ones were only advised
+  bool isLocked;                        // Locked in RAM (mlock)
+}
+EposArenaStats;
+
+// Carves device data, input histories and rollups, capture buffers, object caches, and queued commands with their
+// payloads out of a single region of size bytes, mapped and pre-faulted here, optionally backed by hugepages and locked
+// in RAM, so that they cause no page fault after startup. Device and worker registries, threads, and the promises of the
+// C++ layer stay on the heap. Meant to be called before the first InitDevice(), as memory taken before stays on the
+// heap. A size of 0 (the default) goes back to the heap. Refused while blocks of the current arena are in use, which
+// command queues are until the last device ends
+bool SetMemoryArena( size_t size, bool useHugePages, bool lockPages );
+bool GetMemoryArenaStats( EposArenaStats* ref_stats );
+
+// Directory where EndDevice() records the position of stopped axes, one file per device configuration
+// (NULL, the default, disables the records). Axes whose brake holds them while unpowered can then skip homing
+bool SetWarmStartDirectory( const char* directoryPath );
+
+// Drive object (at least 4 bytes, otherwise unused, and never stored by the application, e.g. a spare user
+// parameter) where each record leaves a fresh marker in drive RAM, so that a power cycle since the record, which
+// resets the object to its stored value, fails the restore. An index of 0 (the default) disables the marker
+bool SetWarmStartMarker( unsigned short index, unsigned char subIndex );
+
+// Consumes the record of the device configuration and, if it is intact, the drive still holds its marker (if enabled),
+// and is standing still with no fault nor logged error, redefines the recorded position (VCS_DefinePosition), before
+// any output channel is acquired. Returns false when the axis has to be homed instead. Without a marker, the check is
+// best-effort: a power loss that logged no error on the drive (e.g. a clean power down) goes unnoticed
+bool RestoreWarmStart( long int deviceID );
+
+// Generic interface entry points with call counters
+enum
+{
+  SIGNAL_IO_EPOS_CALL_INIT_DEVICE,
+  SIGNAL_IO_EPOS_CALL_END_DEVICE,
+  SIGNAL_IO_EPOS_CALL_RESET,
+  SIGNAL_IO_EPOS_CALL_HAS_ERROR,
+  SIGNAL_IO_EPOS_CALL_GET_MAX_INPUT_SAMPLES_NUMBER,
+  SIGNAL_IO_EPOS_CALL_READ,
+  SIGNAL_IO_EPOS_CALL_CHECK_INPUT_CHANNEL,
+  SIGNAL_IO_EPOS_CALL_WRITE,
+  SIGNAL_IO_EPOS_CALL_ACQUIRE_OUTPUT_CHANNEL,
+  SIGNAL_IO_EPOS_CALL_RELEASE_OUTPUT_CHANNEL,
+  SIGNAL_IO_EPOS_CALLS_NUMBER
+};
+
+// Copies the number of calls made to each entry point since module load (SIGNAL_IO_EPOS_CALLS_NUMBER entries),
+// so that stress runs can check every concurrent call was accounted for
+bool GetCallCounts( unsigned long* ref_counts );
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // SIGNAL_IO_EPOS_H
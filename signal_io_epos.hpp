@@ -0,0 +1,225 @@
+////////////////////////////////////////////////////////////////////////////////
+//                                                                            //
+//  Copyright (c) 2019 Leonardo Consoni <leonardjc@protonmail.com>            //
+//                                                                            //
+//  This file is part of Signal-IO-EposCmd.                                   //
+//                                                                            //
+//  Signal-IO-EposCmd is free software: you can redistribute it and/or modify //
+//  it under the terms of the GNU Lesser General Public License as published  //
+//  by the Free Software Foundation, either version 3 of the License, or      //
+//  (at your option) any later version.                                       //
+//                                                                            //
+//  Signal-IO-EposCmd is distributed in the hope that it will be useful,      //
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of            //
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the              //
+//  GNU Lesser General Public License for more details.                       //
+//                                                                            //
+//  You should have received a copy of the GNU Lesser General Public License  //
+//  along with Signal-IO-EposCmd. If not, see <http://www.gnu.org/licenses/>. //
+//                                                                            //
+////////////////////////////////////////////////////////////////////////////////
+
+// Typed C++ layer over the generic interface and the EposCmd extensions, header only.
+// Channels are types, so that an out of range channel, or an input written as an output,
+// fails to compile instead of being rejected on each call
+
+#ifndef SIGNAL_IO_EPOS_HPP
+#define SIGNAL_IO_EPOS_HPP
+
+#include "interface/signal_io.h"
+#include "signal_io_epos.h"
+
+#include <atomic>
+#include <future>
+
+#if __cplusplus >= 202002L
+#include <span>
+#include <coroutine>
+#endif
+
+// Generic interface entry points of the module, declared here instead of through the interface macros,
+// so that including this header adds nothing but these prototypes to the consumer
+extern "C"
+{
+  long int InitDevice( const char* configuration );
+  void EndDevice( long int deviceID );
+  size_t GetMaxInputSamplesNumber( long int deviceID );
+  size_t Read( long int deviceID, unsigned int channel, double* ref_value );
+  bool HasError( long int deviceID );
+  void Reset( long int deviceID );
+  bool CheckInputChannel( long int deviceID, unsigned int channel );
+  bool Write( long int deviceID, unsigned int channel, double value );
+  bool AcquireOutputChannel( long int deviceID, unsigned int channel );
+  void ReleaseOutputChannel( long int deviceID, unsigned int channel );
+}
+
+namespace SignalIOEpos
+{
+  template< unsigned int CHANNEL >
+  struct InputChannel
+  {
+    static_assert( CHANNEL < SIGNAL_IO_EPOS_INPUT_CHANNELS_NUMBER, "invalid EPOS input channel" );
+  };
+  
+  template< unsigned int CHANNEL >
+  struct OutputChannel
+  {
+    static_assert( CHANNEL < SIGNAL_IO_EPOS_OUTPUT_CHANNELS_NUMBER, "invalid EPOS output channel" );
+  };
+  
+  typedef InputChannel<0> PositionInput;
+  typedef InputChannel<1> VelocityInput;
+  typedef InputChannel<2> CurrentInput;
+  typedef OutputChannel<0> PositionSetpoint;
+  typedef OutputChannel<1> VelocitySetpoint;
+  typedef OutputChannel<2> CurrentSetpoint;
+  
+  // Descriptors of the commands run asynchronously by the bus workers (see SubmitCommand())
+  template< unsigned int CHANNEL >
+  EposCommand AcquireCommand( OutputChannel<CHANNEL> ) { EposCommand command = {}; command.type = SIGNAL_IO_EPOS_COMMAND_ACQUIRE; command.channel = CHANNEL; return command; }
+  
+  template< unsigned int CHANNEL >
+  EposCommand ReleaseCommand( OutputChannel<CHANNEL> ) { EposCommand command = {}; command.type = SIGNAL_IO_EPOS_COMMAND_RELEASE; command.channel = CHANNEL; return command; }
+  
+  inline EposCommand ResetCommand() { EposCommand command = {}; command.type = SIGNAL_IO_EPOS_COMMAND_RESET; return command; }
+  
+  inline EposCommand RestoreWarmStartCommand() { EposCommand command = {}; command.type = SIGNAL_IO_EPOS_COMMAND_RESTORE_WARM_START; return command; }
+  
+  inline EposCommand RestoreParametersCommand() { EposCommand command = {}; command.type = SIGNAL_IO_EPOS_COMMAND_RESTORE_PARAMETERS; return command; }
+  
+  inline EposCommand WriteObjectCommand( unsigned short index, unsigned char subIndex, const void* data, unsigned int size )
+  {
+    EposCommand command = {};
+    command.type = SIGNAL_IO_EPOS_COMMAND_WRITE_OBJECT;
+    command.index = index;
+    command.subIndex = subIndex;
+    command.data = data;
+    command.size = size;
+    return command;
+  }
+  
+#if __cplusplus >= 202002L
+  // co_await result of a submitted command. The awaiting coroutine resumes on the bus worker thread,
+  // which runs no other command of the bus meanwhile: long work should be moved to another executor
+  class CommandAwaiter
+  {
+  public:
+    CommandAwaiter( long int deviceID, const EposCommand& command ) : deviceID( deviceID ), command( command ), result( false ) {}
+    
+    bool await_ready() const noexcept { return false; }
+    
+    // Nothing is touched after submission, as the completion may already resume the coroutine
+    bool await_suspend( std::coroutine_handle<> handle ) 
+    {
+      this->handle = handle;
+      return SubmitCommand( deviceID, &command, Resume, this );
+    }
+    
+    bool await_resume() const noexcept { return result; }
+    
+  private:
+    static void Resume( bool result, void* data )
+    {
+      CommandAwaiter* awaiter = static_cast<CommandAwaiter*>( data );
+      awaiter->result = result;
+      awaiter->handle.resume();
+    }
+    
+    long int deviceID;
+    EposCommand command;
+    bool result;
+    std::coroutine_handle<> handle;
+  };
+#endif
+  
+  // Non-owning device handle, as the module's long int ID, plus the address of its input snapshot.
+  // Copies stay valid until EndDevice(), called through End() or directly
+  class Device
+  {
+  public:
+    Device() : id( SIGNAL_IO_DEVICE_INVALID_ID ), inputValues( nullptr ) {}
+    
+    explicit Device( long int deviceID ) 
+      : id( deviceID ), inputValues( static_cast<const std::atomic<double>*>( GetInputSnapshot( deviceID ) ) ) {}
+    
+    static Device Init( const char* configuration ) { return Device( InitDevice( configuration ) ); }
+    
+    void End() { EndDevice( id ); id = SIGNAL_IO_DEVICE_INVALID_ID; inputValues = nullptr; }
+    
+    bool IsValid() const { return ( inputValues != nullptr ); }
+    
+    long int GetID() const { return id; }
+    
+    bool HasError() const { return ::HasError( id ); }
+    
+    void Reset() const { ::Reset( id ); }
+    
+    // Same as the generic Read(): fetches fresh samples if a maximum age is set, and marks the consumer phase
+    template< unsigned int CHANNEL >
+    bool Read( InputChannel<CHANNEL>, double& ref_value ) const { return ( ::Read( id, CHANNEL, &ref_value ) > 0 ); }
+    
+    // Last value stored by the transfer thread, inlined to a single atomic load, without freshness nor error checks.
+    // Only valid on a valid handle. Meant for hot loops and Compute callbacks
+    template< unsigned int CHANNEL >
+    double ReadCached( InputChannel<CHANNEL> ) const { return inputValues[ CHANNEL ].load( std::memory_order_acquire ); }
+    
+    template< unsigned int CHANNEL >
+    bool SetMaxAge( InputChannel<CHANNEL>, double maxAge, double fetchTimeout ) const 
+    { 
+      return SetInputChannelMaxAge( id, CHANNEL, maxAge, fetchTimeout ); 
+    }
+    
+    template< unsigned int CHANNEL >
+    bool Acquire( OutputChannel<CHANNEL> ) const { return AcquireOutputChannel( id, CHANNEL ); }
+    
+    template< unsigned int CHANNEL >
+    void Release( OutputChannel<CHANNEL> ) const { ReleaseOutputChannel( id, CHANNEL ); }
+    
+    template< unsigned int CHANNEL >
+    bool Write( OutputChannel<CHANNEL>, double value ) const { return ::Write( id, CHANNEL, value ); }
+    
+    // Future of the command result, set from the bus worker, e.g. to wait on many axes with one thread
+    std::future<bool> Submit( const EposCommand& command ) const
+    {
+      std::promise<bool>* promise = new std::promise<bool>();
+      std::future<bool> result = promise->get_future();
+      if( !SubmitCommand( id, &command, SetPromise, promise ) ) SetPromise( false, promise );
+      return result;
+    }
+    
+#if __cplusplus >= 202002L
+    CommandAwaiter Await( const EposCommand& command ) const { return CommandAwaiter( id, command ); }
+    
+    // Cached values of the given channels, in order, as one batch
+    template< unsigned int... CHANNELS >
+    void ReadCached( std::span<double, sizeof...(CHANNELS)> ref_values, InputChannel<CHANNELS>... channels ) const
+    {
+      size_t valueIndex = 0;
+      ( ( ref_values[ valueIndex++ ] = ReadCached( channels ) ), ... );
+    }
+    
+    // Input history of the channel after startTime, oldest first (see ReadInputHistory()). An empty
+    // ref_times skips the times. Returns the number of samples copied
+    template< unsigned int CHANNEL >
+    size_t ReadHistory( InputChannel<CHANNEL>, double startTime, std::span<double> ref_values, std::span<double> ref_times = {} ) const
+    {
+      size_t samplesNumber = ref_values.size();
+      if( !ref_times.empty() && ref_times.size() < samplesNumber ) samplesNumber = ref_times.size();
+      return ReadInputHistory( id, CHANNEL, startTime, ref_times.empty() ? nullptr : ref_times.data(), ref_values.data(), samplesNumber );
+    }
+#endif
+    
+  private:
+    static void SetPromise( bool result, void* data )
+    {
+      std::promise<bool>* promise = static_cast<std::promise<bool>*>( data );
+      promise->set_value( result );
+      delete promise;
+    }
+    
+    long int id;
+    const std::atomic<double>* inputValues;
+  };
+}
+
+#endif // SIGNAL_IO_EPOS_HPP
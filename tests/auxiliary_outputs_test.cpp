@@ -0,0 +1,97 @@
+////////////////////////////////////////////////////////////////////////////////
+//                                                                            //
+//  Copyright (c) 2019 Leonardo Consoni <leonardjc@protonmail.com>            //
+//                                                                            //
+//  This file is part of Signal-IO-EposCmd.                                   //
+//                                                                            //
+//  Signal-IO-EposCmd is free software: you can redistribute it and/or modify //
+//  it under the terms of the GNU Lesser General Public License as published  //
+//  by the Free Software Foundation, either version 3 of the License, or      //
+//  (at your option) any later version.                                       //
+//                                                                            //
+//  Signal-IO-EposCmd is distributed in the hope that it will be useful,      //
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of            //
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the              //
+//  GNU Lesser General Public License for more details.                       //
+//                                                                            //
+//  You should have received a copy of the GNU Lesser General Public License  //
+//  along with Signal-IO-EposCmd. If not, see <http://www.gnu.org/licenses/>. //
+//                                                                            //
+////////////////////////////////////////////////////////////////////////////////
+
+// Digital and analog output changes must be coalesced into one transmission per cycle: in lock-step virtual time,
+// where only transactions move the clock, each cycle lasts its three feedback reads plus exactly the output
+// transactions expected. Digital outputs are read back, unmasked bits keeping their states
+
+#include "simulated_bus_test.h"
+
+#include <stdlib.h>
+
+#define CYCLE_PERIOD 0.005
+#define FEEDBACK_READS_NUMBER 3
+#define TIME_TOLERANCE 1e-9
+
+static double transactionTime = 0.0;
+
+// Runs a single cycle, which must take the feedback reads and the given number of output transactions
+static void CheckCycleTransactions( int outputTransactionsNumber, const char* description )
+{
+  EposTransferStats stats;
+  GetTransferStats( &stats, true );
+  CHECK( StepVirtualTime( CYCLE_PERIOD ), "transfer thread not idle" );
+  CHECK( GetTransferStats( &stats, true ), "transfer statistics not read" );
+  double cycleDuration = ( FEEDBACK_READS_NUMBER + outputTransactionsNumber ) * transactionTime;
+  CHECK( stats.cyclesCount == 1 && fabs( stats.cycleDurations.minimum - cycleDuration ) < TIME_TOLERANCE && fabs( stats.cycleDurations.maximum - cycleDuration ) < TIME_TOLERANCE,
+         "%s: %lu cycles of %g to %g s instead of %g s", description, stats.cyclesCount, stats.cycleDurations.minimum, stats.cycleDurations.maximum, cycleDuration );
+}
+
+int main( int argc, char* argv[] )
+{
+  const char* transactionTimeValue = getenv( "EPOSCMD_SIMULATION_TRANSACTION_TIME" );
+  transactionTime = ( transactionTimeValue != NULL ) ? strtod( transactionTimeValue, NULL ) : 0.0;
+  if( transactionTime <= 0.0 ) 
+  {
+    fprintf( stderr, "simulation transaction time must be set\n" );
+    return 1;
+  }
+  
+  if( !UseVirtualTime() ) return 1;
+  
+  long int deviceID = InitSimulatedDevice( 0, 1 );
+  if( deviceID == SIGNAL_IO_DEVICE_INVALID_ID ) return 1;
+  SetTransferCycle( CYCLE_PERIOD, false, 0.0 );
+  CHECK( StepVirtualTime( CYCLE_PERIOD ), "transfer thread not idle" );
+  CheckCycleTransactions( 0, "idle cycle" );
+  
+  // The first change reads the drive states once, and every change is read back
+  unsigned short states = 0xFFFF;
+  CHECK( WriteDigitalOutputs( deviceID, 0x000F, 0x0005 ), "digital outputs not written" );
+  CHECK( ReadDigitalOutputs( deviceID, &states ) && states == 0x0000, "digital outputs 0x%04x before transmission", states );
+  CheckCycleTransactions( 3, "first digital change" );
+  CHECK( ReadDigitalOutputs( deviceID, &states ) && states == 0x0005, "digital outputs 0x%04x", states );
+  
+  // Changes of the same cycle are merged by mask, the last one winning on shared bits
+  CHECK( WriteDigitalOutputs( deviceID, 0x0003, 0x0002 ), "digital outputs not written" );
+  CHECK( WriteDigitalOutputs( deviceID, 0x0100, 0x0100 ), "digital outputs not written" );
+  CHECK( WriteDigitalOutputs( deviceID, 0x0001, 0x0001 ), "digital outputs not written" );
+  CheckCycleTransactions( 2, "coalesced digital changes" );
+  CHECK( ReadDigitalOutputs( deviceID, &states ) && states == 0x0107, "digital outputs 0x%04x", states );
+  
+  // Only the last value of each analog output is sent
+  CHECK( !WriteAnalogOutput( deviceID, SIGNAL_IO_EPOS_ANALOG_OUTPUTS_NUMBER, 1000 ), "invalid analog output written" );
+  CHECK( WriteAnalogOutput( deviceID, 0, 1000 ) && WriteAnalogOutput( deviceID, 0, 2000 ) && WriteAnalogOutput( deviceID, 0, 3000 ), "analog output not written" );
+  CheckCycleTransactions( 1, "coalesced analog values" );
+  CHECK( WriteAnalogOutput( deviceID, 0, 4000 ) && WriteAnalogOutput( deviceID, 1, 5000 ), "analog outputs not written" );
+  CHECK( WriteDigitalOutputs( deviceID, 0xFFFF, 0x0000 ), "digital outputs not written" );
+  CheckCycleTransactions( 4, "digital and analog changes" );
+  CHECK( ReadDigitalOutputs( deviceID, &states ) && states == 0x0000, "digital outputs 0x%04x", states );
+  
+  // Sent changes are not sent again
+  CheckCycleTransactions( 0, "cycle after changes" );
+  
+  EndDevice( deviceID );
+  
+  CHECK( !WriteDigitalOutputs( deviceID, 0x0001, 0x0001 ) && !ReadDigitalOutputs( deviceID, &states ), "outputs of ended device" );
+  
+  return failedChecksCount;
+}
@@ -0,0 +1,87 @@
+////////////////////////////////////////////////////////////////////////////////
+//                                                                            //
+//  Copyright (c) 2019 Leonardo Consoni <leonardjc@protonmail.com>            //
+//                                                                            //
+//  This file is part of Signal-IO-EposCmd.                                   //
+//                                                                            //
+//  Signal-IO-EposCmd is free software: you can redistribute it and/or modify //
+//  it under the terms of the GNU Lesser General Public License as published  //
+//  by the Free Software Foundation, either version 3 of the License, or      //
+//  (at your option) any later version.                                       //
+//                                                                            //
+//  Signal-IO-EposCmd is distributed in the hope that it will be useful,      //
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of            //
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the              //
+//  GNU Lesser General Public License for more details.                       //
+//                                                                            //
+//  You should have received a copy of the GNU Lesser General Public License  //
+//  along with Signal-IO-EposCmd. If not, see <http://www.gnu.org/licenses/>. //
+//                                                                            //
+////////////////////////////////////////////////////////////////////////////////
+
+
+// Acquiring the outputs of many axes on a single bus must cost 2 transactions per axis, plus 1 when confirmed.
+// Runs in virtual time, where only bus transactions move the clock, with a cycle long enough for none to run meanwhile
+
+#include "simulated_bus_test.h"
+
+#include <stdlib.h>
+
+#define DEVICES_NUMBER 12
+#define CYCLE_PERIOD 1.0
+#define TIME_TOLERANCE 1e-9
+
+int main( int argc, char* argv[] )
+{
+  const char* transactionTimeValue = getenv( "EPOSCMD_SIMULATION_TRANSACTION_TIME" );
+  double transactionTime = ( transactionTimeValue != NULL ) ? strtod( transactionTimeValue, NULL ) : 0.0;
+  if( transactionTime <= 0.0 ) 
+  {
+    fprintf( stderr, "simulation transaction time must be set\n" );
+    return 1;
+  }
+  
+  if( !UseVirtualTime() ) return 1;
+  
+  long int devices[ DEVICES_NUMBER ];
+  unsigned int channels[ DEVICES_NUMBER ];
+  for( size_t deviceIndex = 0; deviceIndex < DEVICES_NUMBER; deviceIndex++ )
+  {
+    devices[ deviceIndex ] = InitSimulatedDevice( 0, deviceIndex + 1 );
+    if( devices[ deviceIndex ] == SIGNAL_IO_DEVICE_INVALID_ID ) return 1;
+    channels[ deviceIndex ] = deviceIndex % SIGNAL_IO_EPOS_OUTPUT_CHANNELS_NUMBER;
+  }
+  SetTransferCycle( CYCLE_PERIOD, false, 0.0 );
+  CHECK( StepVirtualTime( CYCLE_PERIOD ), "transfer thread not idle" );
+  
+  bool results[ DEVICES_NUMBER ];
+  for( int confirmationIndex = 1; confirmationIndex >= 0; confirmationIndex-- )
+  {
+    bool isConfirmed = ( confirmationIndex == 1 );
+    double startTime = GetVirtualTime( NULL );
+    size_t acquiredNumber = AcquireOutputChannels( devices, channels, DEVICES_NUMBER, isConfirmed, results );
+    double busTime = GetVirtualTime( NULL ) - startTime;
+    double expectedBusTime = DEVICES_NUMBER * ( isConfirmed ? 3 : 2 ) * transactionTime;
+    printf( "%d axes on one bus%s: %g s (%g transactions)\n", DEVICES_NUMBER, isConfirmed ? ", confirmed" : "", busTime, busTime / transactionTime );
+    CHECK( acquiredNumber == DEVICES_NUMBER, "%zu channels acquired", acquiredNumber );
+    for( size_t deviceIndex = 0; deviceIndex < DEVICES_NUMBER; deviceIndex++ )
+      CHECK( results[ deviceIndex ], "device %zu not acquired", deviceIndex );
+    CHECK( fabs( busTime - expectedBusTime ) < TIME_TOLERANCE, "bus time %g, expected %g", busTime, expectedBusTime );
+    
+    for( size_t deviceIndex = 0; deviceIndex < DEVICES_NUMBER; deviceIndex++ )
+      ReleaseOutputChannel( devices[ deviceIndex ], channels[ deviceIndex ] );
+  }
+  
+  // Invalid entries are reported without touching the bus
+  long int invalidDevices[ 2 ] = { devices[ 0 ], SIGNAL_IO_DEVICE_INVALID_ID };
+  unsigned int invalidChannels[ 2 ] = { SIGNAL_IO_EPOS_OUTPUT_CHANNELS_NUMBER, 0 };
+  double startTime = GetVirtualTime( NULL );
+  CHECK( AcquireOutputChannels( invalidDevices, invalidChannels, 2, true, results ) == 0, "invalid entries acquired" );
+  CHECK( !results[ 0 ] && !results[ 1 ], "invalid entries reported as acquired" );
+  CHECK( GetVirtualTime( NULL ) == startTime, "bus used for invalid entries" );
+  
+  for( size_t deviceIndex = 0; deviceIndex < DEVICES_NUMBER; deviceIndex++ )
+    EndDevice( devices[ deviceIndex ] );
+  
+  return failedChecksCount;
+}
@@ -0,0 +1,14 @@
+# Checks that every static tracepoint of the module is listed in its stapsdt notes, under its literal name
+# Usage: cmake -DREADELF=<readelf> -DMODULE_FILE=<EposCmdIO.so> -P check_tracepoints.cmake
+
+execute_process( COMMAND ${READELF} -n ${MODULE_FILE} OUTPUT_VARIABLE NOTES RESULT_VARIABLE STATUS )
+if( NOT STATUS EQUAL 0 )
+  message( FATAL_ERROR "cannot read the notes of ${MODULE_FILE}" )
+endif()
+
+foreach( PROBE cycle__start cycle__end transaction__start transaction__end read write fetch__request fault queue__overflow )
+  if( NOT NOTES MATCHES "Provider: signal_io_epos[\r\n]+ *Name: ${PROBE}[\r\n]" )
+    message( FATAL_ERROR "probe signal_io_epos:${PROBE} missing from ${MODULE_FILE}" )
+  endif()
+  message( STATUS "probe signal_io_epos:${PROBE} found" )
+endforeach()
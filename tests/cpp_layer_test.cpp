@@ -0,0 +1,120 @@
+////////////////////////////////////////////////////////////////////////////////
+//                                                                            //
+//  Copyright (c) 2019 Leonardo Consoni <leonardjc@protonmail.com>            //
+//                                                                            //
+//  This file is part of Signal-IO-EposCmd.                                   //
+//                                                                            //
+//  Signal-IO-EposCmd is free software: you can redistribute it and/or modify //
+//  it under the terms of the GNU Lesser General Public License as published  //
+//  by the Free Software Foundation, either version 3 of the License, or      //
+//  (at your option) any later version.                                       //
+//                                                                            //
+//  Signal-IO-EposCmd is distributed in the hope that it will be useful,      //
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of            //
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the              //
+//  GNU Lesser General Public License for more details.                       //
+//                                                                            //
+//  You should have received a copy of the GNU Lesser General Public License  //
+//  along with Signal-IO-EposCmd. If not, see <http://www.gnu.org/licenses/>. //
+//                                                                            //
+////////////////////////////////////////////////////////////////////////////////
+
+// Typed C++ layer, built once as C++11 and once as C++20 (Await() and span reads) against the shared module:
+// reads and writes through channel types, and command results through futures and coroutines
+
+#include "signal_io_epos.hpp"
+
+#include <stdio.h>
+
+#include <thread>
+#include <chrono>
+
+// The layer declares the generic entry points itself, so the test helpers are only included for their checks
+#include "simulated_bus_test.h"
+
+#define WAIT_TIMEOUT 2.0
+
+using namespace SignalIOEpos;
+
+static bool WaitForPosition( const Device& device, double position )
+{
+  double deadline = GetTestTime() + WAIT_TIMEOUT;
+  while( device.ReadCached( PositionInput() ) != position && GetTestTime() < deadline )
+    std::this_thread::sleep_for( std::chrono::milliseconds( 1 ) );
+  return ( device.ReadCached( PositionInput() ) == position );
+}
+
+#if __cplusplus >= 202002L
+// Minimal eager coroutine, run until its first suspension by the caller and finished on the bus worker
+struct DetachedTask
+{
+  struct promise_type
+  {
+    DetachedTask get_return_object() { return {}; }
+    std::suspend_never initial_suspend() noexcept { return {}; }
+    std::suspend_never final_suspend() noexcept { return {}; }
+    void return_void() {}
+    void unhandled_exception() { std::terminate(); }
+  };
+};
+
+static DetachedTask AcquireAndRelease( Device device, std::promise<int>* ref_results )
+{
+  bool isAcquired = co_await device.Await( AcquireCommand( VelocitySetpoint() ) );
+  bool isReleased = co_await device.Await( ReleaseCommand( VelocitySetpoint() ) );
+  ref_results->set_value( ( isAcquired ? 1 : 0 ) + ( isReleased ? 2 : 0 ) );
+}
+#endif
+
+int main( int argc, char* argv[] )
+{
+  Device device = Device::Init( "EPOS4:CANopen:Kvaser:CAN0:1:1000000" );
+  CHECK( device.IsValid(), "device 0x%lx", device.GetID() );
+  if( !device.IsValid() ) return failedChecksCount;
+
+  // Immediate writes reach the drive from this thread, and feedback comes back through the transfer thread
+  CHECK( device.Acquire( PositionSetpoint() ), "position setpoint not acquired" );
+  CHECK( device.Write( PositionSetpoint(), 1000.0 ), "position setpoint not written" );
+  CHECK( WaitForPosition( device, 1000.0 ), "position %g", device.ReadCached( PositionInput() ) );
+  double position = 0.0;
+  CHECK( device.Read( PositionInput(), position ) && position == 1000.0, "read position %g", position );
+  CHECK( device.SetMaxAge( PositionInput(), 0.001, 0.1 ), "maximum age not set" );
+  CHECK( device.Read( PositionInput(), position ) && position == 1000.0, "fetched position %g", position );
+  CHECK( !device.HasError(), "device error" );
+
+  // Futures are set by the bus worker, in submission order
+  unsigned int value = 0x12345678, readValue = 0;
+  std::future<bool> writeResult = device.Submit( WriteObjectCommand( 0x2000, 0x01, &value, sizeof(value) ) );
+  std::future<bool> resetResult = device.Submit( ResetCommand() );
+  CHECK( writeResult.get(), "object write failed" );
+  CHECK( resetResult.get(), "reset failed" );
+  CHECK( ReadDriveObject( device.GetID(), 0x2000, 0x01, &readValue, sizeof(readValue), NULL, false ) && readValue == value, "object 0x%x", readValue );
+
+#if __cplusplus >= 202002L
+  std::promise<int> awaitResults;
+  std::future<int> awaitResultsFuture = awaitResults.get_future();
+  AcquireAndRelease( device, &awaitResults );
+  CHECK( awaitResultsFuture.wait_for( std::chrono::duration<double>( WAIT_TIMEOUT ) ) == std::future_status::ready, "coroutine not resumed" );
+  if( awaitResultsFuture.valid() ) CHECK( awaitResultsFuture.get() == 3, "acquire and release results" );
+
+  // Batch cached reads match channel by channel, and the history ends with the current feedback
+  CHECK( device.Acquire( PositionSetpoint() ) && device.Write( PositionSetpoint(), 2000.0 ), "second setpoint" );
+  CHECK( SetInputHistoryLength( device.GetID(), 64 ), "history not enabled" );
+  CHECK( WaitForPosition( device, 2000.0 ), "position %g", device.ReadCached( PositionInput() ) );
+  std::this_thread::sleep_for( std::chrono::milliseconds( 20 ) );
+  double values[ 3 ] = { 0.0, -1.0, -1.0 };
+  device.ReadCached( std::span<double, 3>( values ), PositionInput(), VelocityInput(), CurrentInput() );
+  CHECK( values[ 0 ] == 2000.0 && values[ 1 ] == 0.0 && values[ 2 ] == 0.0, "cached values %g %g %g", values[ 0 ], values[ 1 ], values[ 2 ] );
+  double historyValues[ 64 ], historyTimes[ 64 ];
+  size_t samplesNumber = device.ReadHistory( PositionInput(), 0.0, std::span<double>( historyValues ), std::span<double>( historyTimes ) );
+  CHECK( samplesNumber > 0 && historyValues[ samplesNumber - 1 ] == 2000.0, "%zu history samples", samplesNumber );
+  for( size_t sampleIndex = 1; sampleIndex < samplesNumber; sampleIndex++ )
+    CHECK( historyTimes[ sampleIndex ] > historyTimes[ sampleIndex - 1 ], "history time %zu", sampleIndex );
+  CHECK( device.ReadHistory( PositionInput(), 0.0, std::span<double>( historyValues ) ) == samplesNumber, "history without times" );
+#endif
+
+  device.End();
+  CHECK( !device.IsValid(), "handle still valid after End()" );
+
+  return failedChecksCount;
+}
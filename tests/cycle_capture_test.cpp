@@ -0,0 +1,182 @@
+////////////////////////////////////////////////////////////////////////////////
+//                                                                            //
+//  Copyright (c) 2019 Leonardo Consoni <leonardjc@protonmail.com>            //
+//                                                                            //
+//  This file is part of Signal-IO-EposCmd.                                   //
+//                                                                            //
+//  Signal-IO-EposCmd is free software: you can redistribute it and/or modify //
+//  it under the terms of the GNU Lesser General Public License as published  //
+//  by the Free Software Foundation, either version 3 of the License, or      //
+//  (at your option) any later version.                                       //
+//                                                                            //
+//  Signal-IO-EposCmd is distributed in the hope that it will be useful,      //
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of            //
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the              //
+//  GNU Lesser General Public License for more details.                       //
+//                                                                            //
+//  You should have received a copy of the GNU Lesser General Public License  //
+//  along with Signal-IO-EposCmd. If not, see <http://www.gnu.org/licenses/>. //
+//                                                                            //
+////////////////////////////////////////////////////////////////////////////////
+
+// Cycle captures must write a Chrome trace event file holding the requested cycles: in lock-step virtual time, every
+// cycle span lasts exactly as long as the bus transactions recorded inside it, consumer transactions get their own
+// track, and a capture ends early once its span buffer is full
+
+#include "simulated_bus_test.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <string>
+#include <vector>
+
+#define CYCLE_PERIOD 0.005
+#define CAPTURE_CYCLES_NUMBER 3
+#define MAX_SPANS_NUMBER 64
+#define FULL_SPANS_NUMBER 4
+#define CAPTURE_TIMEOUT 5.0  // Wall time given to the capture file writer
+#define TIME_TOLERANCE 0.002  // Printed times are rounded to nanoseconds, in microseconds
+
+#define CAPTURE_FILE_PATH "cycle_capture_test.json"
+#define FULL_CAPTURE_FILE_PATH "cycle_capture_full_test.json"
+
+typedef struct CaptureEvent
+{
+  std::string name, category;
+  int threadId;
+  double startTime, duration;
+  unsigned int nodeId;
+}
+CaptureEvent;
+
+static bool WaitCaptureDone( void )
+{
+  double timeoutTime = GetTestTime() + CAPTURE_TIMEOUT;
+  while( !IsCycleCaptureDone() )
+  {
+    if( GetTestTime() > timeoutTime ) return false;
+    std::this_thread::sleep_for( std::chrono::milliseconds( 1 ) );
+  }
+  return true;
+}
+
+// The writer puts one event per line, between the opening and closing lines of the event array.
+// Thread name metadata are kept in ref_threadNames as "<tid>:<name>"
+static bool ReadCaptureFile( const char* filePath, std::vector<CaptureEvent>& ref_events, std::vector<std::string>& ref_threadNames )
+{
+  FILE* captureFile = fopen( filePath, "r" );
+  if( captureFile == NULL ) return false;
+  
+  char line[ 512 ];
+  bool isOpened = false, isClosed = false, isValid = true;
+  while( fgets( line, sizeof(line), captureFile ) != NULL )
+  {
+    line[ strcspn( line, "\n" ) ] = '\0';
+    const char* event = ( line[ 0 ] == ',' ) ? line + 1 : line;
+    char name[ 64 ], category[ 16 ];
+    CaptureEvent captureEvent;
+    int threadId = 0;
+    if( strcmp( line, "{\"traceEvents\":[" ) == 0 ) isOpened = true;
+    else if( strcmp( line, "]}" ) == 0 ) isClosed = true;
+    else if( sscanf( event, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"%63[^\"]\"}}", &threadId, name ) == 2 )
+      ref_threadNames.push_back( std::to_string( threadId ) + ":" + name );
+    else if( sscanf( event, "{\"name\":\"%63[^\"]\",\"cat\":\"%15[^\"]\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%lf,\"dur\":%lf,\"args\":{\"node\":%u}}",
+                     name, category, &(captureEvent.threadId), &(captureEvent.startTime), &(captureEvent.duration), &(captureEvent.nodeId) ) == 6 )
+    {
+      captureEvent.name = name;
+      captureEvent.category = category;
+      ref_events.push_back( captureEvent );
+    }
+    else isValid = false;
+  }
+  fclose( captureFile );
+  
+  return ( isOpened && isClosed && isValid );
+}
+
+int main( int argc, char* argv[] )
+{
+  const char* transactionTimeValue = getenv( "EPOSCMD_SIMULATION_TRANSACTION_TIME" );
+  double transactionTime = ( transactionTimeValue != NULL ) ? strtod( transactionTimeValue, NULL ) : 0.0;
+  if( transactionTime <= 0.0 ) 
+  {
+    fprintf( stderr, "simulation transaction time must be set\n" );
+    return 1;
+  }
+  
+  if( !UseVirtualTime() ) return 1;
+  
+  long int deviceID = InitSimulatedDevice( 0, 1 );
+  if( deviceID == SIGNAL_IO_DEVICE_INVALID_ID ) return 1;
+  SetTransferCycle( CYCLE_PERIOD, false, 0.0 );
+  CHECK( StepVirtualTime( CYCLE_PERIOD ), "transfer thread not idle" );
+  
+  CHECK( !StartCycleCapture( 0, MAX_SPANS_NUMBER, CAPTURE_FILE_PATH ), "capture of no cycles started" );
+  CHECK( !StartCycleCapture( CAPTURE_CYCLES_NUMBER, 0, CAPTURE_FILE_PATH ), "capture without spans started" );
+  CHECK( !StartCycleCapture( CAPTURE_CYCLES_NUMBER, MAX_SPANS_NUMBER, std::string( 1024, 'x' ).c_str() ), "capture to overlong path started" );
+  
+  // Started between cycles, with one consumer transaction in the middle of the capture
+  remove( CAPTURE_FILE_PATH );
+  CHECK( StartCycleCapture( CAPTURE_CYCLES_NUMBER, MAX_SPANS_NUMBER, CAPTURE_FILE_PATH ), "capture not started" );
+  CHECK( !StartCycleCapture( CAPTURE_CYCLES_NUMBER, MAX_SPANS_NUMBER, FULL_CAPTURE_FILE_PATH ), "second capture started" );
+  CHECK( StepVirtualTime( CYCLE_PERIOD ), "transfer thread not idle" );
+  unsigned short statusWord = 0;
+  CHECK( ReadDriveObject( deviceID, 0x6041, 0x00, &statusWord, sizeof(statusWord), NULL, false ), "statusword not read" );
+  CHECK( StepVirtualTime( CAPTURE_CYCLES_NUMBER * CYCLE_PERIOD ), "transfer thread not idle" );
+  CHECK( WaitCaptureDone(), "capture not done" );
+  
+  std::vector<CaptureEvent> events;
+  std::vector<std::string> threadNames;
+  CHECK( ReadCaptureFile( CAPTURE_FILE_PATH, events, threadNames ), "capture file not parsed" );
+  CHECK( threadNames.size() == 2 && threadNames[ 0 ] == "1:transfer" && threadNames[ 1 ] == "2:consumer 1", "%zu thread names", threadNames.size() );
+  size_t cyclesCount = 0, consumerEventsCount = 0;
+  double originTime = HUGE_VAL;
+  for( const CaptureEvent& cycle : events )
+  {
+    if( cycle.startTime < originTime ) originTime = cycle.startTime;
+    if( cycle.threadId != 1 ) 
+    {
+      consumerEventsCount++;
+      CHECK( cycle.threadId == 2 && cycle.name == "VCS_GetObject" && cycle.nodeId == 1, "consumer event %s on thread %d", cycle.name.c_str(), cycle.threadId );
+      continue;
+    }
+    if( cycle.category != "cycle" ) 
+    {
+      CHECK( cycle.category == "vcs" && cycle.nodeId == 1, "event %s of category %s", cycle.name.c_str(), cycle.category.c_str() );
+      CHECK( fabs( cycle.duration - transactionTime * 1e6 ) < TIME_TOLERANCE, "%s lasting %.3f us", cycle.name.c_str(), cycle.duration );
+      continue;
+    }
+    cyclesCount++;
+    CHECK( cycle.name == "cycle" && cycle.nodeId == 0, "cycle event %s", cycle.name.c_str() );
+    // Only transactions move the clock, so that a cycle is its transactions back to back
+    double transactionsDuration = 0.0;
+    for( const CaptureEvent& transaction : events )
+    {
+      if( transaction.threadId == 1 && transaction.category == "vcs" && transaction.startTime >= cycle.startTime - TIME_TOLERANCE 
+          && transaction.startTime + transaction.duration <= cycle.startTime + cycle.duration + TIME_TOLERANCE )
+        transactionsDuration += transaction.duration;
+    }
+    CHECK( transactionsDuration > 0.0 && fabs( transactionsDuration - cycle.duration ) < TIME_TOLERANCE, "cycle of %.3f us with %.3f us of transactions", cycle.duration, transactionsDuration );
+  }
+  CHECK( cyclesCount == CAPTURE_CYCLES_NUMBER, "%zu cycles captured", cyclesCount );
+  CHECK( consumerEventsCount == 1, "%zu consumer events", consumerEventsCount );
+  CHECK( fabs( originTime ) < TIME_TOLERANCE, "first event at %.3f us", originTime );
+  
+  // A full buffer ends the capture at the cycle end, with no more spans than preallocated
+  remove( FULL_CAPTURE_FILE_PATH );
+  CHECK( StartCycleCapture( CAPTURE_CYCLES_NUMBER, FULL_SPANS_NUMBER, FULL_CAPTURE_FILE_PATH ), "full capture not started" );
+  CHECK( StepVirtualTime( 2 * CYCLE_PERIOD ), "transfer thread not idle" );
+  CHECK( WaitCaptureDone(), "full capture not done" );
+  events.clear();
+  threadNames.clear();
+  CHECK( ReadCaptureFile( FULL_CAPTURE_FILE_PATH, events, threadNames ), "full capture file not parsed" );
+  CHECK( events.size() == FULL_SPANS_NUMBER, "%zu events in full capture", events.size() );
+  
+  EndDevice( deviceID );
+  
+  remove( CAPTURE_FILE_PATH );
+  remove( FULL_CAPTURE_FILE_PATH );
+  
+  return failedChecksCount;
+}
@@ -0,0 +1,113 @@
+////////////////////////////////////////////////////////////////////////////////
+//                                                                            //
+//  Copyright (c) 2019 Leonardo Consoni <leonardjc@protonmail.com>            //
+//                                                                            //
+//  This file is part of Signal-IO-EposCmd.                                   //
+//                                                                            //
+//  Signal-IO-EposCmd is free software: you can redistribute it and/or modify //
+//  it under the terms of the GNU Lesser General Public License as published  //
+//  by the Free Software Foundation, either version 3 of the License, or      //
+//  (at your option) any later version.                                       //
+//                                                                            //
+//  Signal-IO-EposCmd is distributed in the hope that it will be useful,      //
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of            //
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the              //
+//  GNU Lesser General Public License for more details.                       //
+//                                                                            //
+//  You should have received a copy of the GNU Lesser General Public License  //
+//  along with Signal-IO-EposCmd. If not, see <http://www.gnu.org/licenses/>. //
+//                                                                            //
+////////////////////////////////////////////////////////////////////////////////
+
+// Devices are added and removed while the transfer thread serves another one: its fetched reads must keep
+// succeeding, ended device IDs must be rejected, and the transfer thread must stop with the last device
+// and restart with the next one. Runs in lock-step virtual time, so that cycle counts are exact
+
+#include "simulated_bus_test.h"
+
+#include <atomic>
+#include <thread>
+
+#define CYCLE_PERIOD 0.005
+#define LIFECYCLES_NUMBER 20
+#define FETCH_TIMEOUT 0.5
+
+static std::atomic<bool> isReading( true );
+static std::atomic<unsigned long> readsCount( 0 ), failedReadsCount( 0 );
+
+static void ReadFetched( long int deviceID )
+{
+  double value;
+  while( isReading.load() )
+  {
+    if( Read( deviceID, 0, &value ) == 0 ) failedReadsCount++;
+    readsCount++;
+  }
+}
+
+static unsigned long GetCyclesCount( void )
+{
+  EposTransferStats stats;
+  GetTransferStats( &stats, false );
+  return stats.cyclesCount;
+}
+
+int main( int argc, char* argv[] )
+{
+  if( !UseVirtualTime() ) return 1;
+  
+  long int servedDevice = InitSimulatedDevice( 0, 1 );
+  if( servedDevice == SIGNAL_IO_DEVICE_INVALID_ID ) return 1;
+  SetInputChannelMaxAge( servedDevice, 0, CYCLE_PERIOD / 2, FETCH_TIMEOUT );
+  SetTransferCycle( CYCLE_PERIOD, false, 0.0 );
+  
+  std::thread readThread( ReadFetched, servedDevice );
+  
+  // Devices come and go on the served bus and on another one
+  double value;
+  for( int lifecycleIndex = 0; lifecycleIndex < LIFECYCLES_NUMBER; lifecycleIndex++ )
+  {
+    long int addedDevices[ 2 ] = { InitSimulatedDevice( 0, 2 ), InitSimulatedDevice( 1, 1 ) };
+    for( int deviceIndex = 0; deviceIndex < 2; deviceIndex++ )
+    {
+      long int deviceID = addedDevices[ deviceIndex ];
+      CHECK( deviceID != SIGNAL_IO_DEVICE_INVALID_ID, "lifecycle %d, device %d", lifecycleIndex, deviceIndex );
+      CHECK( AcquireOutputChannel( deviceID, 0 ), "lifecycle %d, device %d", lifecycleIndex, deviceIndex );
+      CHECK( Write( deviceID, 0, lifecycleIndex ), "lifecycle %d, device %d", lifecycleIndex, deviceIndex );
+      CHECK( Read( deviceID, 0, &value ) > 0, "lifecycle %d, device %d", lifecycleIndex, deviceIndex );
+    }
+    unsigned long lifecycleCyclesCount = GetCyclesCount();
+    CHECK( StepVirtualTime( 4 * CYCLE_PERIOD ), "lifecycle %d, transfer thread not idle", lifecycleIndex );
+    CHECK( GetCyclesCount() - lifecycleCyclesCount >= 4, "lifecycle %d, %lu cycles", lifecycleIndex, GetCyclesCount() - lifecycleCyclesCount );
+    for( int deviceIndex = 0; deviceIndex < 2; deviceIndex++ )
+    {
+      long int deviceID = addedDevices[ deviceIndex ];
+      EndDevice( deviceID );
+      // Device IDs may be reused by later InitDevice() calls, so they are only checked right after EndDevice()
+      CHECK( Read( deviceID, 0, &value ) == 0, "lifecycle %d, device %d", lifecycleIndex, deviceIndex );
+      CHECK( !Write( deviceID, 0, 0.0 ), "lifecycle %d, device %d", lifecycleIndex, deviceIndex );
+      CHECK( !AcquireOutputChannel( deviceID, 0 ), "lifecycle %d, device %d", lifecycleIndex, deviceIndex );
+    }
+  }
+  
+  isReading = false;
+  readThread.join();
+  printf( "%lu fetched reads, %lu failed\n", readsCount.load(), failedReadsCount.load() );
+  CHECK( readsCount > 0, "no read completed" );
+  CHECK( failedReadsCount == 0, "%lu of %lu fetched reads failed", failedReadsCount.load(), readsCount.load() );
+  
+  // No cycles run without devices, and a new device starts them again
+  EndDevice( servedDevice );
+  CHECK( Read( servedDevice, 0, &value ) == 0, "served device read after EndDevice()" );
+  unsigned long stoppedCyclesCount = GetCyclesCount();
+  CHECK( StepVirtualTime( 10 * CYCLE_PERIOD ), "stopped transfer thread not idle" );
+  CHECK( GetCyclesCount() == stoppedCyclesCount, "%lu cycles without devices", GetCyclesCount() - stoppedCyclesCount );
+  
+  long int restartedDevice = InitSimulatedDevice( 1, 2 );
+  CHECK( restartedDevice != SIGNAL_IO_DEVICE_INVALID_ID, "restarted device" );
+  CHECK( StepVirtualTime( 10 * CYCLE_PERIOD ), "restarted transfer thread not idle" );
+  CHECK( GetCyclesCount() - stoppedCyclesCount >= 10, "%lu cycles after restart", GetCyclesCount() - stoppedCyclesCount );
+  EndDevice( restartedDevice );
+  
+  return failedChecksCount;
+}
@@ -0,0 +1,180 @@
+////////////////////////////////////////////////////////////////////////////////
+//                                                                            //
+//  Copyright (c) 2019 Leonardo Consoni <leonardjc@protonmail.com>            //
+//                                                                            //
+//  This file is part of Signal-IO-EposCmd.                                   //
+//                                                                            //
+//  Signal-IO-EposCmd is free software: you can redistribute it and/or modify //
+//  it under the terms of the GNU Lesser General Public License as published  //
+//  by the Free Software Foundation, either version 3 of the License, or      //
+//  (at your option) any later version.                                       //
+//                                                                            //
+//  Signal-IO-EposCmd is distributed in the hope that it will be useful,      //
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of            //
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the              //
+//  GNU Lesser General Public License for more details.                       //
+//                                                                            //
+//  You should have received a copy of the GNU Lesser General Public License  //
+//  along with Signal-IO-EposCmd. If not, see <http://www.gnu.org/licenses/>. //
+//                                                                            //
+////////////////////////////////////////////////////////////////////////////////
+
+// Every entry point is called at random from concurrent threads, while devices are initialized and ended under
+// them, so that instrumented builds (EPOSCMD_SANITIZER) report races and invalid accesses. All calls must be
+// accounted for by GetCallCounts(), and every accepted command completed
+
+#include "simulated_bus_test.h"
+
+#include <atomic>
+#include <random>
+#include <thread>
+
+#define THREADS_NUMBER 4
+#define SLOTS_NUMBER 4
+#define RUN_TIME 2.0
+#define COMPLETION_TIMEOUT 5.0
+
+// Device IDs by slot, SLOT_CLAIMED while a thread initializes it
+#define SLOT_CLAIMED 0
+static std::atomic<long int> deviceSlots[ SLOTS_NUMBER ];
+
+static std::atomic<unsigned long> callsCounts[ SIGNAL_IO_EPOS_CALLS_NUMBER ];
+static std::atomic<unsigned long> initsCount( 0 ), successfulReadsCount( 0 );
+static std::atomic<unsigned long> submittedCommandsCount( 0 ), completedCommandsCount( 0 );
+
+static void CompleteCommand( bool result, void* data )
+{
+  completedCommandsCount++;
+}
+
+static void InitSlot( int slotIndex )
+{
+  long int emptySlot = SIGNAL_IO_DEVICE_INVALID_ID;
+  if( !deviceSlots[ slotIndex ].compare_exchange_strong( emptySlot, SLOT_CLAIMED ) ) return;
+  long int deviceID = InitSimulatedDevice( slotIndex / 2, slotIndex % 2 + 1 );
+  callsCounts[ SIGNAL_IO_EPOS_CALL_INIT_DEVICE ]++;
+  if( deviceID != SIGNAL_IO_DEVICE_INVALID_ID ) initsCount++;
+  deviceSlots[ slotIndex ] = deviceID;
+}
+
+static void EndSlot( int slotIndex )
+{
+  long int deviceID = deviceSlots[ slotIndex ].load();
+  if( deviceID == SIGNAL_IO_DEVICE_INVALID_ID || deviceID == SLOT_CLAIMED ) return;
+  if( !deviceSlots[ slotIndex ].compare_exchange_strong( deviceID, SIGNAL_IO_DEVICE_INVALID_ID ) ) return;
+  EndDevice( deviceID );
+  callsCounts[ SIGNAL_IO_EPOS_CALL_END_DEVICE ]++;
+}
+
+// The device ID used may be ended, or even reused, by another thread meanwhile
+static void CallEntryPoint( std::mt19937& generator )
+{
+  int slotIndex = generator() % SLOTS_NUMBER;
+  long int deviceID = deviceSlots[ slotIndex ].load();
+  unsigned int channel = generator() % 3;
+  double value = 0.0;
+  
+  switch( generator() % 16 )
+  {
+    case 0:
+      InitSlot( slotIndex );
+      break;
+    case 1:
+      EndSlot( slotIndex );
+      break;
+    case 2:
+      HasError( deviceID );
+      callsCounts[ SIGNAL_IO_EPOS_CALL_HAS_ERROR ]++;
+      break;
+    case 3:
+      Reset( deviceID );
+      callsCounts[ SIGNAL_IO_EPOS_CALL_RESET ]++;
+      break;
+    case 4:
+      AcquireOutputChannel( deviceID, channel );
+      callsCounts[ SIGNAL_IO_EPOS_CALL_ACQUIRE_OUTPUT_CHANNEL ]++;
+      break;
+    case 5:
+      ReleaseOutputChannel( deviceID, channel );
+      callsCounts[ SIGNAL_IO_EPOS_CALL_RELEASE_OUTPUT_CHANNEL ]++;
+      break;
+    case 6:
+      GetMaxInputSamplesNumber( deviceID );
+      callsCounts[ SIGNAL_IO_EPOS_CALL_GET_MAX_INPUT_SAMPLES_NUMBER ]++;
+      break;
+    case 7:
+      CheckInputChannel( deviceID, channel );
+      callsCounts[ SIGNAL_IO_EPOS_CALL_CHECK_INPUT_CHANNEL ]++;
+      break;
+    case 8:
+    {
+      EposCommand command = {};
+      command.type = generator() % SIGNAL_IO_EPOS_COMMAND_WRITE_OBJECT;
+      command.channel = channel;
+      if( SubmitCommand( deviceID, &command, CompleteCommand, NULL ) ) submittedCommandsCount++;
+      break;
+    }
+    case 9:
+      SetInputChannelMaxAge( deviceID, channel, ( generator() % 2 ) * 0.001, 0.01 );
+      break;
+    case 10:
+    case 11:
+      Write( deviceID, channel, (double) ( generator() % 1000 ) );
+      callsCounts[ SIGNAL_IO_EPOS_CALL_WRITE ]++;
+      break;
+    default:
+      if( Read( deviceID, generator() % SIGNAL_IO_EPOS_INPUT_CHANNELS_NUMBER, &value ) > 0 ) successfulReadsCount++;
+      callsCounts[ SIGNAL_IO_EPOS_CALL_READ ]++;
+      break;
+  }
+}
+
+static void RunCalls( unsigned int seed )
+{
+  std::mt19937 generator( seed );
+  double startTime = GetTestTime();
+  while( GetTestTime() - startTime < RUN_TIME )
+    CallEntryPoint( generator );
+}
+
+int main( int argc, char* argv[] )
+{
+  for( int slotIndex = 0; slotIndex < SLOTS_NUMBER; slotIndex++ )
+    deviceSlots[ slotIndex ] = SIGNAL_IO_DEVICE_INVALID_ID;
+  
+  unsigned long initialCallsCounts[ SIGNAL_IO_EPOS_CALLS_NUMBER ];
+  GetCallCounts( initialCallsCounts );
+  
+  std::random_device seedSource;
+  unsigned int seed = ( argc > 1 ) ? (unsigned int) strtoul( argv[ 1 ], NULL, 0 ) : seedSource();
+  printf( "seed %u\n", seed );
+  std::thread callThreads[ THREADS_NUMBER ];
+  for( int threadIndex = 0; threadIndex < THREADS_NUMBER; threadIndex++ )
+    callThreads[ threadIndex ] = std::thread( RunCalls, seed + threadIndex );
+  for( int threadIndex = 0; threadIndex < THREADS_NUMBER; threadIndex++ )
+    callThreads[ threadIndex ].join();
+  
+  double completionStartTime = GetTestTime();
+  while( completedCommandsCount < submittedCommandsCount && GetTestTime() - completionStartTime < COMPLETION_TIMEOUT )
+    std::this_thread::sleep_for( std::chrono::milliseconds( 1 ) );
+  
+  for( int slotIndex = 0; slotIndex < SLOTS_NUMBER; slotIndex++ )
+    EndSlot( slotIndex );
+  
+  unsigned long finalCallsCounts[ SIGNAL_IO_EPOS_CALLS_NUMBER ];
+  GetCallCounts( finalCallsCounts );
+  
+  printf( "%lu inits, %lu successful reads, %lu of %lu commands completed\n", initsCount.load(), successfulReadsCount.load(), 
+          completedCommandsCount.load(), submittedCommandsCount.load() );
+  CHECK( initsCount > 0, "no device initialized" );
+  CHECK( successfulReadsCount > 0, "no successful read" );
+  CHECK( completedCommandsCount == submittedCommandsCount, "%lu commands not completed", submittedCommandsCount - completedCommandsCount );
+  for( int call = 0; call < SIGNAL_IO_EPOS_CALLS_NUMBER; call++ )
+  {
+    unsigned long countedCallsNumber = finalCallsCounts[ call ] - initialCallsCounts[ call ];
+    printf( "entry point %d: %lu calls\n", call, countedCallsNumber );
+    CHECK( countedCallsNumber == callsCounts[ call ], "entry point %d counted %lu calls, %lu made", call, countedCallsNumber, callsCounts[ call ].load() );
+  }
+  
+  return failedChecksCount;
+}
@@ -0,0 +1,89 @@
+////////////////////////////////////////////////////////////////////////////////
+//                                                                            //
+//  Copyright (c) 2019 Leonardo Consoni <leonardjc@protonmail.com>            //
+//                                                                            //
+//  This file is part of Signal-IO-EposCmd.                                   //
+//                                                                            //
+//  Signal-IO-EposCmd is free software: you can redistribute it and/or modify //
+//  it under the terms of the GNU Lesser General Public License as published  //
+//  by the Free Software Foundation, either version 3 of the License, or      //
+//  (at your option) any later version.                                       //
+//                                                                            //
+//  Signal-IO-EposCmd is distributed in the hope that it will be useful,      //
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of            //
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the              //
+//  GNU Lesser General Public License for more details.                       //
+//                                                                            //
+//  You should have received a copy of the GNU Lesser General Public License  //
+//  along with Signal-IO-EposCmd. If not, see <http://www.gnu.org/licenses/>. //
+//                                                                            //
+////////////////////////////////////////////////////////////////////////////////
+
+
+// A known position trajectory, set one point per cycle, is read back from the input history: the samples kept
+// in native types must convert back to the exact setpoints, oldest first, one cycle apart, and only the last
+// HISTORY_LENGTH of them must be kept. Runs in lock-step virtual time, so that sample times are exact. Setpoints are
+// buffered, as an immediate write could take the clock past a cycle start, and delay that cycle's reads
+
+#include "simulated_bus_test.h"
+
+#include <string.h>
+
+#define CYCLE_PERIOD 0.005
+#define HISTORY_LENGTH 16
+#define TRAJECTORY_LENGTH 40
+#define TIME_TOLERANCE 1e-9
+
+// Alternating signs and magnitudes well past the short and float exact ranges
+static double GetTrajectoryPoint( int pointIndex )
+{
+  return ( ( pointIndex % 2 == 0 ) ? 1.0 : -1.0 ) * ( 100000000.0 + pointIndex * 12345.0 );
+}
+
+int main( int argc, char* argv[] )
+{
+  if( !UseVirtualTime() ) return 1;
+  
+  long int deviceID = InitSimulatedDevice( 0, 1 );
+  if( deviceID == SIGNAL_IO_DEVICE_INVALID_ID ) return 1;
+  SetTransferCycle( CYCLE_PERIOD, false, 0.0 );
+  CHECK( SetTransferCycleLayout( SIGNAL_IO_EPOS_CYCLE_WRITES_READS, false, NULL, NULL ), "layout not set" );
+  CHECK( SetInputHistoryLength( deviceID, HISTORY_LENGTH ), "history not enabled" );
+  CHECK( AcquireOutputChannel( deviceID, 0 ), "position setpoint not acquired" );
+  for( int pointIndex = 0; pointIndex < TRAJECTORY_LENGTH; pointIndex++ )
+  {
+    CHECK( Write( deviceID, 0, GetTrajectoryPoint( pointIndex ) ), "point %d not written", pointIndex );
+    CHECK( StepVirtualTime( CYCLE_PERIOD ), "transfer thread not idle at point %d", pointIndex );
+  }
+  
+  double times[ HISTORY_LENGTH + 1 ], values[ HISTORY_LENGTH + 1 ];
+  size_t samplesNumber = ReadInputHistory( deviceID, 0, 0.0, times, values, HISTORY_LENGTH + 1 );
+  CHECK( samplesNumber == HISTORY_LENGTH, "%zu samples kept", samplesNumber );
+  if( samplesNumber != HISTORY_LENGTH ) return failedChecksCount;
+  
+  // Feedback follows the setpoints with a fixed lag, found from the last sample
+  int lastPointIndex = TRAJECTORY_LENGTH - 1;
+  while( lastPointIndex > 0 && GetTrajectoryPoint( lastPointIndex ) != values[ HISTORY_LENGTH - 1 ] ) lastPointIndex--;
+  CHECK( lastPointIndex >= TRAJECTORY_LENGTH - 3, "last sample %g from point %d", values[ HISTORY_LENGTH - 1 ], lastPointIndex );
+  for( size_t sampleIndex = 0; sampleIndex < HISTORY_LENGTH; sampleIndex++ )
+  {
+    double point = GetTrajectoryPoint( lastPointIndex - (int) ( HISTORY_LENGTH - 1 - sampleIndex ) );
+    CHECK( values[ sampleIndex ] == point, "sample %zu: %.1f instead of %.1f", sampleIndex, values[ sampleIndex ], point );
+    if( sampleIndex > 0 )
+      CHECK( fabs( times[ sampleIndex ] - times[ sampleIndex - 1 ] - CYCLE_PERIOD ) < TIME_TOLERANCE, "sample %zu interval", sampleIndex );
+  }
+  
+  // Reads after a start time, without times, and of another channel
+  double lastValues[ HISTORY_LENGTH ];
+  CHECK( ReadInputHistory( deviceID, 0, times[ HISTORY_LENGTH - 5 ], NULL, lastValues, HISTORY_LENGTH ) == 4, "samples after start time" );
+  CHECK( memcmp( lastValues, values + HISTORY_LENGTH - 4, 4 * sizeof(double) ) == 0, "values after start time" );
+  CHECK( ReadInputHistory( deviceID, 1, 0.0, NULL, lastValues, HISTORY_LENGTH ) == HISTORY_LENGTH && lastValues[ 0 ] == 0.0, "velocity samples" );
+  
+  // Live values stay doubles, matching the last sample
+  double position = 0.0;
+  CHECK( Read( deviceID, 0, &position ) > 0 && position == values[ HISTORY_LENGTH - 1 ], "position %.1f", position );
+  
+  EndDevice( deviceID );
+  
+  return failedChecksCount;
+}
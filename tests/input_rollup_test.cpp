@@ -0,0 +1,152 @@
+////////////////////////////////////////////////////////////////////////////////
+//                                                                            //
+//  Copyright (c) 2019 Leonardo Consoni <leonardjc@protonmail.com>            //
+//                                                                            //
+//  This file is part of Signal-IO-EposCmd.                                   //
+//                                                                            //
+//  Signal-IO-EposCmd is free software: you can redistribute it and/or modify //
+//  it under the terms of the GNU Lesser General Public License as published  //
+//  by the Free Software Foundation, either version 3 of the License, or      //
+//  (at your option) any later version.                                       //
+//                                                                            //
+//  Signal-IO-EposCmd is distributed in the hope that it will be useful,      //
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of            //
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the              //
+//  GNU Lesser General Public License for more details.                       //
+//                                                                            //
+//  You should have received a copy of the GNU Lesser General Public License  //
+//  along with Signal-IO-EposCmd. If not, see <http://www.gnu.org/licenses/>. //
+//                                                                            //
+////////////////////////////////////////////////////////////////////////////////
+
+// Rollup tiers must aggregate exactly the reads kept in the full rate history: regrouped by period, the history gives
+// the expected bucket start times, sample counts, minimums, maximums and means, whatever the cycle phase. Only the
+// last buckets of each tier are kept, and resizing or disabling a tier clears it. Runs in lock-step virtual time
+
+#include "simulated_bus_test.h"
+
+#include <vector>
+
+#define CYCLE_PERIOD 0.005
+#define HISTORY_LENGTH 64
+#define TRAJECTORY_LENGTH 40
+#define FINE_PERIOD ( 4 * CYCLE_PERIOD )
+#define FINE_BUCKETS_NUMBER 4
+#define COARSE_PERIOD ( 20 * CYCLE_PERIOD )
+#define COARSE_BUCKETS_NUMBER 8
+
+// Steps of varying sign and size, so that every period has distinct extremes
+static double GetTrajectoryPoint( int pointIndex )
+{
+  return ( pointIndex % 7 ) * 1000.0 - ( pointIndex % 3 ) * 2500.0;
+}
+
+// Groups the history samples by period, as rollups of unlimited length would
+static std::vector<EposInputRollup> GroupSamples( const double* times, const double* values, size_t samplesNumber, double period )
+{
+  std::vector<EposInputRollup> rollups;
+  std::vector<double> sums;
+  for( size_t sampleIndex = 0; sampleIndex < samplesNumber; sampleIndex++ )
+  {
+    double startTime = floor( times[ sampleIndex ] / period ) * period;
+    if( rollups.empty() || startTime > rollups.back().startTime )
+    {
+      rollups.push_back( { startTime, 0, values[ sampleIndex ], values[ sampleIndex ], 0.0 } );
+      sums.push_back( 0.0 );
+    }
+    EposInputRollup* rollup = &(rollups.back());
+    rollup->samplesCount++;
+    rollup->minimum = std::min( rollup->minimum, values[ sampleIndex ] );
+    rollup->maximum = std::max( rollup->maximum, values[ sampleIndex ] );
+    sums.back() += values[ sampleIndex ];
+    rollup->mean = sums.back() / rollup->samplesCount;
+  }
+  return rollups;
+}
+
+// Compares the kept rollups with the last expected ones
+static void CheckRollups( const char* tierName, const EposInputRollup* rollups, size_t rollupsNumber, const std::vector<EposInputRollup>& expectedRollups, size_t bucketsNumber )
+{
+  size_t expectedNumber = std::min( expectedRollups.size(), bucketsNumber );
+  CHECK( rollupsNumber == expectedNumber, "%s tier: %zu rollups instead of %zu", tierName, rollupsNumber, expectedNumber );
+  if( rollupsNumber != expectedNumber ) return;
+  
+  for( size_t rollupIndex = 0; rollupIndex < rollupsNumber; rollupIndex++ )
+  {
+    const EposInputRollup* rollup = &(rollups[ rollupIndex ]);
+    const EposInputRollup* expectedRollup = &(expectedRollups[ expectedRollups.size() - rollupsNumber + rollupIndex ]);
+    CHECK( rollup->startTime == expectedRollup->startTime && rollup->samplesCount == expectedRollup->samplesCount,
+           "%s tier rollup %zu: %lu samples from %.6f s instead of %lu from %.6f s", tierName, rollupIndex, 
+           rollup->samplesCount, rollup->startTime, expectedRollup->samplesCount, expectedRollup->startTime );
+    CHECK( rollup->minimum == expectedRollup->minimum && rollup->maximum == expectedRollup->maximum && rollup->mean == expectedRollup->mean,
+           "%s tier rollup %zu: %g/%g/%g instead of %g/%g/%g", tierName, rollupIndex, rollup->minimum, rollup->maximum, rollup->mean, 
+           expectedRollup->minimum, expectedRollup->maximum, expectedRollup->mean );
+  }
+}
+
+int main( int argc, char* argv[] )
+{
+  if( !UseVirtualTime() ) return 1;
+  
+  long int deviceID = InitSimulatedDevice( 0, 1 );
+  if( deviceID == SIGNAL_IO_DEVICE_INVALID_ID ) return 1;
+  SetTransferCycle( CYCLE_PERIOD, false, 0.0 );
+  CHECK( SetTransferCycleLayout( SIGNAL_IO_EPOS_CYCLE_WRITES_READS, false, NULL, NULL ), "layout not set" );
+  
+  CHECK( !SetInputRollup( deviceID, SIGNAL_IO_EPOS_ROLLUP_TIERS_NUMBER, FINE_PERIOD, FINE_BUCKETS_NUMBER ), "invalid tier enabled" );
+  CHECK( !SetInputRollup( deviceID, SIGNAL_IO_EPOS_ROLLUP_FINE, 0.0, FINE_BUCKETS_NUMBER ), "tier without period enabled" );
+  CHECK( !SetInputRollup( SIGNAL_IO_DEVICE_INVALID_ID, SIGNAL_IO_EPOS_ROLLUP_FINE, FINE_PERIOD, FINE_BUCKETS_NUMBER ), "tier of invalid device enabled" );
+  
+  CHECK( SetInputHistoryLength( deviceID, HISTORY_LENGTH ), "history not enabled" );
+  CHECK( SetInputRollup( deviceID, SIGNAL_IO_EPOS_ROLLUP_FINE, FINE_PERIOD, FINE_BUCKETS_NUMBER ), "fine tier not enabled" );
+  CHECK( SetInputRollup( deviceID, SIGNAL_IO_EPOS_ROLLUP_COARSE, COARSE_PERIOD, COARSE_BUCKETS_NUMBER ), "coarse tier not enabled" );
+  CHECK( AcquireOutputChannel( deviceID, 0 ), "position setpoint not acquired" );
+  for( int pointIndex = 0; pointIndex < TRAJECTORY_LENGTH; pointIndex++ )
+  {
+    CHECK( Write( deviceID, 0, GetTrajectoryPoint( pointIndex ) ), "point %d not written", pointIndex );
+    CHECK( StepVirtualTime( CYCLE_PERIOD ), "transfer thread not idle at point %d", pointIndex );
+  }
+  
+  double times[ HISTORY_LENGTH ], values[ HISTORY_LENGTH ];
+  size_t samplesNumber = ReadInputHistory( deviceID, 0, 0.0, times, values, HISTORY_LENGTH );
+  CHECK( samplesNumber >= TRAJECTORY_LENGTH && samplesNumber < HISTORY_LENGTH, "%zu samples kept", samplesNumber );
+  
+  // The fine tier wraps, keeping its last buckets only, while the coarse one still holds every period
+  EposInputRollup rollups[ COARSE_BUCKETS_NUMBER + 1 ];
+  std::vector<EposInputRollup> expectedRollups = GroupSamples( times, values, samplesNumber, FINE_PERIOD );
+  CHECK( expectedRollups.size() > FINE_BUCKETS_NUMBER, "%zu fine periods", expectedRollups.size() );
+  size_t rollupsNumber = ReadInputRollup( deviceID, SIGNAL_IO_EPOS_ROLLUP_FINE, 0, 0.0, rollups, COARSE_BUCKETS_NUMBER + 1 );
+  CheckRollups( "fine", rollups, rollupsNumber, expectedRollups, FINE_BUCKETS_NUMBER );
+  bool isVarying = false;
+  for( size_t rollupIndex = 0; rollupIndex < rollupsNumber; rollupIndex++ )
+    isVarying = isVarying || ( rollups[ rollupIndex ].minimum < rollups[ rollupIndex ].maximum );
+  CHECK( isVarying, "constant feedback" );
+  
+  // Rollups ending after a start time
+  double startTime = rollups[ 1 ].startTime + FINE_PERIOD / 2;
+  CHECK( ReadInputRollup( deviceID, SIGNAL_IO_EPOS_ROLLUP_FINE, 0, startTime, rollups, COARSE_BUCKETS_NUMBER + 1 ) == FINE_BUCKETS_NUMBER - 1, "rollups after start time" );
+  
+  expectedRollups = GroupSamples( times, values, samplesNumber, COARSE_PERIOD );
+  CHECK( expectedRollups.size() > 1 && expectedRollups.size() <= COARSE_BUCKETS_NUMBER, "%zu coarse periods", expectedRollups.size() );
+  rollupsNumber = ReadInputRollup( deviceID, SIGNAL_IO_EPOS_ROLLUP_COARSE, 0, 0.0, rollups, COARSE_BUCKETS_NUMBER + 1 );
+  CheckRollups( "coarse", rollups, rollupsNumber, expectedRollups, COARSE_BUCKETS_NUMBER );
+  
+  // Other channels get their own aggregates, and invalid ones none
+  samplesNumber = ReadInputHistory( deviceID, 1, 0.0, times, values, HISTORY_LENGTH );
+  expectedRollups = GroupSamples( times, values, samplesNumber, COARSE_PERIOD );
+  rollupsNumber = ReadInputRollup( deviceID, SIGNAL_IO_EPOS_ROLLUP_COARSE, 1, 0.0, rollups, COARSE_BUCKETS_NUMBER + 1 );
+  CheckRollups( "velocity coarse", rollups, rollupsNumber, expectedRollups, COARSE_BUCKETS_NUMBER );
+  CHECK( ReadInputRollup( deviceID, SIGNAL_IO_EPOS_ROLLUP_COARSE, SIGNAL_IO_EPOS_INPUT_CHANNELS_NUMBER, 0.0, rollups, COARSE_BUCKETS_NUMBER + 1 ) == 0, "rollups of invalid channel" );
+  
+  // Reconfigured tiers start over, and disabled ones stay empty
+  CHECK( SetInputRollup( deviceID, SIGNAL_IO_EPOS_ROLLUP_FINE, FINE_PERIOD, FINE_BUCKETS_NUMBER + 1 ), "fine tier not resized" );
+  CHECK( ReadInputRollup( deviceID, SIGNAL_IO_EPOS_ROLLUP_FINE, 0, 0.0, rollups, COARSE_BUCKETS_NUMBER + 1 ) == 0, "resized tier not cleared" );
+  CHECK( SetInputRollup( deviceID, SIGNAL_IO_EPOS_ROLLUP_COARSE, 0.0, 0 ), "coarse tier not disabled" );
+  CHECK( StepVirtualTime( CYCLE_PERIOD ), "transfer thread not idle" );
+  CHECK( ReadInputRollup( deviceID, SIGNAL_IO_EPOS_ROLLUP_FINE, 0, 0.0, rollups, COARSE_BUCKETS_NUMBER + 1 ) == 1, "resized tier not filled" );
+  CHECK( ReadInputRollup( deviceID, SIGNAL_IO_EPOS_ROLLUP_COARSE, 0, 0.0, rollups, COARSE_BUCKETS_NUMBER + 1 ) == 0, "disabled tier filled" );
+  
+  EndDevice( deviceID );
+  
+  return failedChecksCount;
+}
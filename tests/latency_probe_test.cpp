@@ -0,0 +1,90 @@
+////////////////////////////////////////////////////////////////////////////////
+//                                                                            //
+//  Copyright (c) 2019 Leonardo Consoni <leonardjc@protonmail.com>            //
+//                                                                            //
+//  This file is part of Signal-IO-EposCmd.                                   //
+//                                                                            //
+//  Signal-IO-EposCmd is free software: you can redistribute it and/or modify //
+//  it under the terms of the GNU Lesser General Public License as published  //
+//  by the Free Software Foundation, either version 3 of the License, or      //
+//  (at your option) any later version.                                       //
+//                                                                            //
+//  Signal-IO-EposCmd is distributed in the hope that it will be useful,      //
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of            //
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the              //
+//  GNU Lesser General Public License for more details.                       //
+//                                                                            //
+//  You should have received a copy of the GNU Lesser General Public License  //
+//  along with Signal-IO-EposCmd. If not, see <http://www.gnu.org/licenses/>. //
+//                                                                            //
+////////////////////////////////////////////////////////////////////////////////
+
+
+// The latency probe must measure the response delay of the simulated drive: each step shows up in the position
+// feedback at the first read past its transmission plus the response delay, so no earlier than that, and at most
+// a cycle later. Runs in lock-step virtual time, so that no step is lost to host scheduling
+
+#include "simulated_bus_test.h"
+
+#include <stdlib.h>
+
+#define CYCLE_PERIOD 0.001
+#define PROBE_AMPLITUDE 100.0
+#define PROBE_STEPS_NUMBER 20
+#define PROBE_TIMEOUT 1.0
+#define TIME_TOLERANCE 1e-9
+
+static double GetEnvironmentTime( const char* variableName )
+{
+  const char* value = getenv( variableName );
+  return ( value != NULL ) ? strtod( value, NULL ) : 0.0;
+}
+
+int main( int argc, char* argv[] )
+{
+  double responseDelay = GetEnvironmentTime( "EPOSCMD_SIMULATION_RESPONSE_DELAY" );
+  double transactionTime = GetEnvironmentTime( "EPOSCMD_SIMULATION_TRANSACTION_TIME" );
+  if( responseDelay <= 0.0 || transactionTime <= 0.0 ) 
+  {
+    fprintf( stderr, "simulation response delay and transaction time must be set\n" );
+    return 1;
+  }
+  
+  if( !UseVirtualTime() ) return 1;
+  
+  long int deviceID = InitSimulatedDevice( 0, 1 );
+  if( deviceID == SIGNAL_IO_DEVICE_INVALID_ID ) return 1;
+  SetTransferCycle( CYCLE_PERIOD, false, 0.0 );
+  CHECK( AcquireOutputChannel( deviceID, 0 ), "position setpoint not acquired" );
+  CHECK( Write( deviceID, 0, 1000.0 ), "position setpoint not written" );
+  CHECK( StepVirtualTime( 10 * CYCLE_PERIOD ), "transfer thread not idle" );
+  
+  EposLatencyStats latencies;
+  unsigned long lostSteps = 0;
+  CHECK( !GetLatencyProbeResults( deviceID, &latencies, &lostSteps ) || latencies.count == 0, "results before the probe" );
+  CHECK( StartLatencyProbe( deviceID, 0, PROBE_AMPLITUDE, PROBE_STEPS_NUMBER ), "probe not started" );
+  CHECK( !StartLatencyProbe( deviceID, 0, PROBE_AMPLITUDE, PROBE_STEPS_NUMBER ), "second probe started" );
+  double timeoutTime = GetVirtualTime( NULL ) + PROBE_TIMEOUT;
+  while( !GetLatencyProbeResults( deviceID, &latencies, &lostSteps ) && GetVirtualTime( NULL ) < timeoutTime )
+  {
+    if( !StepVirtualTime( CYCLE_PERIOD ) ) break;
+  }
+  CHECK( GetLatencyProbeResults( deviceID, &latencies, &lostSteps ), "probe not finished" );
+  
+  // The simulated drive applies a setpoint once the response delay elapsed from the end of its transaction
+  double minLatency = responseDelay + transactionTime;
+  printf( "%lu steps: latency %g to %g s (mean %g), %lu lost\n", latencies.count, latencies.minimum, latencies.maximum, latencies.mean, lostSteps );
+  CHECK( latencies.count == PROBE_STEPS_NUMBER, "%lu steps measured", latencies.count );
+  CHECK( lostSteps == 0, "%lu steps lost", lostSteps );
+  CHECK( latencies.minimum >= minLatency - TIME_TOLERANCE, "minimum latency %g below %g", latencies.minimum, minLatency );
+  CHECK( latencies.maximum <= minLatency + CYCLE_PERIOD + TIME_TOLERANCE, "maximum latency %g above %g", latencies.maximum, minLatency + CYCLE_PERIOD );
+  
+  // The probe leaves the setpoint where it was
+  CHECK( StepVirtualTime( 10 * CYCLE_PERIOD ), "transfer thread not idle" );
+  double position = 0.0;
+  CHECK( Read( deviceID, 0, &position ) > 0 && position == 1000.0, "position %g after the probe", position );
+  
+  EndDevice( deviceID );
+  
+  return failedChecksCount;
+}
@@ -0,0 +1,125 @@
+////////////////////////////////////////////////////////////////////////////////
+//                                                                            //
+//  Copyright (c) 2019 Leonardo Consoni <leonardjc@protonmail.com>            //
+//                                                                            //
+//  This file is part of Signal-IO-EposCmd.                                   //
+//                                                                            //
+//  Signal-IO-EposCmd is free software: you can redistribute it and/or modify //
+//  it under the terms of the GNU Lesser General Public License as published  //
+//  by the Free Software Foundation, either version 3 of the License, or      //
+//  (at your option) any later version.                                       //
+//                                                                            //
+//  Signal-IO-EposCmd is distributed in the hope that it will be useful,      //
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of            //
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the              //
+//  GNU Lesser General Public License for more details.                       //
+//                                                                            //
+//  You should have received a copy of the GNU Lesser General Public License  //
+//  along with Signal-IO-EposCmd. If not, see <http://www.gnu.org/licenses/>. //
+//                                                                            //
+////////////////////////////////////////////////////////////////////////////////
+
+// Listen-only devices must decode the frames another bus master exchanges with their node, injected on the simulated
+// bus: mapped PDO fields (the last frame of a cycle winning), heartbeats and emergencies, while frames of other nodes
+// are ignored. Monitoring adds no bus transaction, so that cycles take no virtual time, and drive commands are refused
+
+#include "simulated_bus_test.h"
+
+#include <string.h>
+
+#define CYCLE_PERIOD 0.005
+#define NODE_ID 5
+#define OTHER_NODE_ID 6
+#define HISTORY_LENGTH 8
+
+// Little endian fields, as sent by the drive
+static void EncodeField( unsigned char* frame, unsigned int offset, unsigned int size, int value )
+{
+  for( unsigned int byteIndex = 0; byteIndex < size; byteIndex++ )
+    frame[ offset + byteIndex ] = (unsigned char) ( (unsigned int) value >> ( 8 * byteIndex ) );
+}
+
+static double ReadValue( long int deviceID, unsigned int channel )
+{
+  double value = 0.0;
+  CHECK( Read( deviceID, channel, &value ) > 0, "channel %u not read", channel );
+  return value;
+}
+
+int main( int argc, char* argv[] )
+{
+  if( !UseVirtualTime() ) return 1;
+  
+  long int deviceID = InitDevice( "EPOS4:CANopen:Kvaser:CAN0:5:1000000:listen" );
+  if( deviceID == SIGNAL_IO_DEVICE_INVALID_ID ) return 1;
+  CHECK( InitDevice( "EPOS4:CANopen:Kvaser:CAN0:5:1000000:talk" ) == SIGNAL_IO_DEVICE_INVALID_ID, "invalid option accepted" );
+  SetTransferCycle( CYCLE_PERIOD, false, 0.0 );
+  CHECK( SetInputHistoryLength( deviceID, HISTORY_LENGTH ), "history not enabled" );
+  CHECK( StepVirtualTime( CYCLE_PERIOD ), "transfer thread not idle" );
+  
+  CHECK( !AcquireOutputChannel( deviceID, 0 ), "output channel of listen-only device acquired" );
+  CHECK( !WriteDigitalOutputs( deviceID, 0x0001, 0x0001 ), "digital outputs of listen-only device written" );
+  unsigned short statusWord = 0;
+  CHECK( !ReadDriveObject( deviceID, 0x6041, 0x00, &statusWord, sizeof(statusWord), NULL, false ), "object of listen-only device read" );
+  EposMonitorStatus status;
+  CHECK( GetMonitorStatus( deviceID, &status ) && status.heartbeatTime == 0.0 && status.emergenciesCount == 0, "initial monitor status" );
+  
+  // Default mapping: position and velocity from TPDO1, current from TPDO2
+  EposTransferStats stats;
+  GetTransferStats( &stats, true );
+  unsigned char frame[ 8 ] = { 0 };
+  EncodeField( frame, 0, 4, -123456 );
+  EncodeField( frame, 4, 4, 789 );
+  InjectSimulatedCANFrame( 0x180 + NODE_ID, 8, frame );
+  EncodeField( frame, 0, 2, -50 );
+  InjectSimulatedCANFrame( 0x280 + NODE_ID, 2, frame );
+  EncodeField( frame, 0, 2, 75 );
+  InjectSimulatedCANFrame( 0x280 + NODE_ID, 2, frame );
+  EncodeField( frame, 0, 4, 999999 );
+  InjectSimulatedCANFrame( 0x180 + OTHER_NODE_ID, 8, frame );
+  CHECK( StepVirtualTime( CYCLE_PERIOD ), "transfer thread not idle" );
+  CHECK( ReadValue( deviceID, 0 ) == -123456.0, "position %g", ReadValue( deviceID, 0 ) );
+  CHECK( ReadValue( deviceID, 1 ) == 789.0, "velocity %g", ReadValue( deviceID, 1 ) );
+  CHECK( ReadValue( deviceID, 2 ) == 75.0, "current %g", ReadValue( deviceID, 2 ) );
+  double historyValues[ HISTORY_LENGTH ];
+  size_t samplesNumber = ReadInputHistory( deviceID, 0, 0.0, NULL, historyValues, HISTORY_LENGTH );
+  CHECK( samplesNumber == 1 && historyValues[ 0 ] == -123456.0, "%zu history samples", samplesNumber );
+  CHECK( GetTransferStats( &stats, true ) && stats.cyclesCount > 0 && stats.cycleDurations.maximum == 0.0, "monitoring cycles of %g s", stats.cycleDurations.maximum );
+  
+  // Heartbeat states and emergencies, faulting the device until an error reset emergency
+  frame[ 0 ] = 0x05;
+  InjectSimulatedCANFrame( 0x700 + NODE_ID, 1, frame );
+  unsigned char emergencyFrame[ 8 ] = { 0x10, 0x23, 0x04, 0, 0, 0, 0, 0 };
+  InjectSimulatedCANFrame( 0x80 + NODE_ID, 8, emergencyFrame );
+  CHECK( StepVirtualTime( CYCLE_PERIOD ), "transfer thread not idle" );
+  CHECK( GetMonitorStatus( deviceID, &status ), "monitor status not read" );
+  CHECK( status.nmtState == 0x05 && status.heartbeatTime > 0.0, "NMT state 0x%02x at %g s", status.nmtState, status.heartbeatTime );
+  CHECK( status.emergencyCode == 0x2310 && status.errorRegister == 0x04 && status.emergenciesCount == 1 && status.emergencyTime > 0.0,
+         "emergency 0x%04x, register 0x%02x, %lu received", status.emergencyCode, status.errorRegister, status.emergenciesCount );
+  CHECK( HasError( deviceID ), "emergency not reported" );
+  memset( emergencyFrame, 0, sizeof(emergencyFrame) );
+  InjectSimulatedCANFrame( 0x80 + NODE_ID, 8, emergencyFrame );
+  CHECK( StepVirtualTime( CYCLE_PERIOD ), "transfer thread not idle" );
+  CHECK( GetMonitorStatus( deviceID, &status ) && status.emergencyCode == 0 && status.emergenciesCount == 2, "error reset emergency" );
+  CHECK( !HasError( deviceID ), "error reset emergency not reported" );
+  
+  // Remapped channels decode signed fields at any offset, of any COB-ID
+  CHECK( !SetMonitorMapping( deviceID, 0, 0x380 + NODE_ID, 2, 3 ), "3 byte field mapped" );
+  CHECK( !SetMonitorMapping( deviceID, 0, 0x380 + NODE_ID, 6, 4 ), "field past frame end mapped" );
+  CHECK( !SetMonitorMapping( deviceID, SIGNAL_IO_EPOS_INPUT_CHANNELS_NUMBER, 0x380 + NODE_ID, 0, 2 ), "invalid channel mapped" );
+  CHECK( SetMonitorMapping( deviceID, 0, 0x380 + NODE_ID, 2, 2 ), "position not remapped" );
+  CHECK( SetMonitorMapping( deviceID, 2, 0x380 + NODE_ID, 5, 1 ), "current not remapped" );
+  memset( frame, 0, sizeof(frame) );
+  EncodeField( frame, 2, 2, -2 );
+  EncodeField( frame, 5, 1, -3 );
+  InjectSimulatedCANFrame( 0x380 + NODE_ID, 8, frame );
+  CHECK( StepVirtualTime( CYCLE_PERIOD ), "transfer thread not idle" );
+  CHECK( ReadValue( deviceID, 0 ) == -2.0 && ReadValue( deviceID, 2 ) == -3.0, "remapped values %g and %g", ReadValue( deviceID, 0 ), ReadValue( deviceID, 2 ) );
+  CHECK( ReadValue( deviceID, 1 ) == 789.0, "velocity %g after remapping", ReadValue( deviceID, 1 ) );
+  
+  EndDevice( deviceID );
+  
+  CHECK( !GetMonitorStatus( deviceID, &status ), "status of ended device" );
+  
+  return failedChecksCount;
+}
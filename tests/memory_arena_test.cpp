@@ -0,0 +1,137 @@
+////////////////////////////////////////////////////////////////////////////////
+//                                                                            //
+//  Copyright (c) 2019 Leonardo Consoni <leonardjc@protonmail.com>            //
+//                                                                            //
+//  This file is part of Signal-IO-EposCmd.                                   //
+//                                                                            //
+//  Signal-IO-EposCmd is free software: you can redistribute it and/or modify //
+//  it under the terms of the GNU Lesser General Public License as published  //
+//  by the Free Software Foundation, either version 3 of the License, or      //
+//  (at your option) any later version.                                       //
+//                                                                            //
+//  Signal-IO-EposCmd is distributed in the hope that it will be useful,      //
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of            //
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the              //
+//  GNU Lesser General Public License for more details.                       //
+//                                                                            //
+//  You should have received a copy of the GNU Lesser General Public License  //
+//  along with Signal-IO-EposCmd. If not, see <http://www.gnu.org/licenses/>. //
+//                                                                            //
+////////////////////////////////////////////////////////////////////////////////
+
+
+// Once a memory arena is set, device data, object caches and queued command payloads must be carved from it, with
+// exact figures: blocks freed after churn merge back into one region large enough for a history spanning most of
+// the arena, and everything returns to it once the last device ends
+
+#include "simulated_bus_test.h"
+
+#include <unistd.h>
+
+#include <atomic>
+#include <thread>
+
+#define ARENA_SIZE ( 1024 * 1024 )
+#define ARENA_ALIGNMENT 64
+#define OBJECT_INDEX 0x2000
+#define OBJECT_SIZE 4096
+#define CHURN_ROUNDS_NUMBER 64
+#define LARGE_HISTORY_LENGTH 50000  // 900 kB in 4 blocks, the largest of 400 kB
+#define COMMAND_TIMEOUT 2.0
+
+static EposArenaStats completionStats;
+static std::atomic<bool> isCommandCompleted( false );
+
+// Called while the command, and its payload, are still held by the worker
+static void CompleteCommand( bool result, void* data )
+{
+  GetMemoryArenaStats( &completionStats );
+  *((bool*) data) = result;
+  isCommandCompleted = true;
+}
+
+static EposArenaStats GetArenaStats( void )
+{
+  EposArenaStats stats = {};
+  GetMemoryArenaStats( &stats );
+  CHECK( stats.usedSize % ARENA_ALIGNMENT == 0, "used size %zu not in whole blocks", stats.usedSize );
+  CHECK( stats.peakUsedSize >= stats.usedSize, "peak used size %zu below %zu", stats.peakUsedSize, stats.usedSize );
+  return stats;
+}
+
+int main( int argc, char* argv[] )
+{
+  CHECK( SetMemoryArena( ARENA_SIZE, false, false ), "arena not set" );
+  EposArenaStats stats = GetArenaStats();
+  size_t pageSize = (size_t) sysconf( _SC_PAGESIZE );
+  CHECK( stats.size >= ARENA_SIZE && stats.size % pageSize == 0, "arena size %zu", stats.size );
+  CHECK( stats.usedSize == 0 && stats.peakUsedSize == 0 && stats.failedAllocationsCount == 0, "fresh arena in use" );
+  CHECK( !stats.isLocked && !stats.isHugePageBacked, "arena locked or hugepage backed" );
+  
+  long int deviceID = InitSimulatedDevice( 0, 1 );
+  if( deviceID == SIGNAL_IO_DEVICE_INVALID_ID ) return 1;
+  size_t deviceSize = GetArenaStats().usedSize;
+  CHECK( deviceSize > 0, "device data not carved from the arena" );
+  CHECK( !SetMemoryArena( ARENA_SIZE, false, false ), "arena replaced while in use" );
+  
+  // Cached object values
+  unsigned char object[ OBJECT_SIZE ] = { 0 };
+  CHECK( WriteDriveObject( deviceID, OBJECT_INDEX, 0x01, object, sizeof(object) ), "object not written" );
+  CHECK( GetArenaStats().usedSize >= deviceSize + OBJECT_SIZE, "object cache not carved from the arena" );
+  CHECK( InvalidateObjectCache( deviceID ), "object cache not invalidated" );
+  CHECK( GetArenaStats().usedSize == deviceSize, "used size %zu after invalidation, %zu before", GetArenaStats().usedSize, deviceSize );
+  
+  // Command queue and payload, plus the cached value written by the command
+  EposCommand command = {};
+  command.type = SIGNAL_IO_EPOS_COMMAND_WRITE_OBJECT;
+  command.index = OBJECT_INDEX;
+  command.subIndex = 0x02;
+  command.data = object;
+  command.size = sizeof(object);
+  bool commandResult = false;
+  CHECK( SubmitCommand( deviceID, &command, CompleteCommand, &commandResult ), "command not submitted" );
+  double timeoutTime = GetTestTime() + COMMAND_TIMEOUT;
+  while( !isCommandCompleted && GetTestTime() < timeoutTime )
+    std::this_thread::sleep_for( std::chrono::milliseconds( 1 ) );
+  CHECK( isCommandCompleted && commandResult, "command not completed" );
+  CHECK( completionStats.usedSize >= deviceSize + 2 * OBJECT_SIZE, "command payload not carved from the arena (%zu used)", completionStats.usedSize );
+  // The worker releases the payload once the completion returns
+  timeoutTime = GetTestTime() + COMMAND_TIMEOUT;
+  while( GetArenaStats().usedSize > completionStats.usedSize - OBJECT_SIZE && GetTestTime() < timeoutTime )
+    std::this_thread::sleep_for( std::chrono::milliseconds( 1 ) );
+  CHECK( GetArenaStats().usedSize <= completionStats.usedSize - OBJECT_SIZE, "command payload not released" );
+  CHECK( InvalidateObjectCache( deviceID ), "object cache not invalidated" );
+  // The idle command worker keeps its queue until the last device ends
+  size_t baseSize = GetArenaStats().usedSize;
+  
+  // Churn of histories and cached values of varying sizes, in interleaved blocks
+  for( size_t roundIndex = 0; roundIndex < CHURN_ROUNDS_NUMBER; roundIndex++ )
+  {
+    CHECK( SetInputHistoryLength( deviceID, 1000 + ( roundIndex * 7919 ) % 20000 ), "history %zu not set", roundIndex );
+    CHECK( WriteDriveObject( deviceID, OBJECT_INDEX, roundIndex % 4, object, 256 * ( 1 + roundIndex % 16 ) ), "object %zu not written", roundIndex );
+  }
+  stats = GetArenaStats();
+  CHECK( stats.peakUsedSize > baseSize + 20000 * 18, "peak used size %zu", stats.peakUsedSize );
+  CHECK( SetInputHistoryLength( deviceID, 0 ) && InvalidateObjectCache( deviceID ), "churn not released" );
+  CHECK( GetArenaStats().usedSize == baseSize, "used size %zu after churn, %zu before", GetArenaStats().usedSize, baseSize );
+  
+  // Only fits if freed blocks merged back
+  CHECK( SetInputHistoryLength( deviceID, LARGE_HISTORY_LENGTH ), "large history not carved after churn" );
+  CHECK( GetArenaStats().failedAllocationsCount == 0, "%lu failed allocations", GetArenaStats().failedAllocationsCount );
+  
+  // Requests that do not fit fail the call and are counted
+  size_t usedSize = GetArenaStats().usedSize;
+  CHECK( !SetInputHistoryLength( deviceID, ARENA_SIZE ), "oversized history set" );
+  stats = GetArenaStats();
+  CHECK( stats.failedAllocationsCount > 0, "failed allocations not counted" );
+  CHECK( stats.usedSize == usedSize, "used size %zu after a failed history, %zu before", stats.usedSize, usedSize );
+  
+  EndDevice( deviceID );
+  stats = GetArenaStats();
+  CHECK( stats.usedSize == 0, "%zu bytes still used after the last device ended", stats.usedSize );
+  CHECK( SetMemoryArena( 0, false, false ), "arena not released" );
+  stats = GetArenaStats();
+  CHECK( stats.size == 0 && stats.usedSize == 0, "arena figures after release" );
+  
+  return failedChecksCount;
+}
@@ -0,0 +1,123 @@
+////////////////////////////////////////////////////////////////////////////////
+//                                                                            //
+//  Copyright (c) 2019 Leonardo Consoni <leonardjc@protonmail.com>            //
+//                                                                            //
+//  This file is part of Signal-IO-EposCmd.                                   //
+//                                                                            //
+//  Signal-IO-EposCmd is free software: you can redistribute it and/or modify //
+//  it under the terms of the GNU Lesser General Public License as published  //
+//  by the Free Software Foundation, either version 3 of the License, or      //
+//  (at your option) any later version.                                       //
+//                                                                            //
+//  Signal-IO-EposCmd is distributed in the hope that it will be useful,      //
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of            //
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the              //
+//  GNU Lesser General Public License for more details.                       //
+//                                                                            //
+//  You should have received a copy of the GNU Lesser General Public License  //
+//  along with Signal-IO-EposCmd. If not, see <http://www.gnu.org/licenses/>. //
+//                                                                            //
+////////////////////////////////////////////////////////////////////////////////
+
+// Cached drive object reads must only go to the bus on misses: in lock-step virtual time, with the transfer thread
+// idle, every bus transaction moves the clock by the simulated transaction time and cache hits leave it unchanged.
+// Values changed behind the cache (here by a second device on the same node) stay stale until invalidation, writes
+// update the cache, short reads are not cached, and resets clear it
+
+#include "simulated_bus_test.h"
+
+#include <stdlib.h>
+
+#define CYCLE_PERIOD 1.0  // Long enough for the transactions of the test to run between two cycles
+#define CYCLE_MARGIN 0.01
+#define OBJECT_INDEX 0x2000
+#define OBJECT_SUB_INDEX 0x01
+
+static double transactionTime = 0.0;
+
+// Runs a call returning true, and counts the bus transactions it took
+template< typename Call >
+static int CountTransactions( Call call )
+{
+  double startTime = GetVirtualTime( NULL );
+  if( !call() ) return -1;
+  return (int) lround( ( GetVirtualTime( NULL ) - startTime ) / transactionTime );
+}
+
+int main( int argc, char* argv[] )
+{
+  const char* transactionTimeValue = getenv( "EPOSCMD_SIMULATION_TRANSACTION_TIME" );
+  transactionTime = ( transactionTimeValue != NULL ) ? strtod( transactionTimeValue, NULL ) : 0.0;
+  if( transactionTime <= 0.0 ) 
+  {
+    fprintf( stderr, "simulation transaction time must be set\n" );
+    return 1;
+  }
+  
+  if( !UseVirtualTime() ) return 1;
+  
+  long int deviceID = InitSimulatedDevice( 0, 1 );
+  long int otherDeviceID = InitSimulatedDevice( 0, 1 );
+  if( deviceID == SIGNAL_IO_DEVICE_INVALID_ID || otherDeviceID == SIGNAL_IO_DEVICE_INVALID_ID ) return 1;
+  SetTransferCycle( CYCLE_PERIOD, false, 0.0 );
+  
+  // Right past a cycle, leaving the whole period to the test transactions
+  double deadline = 0.0;
+  unsigned long waitsCount = 0;
+  CHECK( StepVirtualTime( CYCLE_PERIOD ), "transfer thread not idle" );
+  CHECK( GetTransferWaitState( &deadline, &waitsCount ), "transfer thread not waiting" );
+  CHECK( StepVirtualTime( deadline + CYCLE_MARGIN - GetVirtualTime( NULL ) ), "transfer thread not idle" );
+  
+  unsigned int value = 1, readValue = 0;
+  unsigned short readHalf = 0;
+  unsigned int bytesNumber = 0;
+  CHECK( CountTransactions( [&]{ return WriteDriveObject( otherDeviceID, OBJECT_INDEX, OBJECT_SUB_INDEX, &value, sizeof(value) ); } ) == 1, "object not written" );
+  
+  // The first cached read misses, later ones of at most the same size hit
+  CHECK( CountTransactions( [&]{ return ReadDriveObject( deviceID, OBJECT_INDEX, OBJECT_SUB_INDEX, &readValue, sizeof(readValue), &bytesNumber, true ); } ) == 1, "first read not missed" );
+  CHECK( readValue == 1 && bytesNumber == sizeof(readValue), "first read: %u, %u bytes", readValue, bytesNumber );
+  readValue = 0;
+  CHECK( CountTransactions( [&]{ return ReadDriveObject( deviceID, OBJECT_INDEX, OBJECT_SUB_INDEX, &readValue, sizeof(readValue), &bytesNumber, true ); } ) == 0, "second read missed" );
+  CHECK( readValue == 1 && bytesNumber == sizeof(readValue), "second read: %u, %u bytes", readValue, bytesNumber );
+  CHECK( CountTransactions( [&]{ return ReadDriveObject( deviceID, OBJECT_INDEX, OBJECT_SUB_INDEX, &readHalf, sizeof(readHalf), &bytesNumber, true ); } ) == 0, "shorter read missed" );
+  CHECK( readHalf == 1 && bytesNumber == sizeof(readHalf), "shorter read: %u, %u bytes", readHalf, bytesNumber );
+  
+  // Longer reads miss, and come back short, so that they are not cached
+  unsigned long long readLong = 0;
+  for( int readIndex = 0; readIndex < 2; readIndex++ )
+  {
+    CHECK( CountTransactions( [&]{ return ReadDriveObject( deviceID, OBJECT_INDEX, OBJECT_SUB_INDEX, &readLong, sizeof(readLong), &bytesNumber, true ); } ) == 1, "longer read %d not missed", readIndex );
+    CHECK( bytesNumber == sizeof(value), "longer read %d: %u bytes", readIndex, bytesNumber );
+  }
+  
+  // Changes behind the cache are only seen by uncached reads, until invalidation
+  value = 2;
+  CHECK( WriteDriveObject( otherDeviceID, OBJECT_INDEX, OBJECT_SUB_INDEX, &value, sizeof(value) ), "object not changed" );
+  CHECK( CountTransactions( [&]{ return ReadDriveObject( deviceID, OBJECT_INDEX, OBJECT_SUB_INDEX, &readValue, sizeof(readValue), NULL, true ); } ) == 0 && readValue == 1, "stale read: %u", readValue );
+  CHECK( CountTransactions( [&]{ return ReadDriveObject( deviceID, OBJECT_INDEX, OBJECT_SUB_INDEX, &readValue, sizeof(readValue), NULL, false ); } ) == 1 && readValue == 2, "uncached read: %u", readValue );
+  CHECK( CountTransactions( [&]{ return ReadDriveObject( deviceID, OBJECT_INDEX, OBJECT_SUB_INDEX, &readValue, sizeof(readValue), NULL, true ); } ) == 0 && readValue == 1, "uncached read updated the cache: %u", readValue );
+  CHECK( InvalidateObjectCache( deviceID ), "cache not invalidated" );
+  CHECK( CountTransactions( [&]{ return ReadDriveObject( deviceID, OBJECT_INDEX, OBJECT_SUB_INDEX, &readValue, sizeof(readValue), NULL, true ); } ) == 1 && readValue == 2, "read after invalidation: %u", readValue );
+  
+  // Writes go to the bus and update the cache
+  value = 3;
+  CHECK( CountTransactions( [&]{ return WriteDriveObject( deviceID, OBJECT_INDEX, OBJECT_SUB_INDEX, &value, sizeof(value) ); } ) == 1, "object not written" );
+  CHECK( CountTransactions( [&]{ return ReadDriveObject( deviceID, OBJECT_INDEX, OBJECT_SUB_INDEX, &readValue, sizeof(readValue), NULL, true ); } ) == 0 && readValue == 3, "read after write: %u", readValue );
+  
+  // Failed reads are not cached
+  CHECK( !ReadDriveObject( deviceID, OBJECT_INDEX, OBJECT_SUB_INDEX + 1, &readValue, sizeof(readValue), NULL, true ), "missing object read" );
+  CHECK( CountTransactions( [&]{ return !ReadDriveObject( deviceID, OBJECT_INDEX, OBJECT_SUB_INDEX + 1, &readValue, sizeof(readValue), NULL, true ); } ) == 1, "missing object cached" );
+  
+  // Resets may reconfigure the drive, so that they clear the cache
+  value = 4;
+  CHECK( WriteDriveObject( otherDeviceID, OBJECT_INDEX, OBJECT_SUB_INDEX, &value, sizeof(value) ), "object not changed" );
+  Reset( deviceID );
+  CHECK( CountTransactions( [&]{ return ReadDriveObject( deviceID, OBJECT_INDEX, OBJECT_SUB_INDEX, &readValue, sizeof(readValue), NULL, true ); } ) == 1 && readValue == 4, "read after reset: %u", readValue );
+  
+  CHECK( GetTransferWaitState( &deadline, &waitsCount ) && deadline > GetVirtualTime( NULL ), "cycle run during the test" );
+  
+  EndDevice( otherDeviceID );
+  EndDevice( deviceID );
+  
+  return failedChecksCount;
+}
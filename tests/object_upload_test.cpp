@@ -0,0 +1,145 @@
+////////////////////////////////////////////////////////////////////////////////
+//                                                                            //
+//  Copyright (c) 2019 Leonardo Consoni <leonardjc@protonmail.com>            //
+//                                                                            //
+//  This file is part of Signal-IO-EposCmd.                                   //
+//                                                                            //
+//  Signal-IO-EposCmd is free software: you can redistribute it and/or modify //
+//  it under the terms of the GNU Lesser General Public License as published  //
+//  by the Free Software Foundation, either version 3 of the License, or      //
+//  (at your option) any later version.                                       //
+//                                                                            //
+//  Signal-IO-EposCmd is distributed in the hope that it will be useful,      //
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of            //
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the              //
+//  GNU Lesser General Public License for more details.                       //
+//                                                                            //
+//  You should have received a copy of the GNU Lesser General Public License  //
+//  along with Signal-IO-EposCmd. If not, see <http://www.gnu.org/licenses/>. //
+//                                                                            //
+////////////////////////////////////////////////////////////////////////////////
+
+// Segmented and block SDO uploads must read large drive objects exactly, served by the simulated drive SDO server,
+// while keeping to the cycle frame budget: in lock-step virtual time, feedback reads are deferred during the upload
+// and only its sent frames take bus time, so that no cycle may last more than the budget of frames. Uploads of
+// missing objects or into short buffers are aborted, and cancelled ones leave the SDO server to later transfers
+
+#include "simulated_bus_test.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#define CYCLE_PERIOD 0.005
+#define OBJECT_INDEX 0x2100
+#define SEGMENTED_OBJECT_SIZE 100
+#define BLOCK_OBJECT_SIZE 1000
+#define BUFFER_SIZE 1024
+#define FRAME_BUDGET 8
+#define MAX_UPLOAD_CYCLES 1000
+#define TIME_TOLERANCE 1e-9
+
+#define SDO_ABORT_OBJECT_NOT_FOUND 0x06020000
+#define SDO_ABORT_OUT_OF_MEMORY 0x05040005
+
+static double transactionTime = 0.0;
+
+// Steps cycles until the upload ends, returning their number, or 0 if it took too long
+static int RunUpload( long int deviceID )
+{
+  for( int cycleIndex = 1; cycleIndex <= MAX_UPLOAD_CYCLES; cycleIndex++ )
+  {
+    CHECK( StepVirtualTime( CYCLE_PERIOD ), "transfer thread not idle" );
+    if( GetObjectUploadState( deviceID, NULL, NULL ) != SIGNAL_IO_EPOS_UPLOAD_RUNNING ) return cycleIndex;
+  }
+  return 0;
+}
+
+static void CheckUpload( long int deviceID, unsigned char subIndex, const unsigned char* object, unsigned int objectSize, bool isBlock )
+{
+  static unsigned char buffer[ BUFFER_SIZE ];
+  const char* uploadName = isBlock ? "block" : "segmented";
+  memset( buffer, 0, sizeof(buffer) );
+  EposTransferStats stats;
+  GetTransferStats( &stats, true );
+  CHECK( StartObjectUpload( deviceID, OBJECT_INDEX, subIndex, buffer, sizeof(buffer), isBlock ), "%s upload not started", uploadName );
+  CHECK( !StartObjectUpload( deviceID, OBJECT_INDEX, subIndex, buffer, sizeof(buffer), isBlock ), "second %s upload started", uploadName );
+  double value = 0.0;
+  CHECK( Read( deviceID, 0, &value ) == 0, "feedback read during %s upload", uploadName );
+  int cyclesNumber = RunUpload( deviceID );
+  unsigned int bytesNumber = 0, abortCode = 0;
+  int state = GetObjectUploadState( deviceID, &bytesNumber, &abortCode );
+  CHECK( state == SIGNAL_IO_EPOS_UPLOAD_DONE && bytesNumber == objectSize && abortCode == 0, "%s upload state %d with %u bytes, abort code 0x%08x", uploadName, state, bytesNumber, abortCode );
+  CHECK( memcmp( buffer, object, objectSize ) == 0, "%s upload data", uploadName );
+  CHECK( GetTransferStats( &stats, true ), "transfer statistics not read" );
+  // Sent frames take half a transaction, received ones none
+  CHECK( stats.cycleDurations.maximum <= FRAME_BUDGET * transactionTime / 2 + TIME_TOLERANCE, "%s upload cycles of up to %g s", uploadName, stats.cycleDurations.maximum );
+  CHECK( cyclesNumber > 1, "%s upload done in %d cycles", uploadName, cyclesNumber );
+  printf( "%s upload of %u bytes: %d cycles\n", uploadName, objectSize, cyclesNumber );
+  CHECK( Read( deviceID, 0, &value ) > 0, "feedback read after %s upload", uploadName );
+}
+
+int main( int argc, char* argv[] )
+{
+  const char* transactionTimeValue = getenv( "EPOSCMD_SIMULATION_TRANSACTION_TIME" );
+  transactionTime = ( transactionTimeValue != NULL ) ? strtod( transactionTimeValue, NULL ) : 0.0;
+  if( transactionTime <= 0.0 ) 
+  {
+    fprintf( stderr, "simulation transaction time must be set\n" );
+    return 1;
+  }
+  
+  if( !UseVirtualTime() ) return 1;
+  
+  long int deviceID = InitSimulatedDevice( 0, 1 );
+  if( deviceID == SIGNAL_IO_DEVICE_INVALID_ID ) return 1;
+  SetTransferCycle( CYCLE_PERIOD, false, 0.0 );
+  CHECK( !SetUploadFrameBudget( 0 ), "empty frame budget set" );
+  CHECK( SetUploadFrameBudget( FRAME_BUDGET ), "frame budget not set" );
+  CHECK( StepVirtualTime( CYCLE_PERIOD ), "transfer thread not idle" );
+  
+  // Objects too large for expedited transfers, with every byte different from its neighbours
+  static unsigned char object[ BLOCK_OBJECT_SIZE ];
+  for( unsigned int byteIndex = 0; byteIndex < BLOCK_OBJECT_SIZE; byteIndex++ )
+    object[ byteIndex ] = (unsigned char) ( byteIndex * 7 + 3 );
+  CHECK( WriteDriveObject( deviceID, OBJECT_INDEX, 0x01, object, SEGMENTED_OBJECT_SIZE ), "segmented object not written" );
+  CHECK( WriteDriveObject( deviceID, OBJECT_INDEX, 0x02, object, BLOCK_OBJECT_SIZE ), "block object not written" );
+  CHECK( WriteDriveObject( deviceID, OBJECT_INDEX, 0x03, object, 3 ), "expedited object not written" );
+  
+  CheckUpload( deviceID, 0x01, object, SEGMENTED_OBJECT_SIZE, false );
+  CheckUpload( deviceID, 0x02, object, BLOCK_OBJECT_SIZE, true );
+  
+  // Values of up to 4 bytes come with the initiate response
+  unsigned char smallBuffer[ 4 ] = { 0 };
+  unsigned int bytesNumber = 0, abortCode = 0;
+  CHECK( StartObjectUpload( deviceID, OBJECT_INDEX, 0x03, smallBuffer, sizeof(smallBuffer), false ), "expedited upload not started" );
+  CHECK( RunUpload( deviceID ) == 1, "expedited upload not done in one cycle" );
+  CHECK( GetObjectUploadState( deviceID, &bytesNumber, NULL ) == SIGNAL_IO_EPOS_UPLOAD_DONE && bytesNumber == 3 && memcmp( smallBuffer, object, 3 ) == 0, "expedited upload of %u bytes", bytesNumber );
+  
+  // Aborted by the drive, or by the module for lack of buffer space
+  static unsigned char buffer[ BUFFER_SIZE ];
+  for( int uploadIndex = 0; uploadIndex < 2; uploadIndex++ )
+  {
+    bool isBlock = ( uploadIndex == 1 );
+    CHECK( StartObjectUpload( deviceID, OBJECT_INDEX, 0x04, buffer, sizeof(buffer), isBlock ), "upload of missing object not started" );
+    RunUpload( deviceID );
+    CHECK( GetObjectUploadState( deviceID, NULL, &abortCode ) == SIGNAL_IO_EPOS_UPLOAD_ABORTED && abortCode == SDO_ABORT_OBJECT_NOT_FOUND, "missing object upload abort code 0x%08x", abortCode );
+    CHECK( StartObjectUpload( deviceID, OBJECT_INDEX, 0x01, buffer, SEGMENTED_OBJECT_SIZE - 1, isBlock ), "upload into short buffer not started" );
+    RunUpload( deviceID );
+    CHECK( GetObjectUploadState( deviceID, NULL, &abortCode ) == SIGNAL_IO_EPOS_UPLOAD_ABORTED && abortCode == SDO_ABORT_OUT_OF_MEMORY, "short buffer upload abort code 0x%08x", abortCode );
+  }
+  
+  // Cancelled midway, with responses left behind, before SDO transactions and a new upload
+  CHECK( StartObjectUpload( deviceID, OBJECT_INDEX, 0x02, buffer, sizeof(buffer), true ), "upload to cancel not started" );
+  CHECK( !WriteDriveObject( deviceID, OBJECT_INDEX, 0x03, object, 3 ), "object written during upload" );
+  CHECK( StepVirtualTime( 2 * CYCLE_PERIOD ), "transfer thread not idle" );
+  CHECK( GetObjectUploadState( deviceID, &bytesNumber, NULL ) == SIGNAL_IO_EPOS_UPLOAD_RUNNING && bytesNumber > 0, "upload to cancel with %u bytes", bytesNumber );
+  CHECK( CancelObjectUpload( deviceID ), "upload not cancelled" );
+  CHECK( !CancelObjectUpload( deviceID ), "cancelled upload cancelled again" );
+  CHECK( GetObjectUploadState( deviceID, NULL, &abortCode ) == SIGNAL_IO_EPOS_UPLOAD_IDLE && abortCode == 0, "cancelled upload abort code 0x%08x", abortCode );
+  CHECK( WriteDriveObject( deviceID, OBJECT_INDEX, 0x03, object, 3 ), "object not written after upload" );
+  CheckUpload( deviceID, 0x01, object, SEGMENTED_OBJECT_SIZE, false );
+  
+  EndDevice( deviceID );
+  
+  return failedChecksCount;
+}
@@ -0,0 +1,71 @@
+////////////////////////////////////////////////////////////////////////////////
+//                                                                            //
+//  Copyright (c) 2019 Leonardo Consoni <leonardjc@protonmail.com>            //
+//                                                                            //
+//  This file is part of Signal-IO-EposCmd.                                   //
+//                                                                            //
+//  Signal-IO-EposCmd is free software: you can redistribute it and/or modify //
+//  it under the terms of the GNU Lesser General Public License as published  //
+//  by the Free Software Foundation, either version 3 of the License, or      //
+//  (at your option) any later version.                                       //
+//                                                                            //
+//  Signal-IO-EposCmd is distributed in the hope that it will be useful,      //
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of            //
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the              //
+//  GNU Lesser General Public License for more details.                       //
+//                                                                            //
+//  You should have received a copy of the GNU Lesser General Public License  //
+//  along with Signal-IO-EposCmd. If not, see <http://www.gnu.org/licenses/>. //
+//                                                                            //
+////////////////////////////////////////////////////////////////////////////////
+
+
+// A consumer whose clock runs 1% slow against the module's must get the transfer cycle locked onto its reads:
+// the phase error converges to zero and the period correction to the clock drift. Runs in lock-step virtual time,
+// with reads, which register the consumer phase, right after each consumer period
+
+#include "simulated_bus_test.h"
+
+#include <algorithm>
+
+#define CYCLE_PERIOD 0.005
+#define CONSUMER_PERIOD 0.00505
+#define PHASE_LEAD 0.001
+#define LOCKING_CYCLES_NUMBER 500
+#define LOCKED_CYCLES_NUMBER 200
+#define PHASE_TOLERANCE 1e-5
+#define DRIFT_TOLERANCE 1e-6
+
+int main( int argc, char* argv[] )
+{
+  if( !UseVirtualTime() ) return 1;
+  
+  long int deviceID = InitSimulatedDevice( 0, 1 );
+  if( deviceID == SIGNAL_IO_DEVICE_INVALID_ID ) return 1;
+  CHECK( !SetTransferCycle( CYCLE_PERIOD, true, CYCLE_PERIOD ), "phase lead of a whole period accepted" );
+  CHECK( SetTransferCycle( CYCLE_PERIOD, true, PHASE_LEAD ), "phase locked cycle not set" );
+  
+  double value, phaseError = 0.0, periodCorrection = 0.0;
+  double initialPhaseError = 0.0, maxLockedPhaseError = 0.0;
+  for( int cycleIndex = 0; cycleIndex < LOCKING_CYCLES_NUMBER + LOCKED_CYCLES_NUMBER; cycleIndex++ )
+  {
+    if( !StepVirtualTime( CONSUMER_PERIOD ) )
+    {
+      CHECK( false, "transfer thread not idle at cycle %d", cycleIndex );
+      break;
+    }
+    CHECK( Read( deviceID, 0, &value ) > 0, "position not read at cycle %d", cycleIndex );
+    CHECK( GetTransferCyclePhase( &phaseError, &periodCorrection ), "phase not read" );
+    if( cycleIndex == 1 ) initialPhaseError = phaseError;
+    if( cycleIndex >= LOCKING_CYCLES_NUMBER ) maxLockedPhaseError = std::max( maxLockedPhaseError, fabs( phaseError ) );
+  }
+  
+  printf( "phase error %g s at start, below %g s once locked, period correction %g s\n", initialPhaseError, maxLockedPhaseError, periodCorrection );
+  CHECK( fabs( initialPhaseError ) > 10 * PHASE_TOLERANCE, "consumer already in phase (%g s)", initialPhaseError );
+  CHECK( maxLockedPhaseError < PHASE_TOLERANCE, "phase error %g s once locked", maxLockedPhaseError );
+  CHECK( fabs( periodCorrection - ( CONSUMER_PERIOD - CYCLE_PERIOD ) ) < DRIFT_TOLERANCE, "period correction %g s", periodCorrection );
+  
+  EndDevice( deviceID );
+  
+  return failedChecksCount;
+}
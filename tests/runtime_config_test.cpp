@@ -0,0 +1,125 @@
+////////////////////////////////////////////////////////////////////////////////
+//                                                                            //
+//  Copyright (c) 2019 Leonardo Consoni <leonardjc@protonmail.com>            //
+//                                                                            //
+//  This file is part of Signal-IO-EposCmd.                                   //
+//                                                                            //
+//  Signal-IO-EposCmd is free software: you can redistribute it and/or modify //
+//  it under the terms of the GNU Lesser General Public License as published  //
+//  by the Free Software Foundation, either version 3 of the License, or      //
+//  (at your option) any later version.                                       //
+//                                                                            //
+//  Signal-IO-EposCmd is distributed in the hope that it will be useful,      //
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of            //
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the              //
+//  GNU Lesser General Public License for more details.                       //
+//                                                                            //
+//  You should have received a copy of the GNU Lesser General Public License  //
+//  along with Signal-IO-EposCmd. If not, see <http://www.gnu.org/licenses/>. //
+//                                                                            //
+////////////////////////////////////////////////////////////////////////////////
+
+
+// Device configurations updated while the transfer thread runs take effect as a whole at the next cycle start:
+// input rate dividers, output limits and input filters. Runs in lock-step virtual time, so that cycle
+// times, and the filter response over them, are exact
+
+#include "simulated_bus_test.h"
+
+#include <string.h>
+
+#define CYCLE_PERIOD 0.005
+#define HISTORY_LENGTH 64
+#define RATE_DIVIDER 4
+#define FILTER_TIME 0.02
+#define TIME_TOLERANCE 1e-9
+#define FILTER_STEPS_NUMBER 20
+
+static double ReadPosition( long int deviceID )
+{
+  double position = 0.0;
+  Read( deviceID, 0, &position );
+  return position;
+}
+
+int main( int argc, char* argv[] )
+{
+  if( !UseVirtualTime() ) return 1;
+  
+  long int deviceID = InitSimulatedDevice( 0, 1 );
+  if( deviceID == SIGNAL_IO_DEVICE_INVALID_ID ) return 1;
+  SetTransferCycle( CYCLE_PERIOD, false, 0.0 );
+  CHECK( SetInputHistoryLength( deviceID, HISTORY_LENGTH ), "history not enabled" );
+  CHECK( AcquireOutputChannel( deviceID, 0 ), "position setpoint not acquired" );
+  CHECK( Write( deviceID, 0, 1000.0 ), "position setpoint not written" );
+  CHECK( StepVirtualTime( 10 * CYCLE_PERIOD ), "transfer thread not idle" );
+  CHECK( ReadPosition( deviceID ) == 1000.0, "position %g", ReadPosition( deviceID ) );
+  
+  // Feedback is read every cycle until the update, and every RATE_DIVIDER cycles from the next cycle start on.
+  // The clock stands still between cycles, so that the last full rate sample is stamped with the update time
+  EposDeviceConfig config;
+  CHECK( GetDeviceConfig( deviceID, &config ), "configuration not read" );
+  for( unsigned int channel = 0; channel < SIGNAL_IO_EPOS_INPUT_CHANNELS_NUMBER; channel++ )
+    config.inputRateDividers[ channel ] = RATE_DIVIDER;
+  double updateTime = GetVirtualTime( NULL );
+  CHECK( UpdateDeviceConfig( deviceID, &config ), "rate dividers not accepted" );
+  EposDeviceConfig readConfig;
+  CHECK( GetDeviceConfig( deviceID, &readConfig ) && readConfig.inputRateDividers[ 0 ] == RATE_DIVIDER, "accepted configuration not returned" );
+  CHECK( StepVirtualTime( 4 * RATE_DIVIDER * CYCLE_PERIOD ), "transfer thread not idle" );
+  double times[ HISTORY_LENGTH ], values[ HISTORY_LENGTH ];
+  size_t samplesNumber = ReadInputHistory( deviceID, 0, 0.0, times, values, HISTORY_LENGTH );
+  size_t firstIndex = 0;
+  while( firstIndex < samplesNumber && times[ firstIndex ] <= updateTime ) firstIndex++;
+  CHECK( firstIndex > 1 && samplesNumber - firstIndex == 4, "%zu samples before the update, %zu after", firstIndex, samplesNumber - firstIndex );
+  if( firstIndex > 1 ) 
+    CHECK( fabs( times[ firstIndex - 1 ] - times[ firstIndex - 2 ] - CYCLE_PERIOD ) < TIME_TOLERANCE, "interval %g before the update", times[ firstIndex - 1 ] - times[ firstIndex - 2 ] );
+  for( size_t sampleIndex = firstIndex + 1; sampleIndex < samplesNumber; sampleIndex++ )
+  {
+    double interval = times[ sampleIndex ] - times[ sampleIndex - 1 ];
+    CHECK( fabs( interval - RATE_DIVIDER * CYCLE_PERIOD ) < TIME_TOLERANCE, "interval %g after the update", interval );
+  }
+  
+  // Setpoints are clamped from the next cycle on, and inverted bounds rejected
+  memset( config.inputRateDividers, 0, sizeof(config.inputRateDividers) );
+  config.areOutputLimitsEnabled[ 0 ] = true;
+  config.outputMinimums[ 0 ] = 1500.0;
+  config.outputMaximums[ 0 ] = -500.0;
+  CHECK( !UpdateDeviceConfig( deviceID, &config ), "inverted limits accepted" );
+  config.outputMinimums[ 0 ] = -500.0;
+  config.outputMaximums[ 0 ] = 1500.0;
+  CHECK( UpdateDeviceConfig( deviceID, &config ), "limits not accepted" );
+  CHECK( StepVirtualTime( CYCLE_PERIOD ), "transfer thread not idle" );
+  CHECK( Write( deviceID, 0, 5000.0 ), "position setpoint not written" );
+  CHECK( StepVirtualTime( 4 * CYCLE_PERIOD ), "transfer thread not idle" );
+  CHECK( ReadPosition( deviceID ) == 1500.0, "position %g above the maximum", ReadPosition( deviceID ) );
+  CHECK( Write( deviceID, 0, -5000.0 ), "position setpoint not written" );
+  CHECK( StepVirtualTime( 4 * CYCLE_PERIOD ), "transfer thread not idle" );
+  CHECK( ReadPosition( deviceID ) == -500.0, "position %g below the minimum", ReadPosition( deviceID ) );
+  
+  // A position step is then filtered at each cycle: the remaining error shrinks by FILTER_TIME / ( FILTER_TIME + period )
+  config.areOutputLimitsEnabled[ 0 ] = false;
+  config.inputFilterTimes[ 0 ] = FILTER_TIME;
+  CHECK( UpdateDeviceConfig( deviceID, &config ), "filter not accepted" );
+  CHECK( StepVirtualTime( CYCLE_PERIOD ), "transfer thread not idle" );
+  CHECK( Write( deviceID, 0, 1500.0 ), "position setpoint not written" );
+  double errors[ FILTER_STEPS_NUMBER ];
+  for( int stepIndex = 0; stepIndex < FILTER_STEPS_NUMBER; stepIndex++ )
+  {
+    CHECK( StepVirtualTime( CYCLE_PERIOD ), "transfer thread not idle" );
+    errors[ stepIndex ] = 1500.0 - ReadPosition( deviceID );
+  }
+  double decayRatio = FILTER_TIME / ( FILTER_TIME + CYCLE_PERIOD );
+  int filteredStepsNumber = 0;
+  for( int stepIndex = 1; stepIndex < FILTER_STEPS_NUMBER; stepIndex++ )
+  {
+    if( errors[ stepIndex - 1 ] >= 2000.0 ) continue;
+    CHECK( fabs( errors[ stepIndex ] / errors[ stepIndex - 1 ] - decayRatio ) < 1e-6, "step %d error %g after %g", stepIndex, errors[ stepIndex ], errors[ stepIndex - 1 ] );
+    filteredStepsNumber++;
+  }
+  CHECK( filteredStepsNumber >= FILTER_STEPS_NUMBER - 4, "%d filtered steps", filteredStepsNumber );
+  CHECK( errors[ FILTER_STEPS_NUMBER - 1 ] > 0.0, "filtered position reached the setpoint" );
+  
+  EndDevice( deviceID );
+  
+  return failedChecksCount;
+}
@@ -0,0 +1,62 @@
+////////////////////////////////////////////////////////////////////////////////
+//                                                                            //
+//  Copyright (c) 2019 Leonardo Consoni <leonardjc@protonmail.com>            //
+//                                                                            //
+//  This file is part of Signal-IO-EposCmd.                                   //
+//                                                                            //
+//  Signal-IO-EposCmd is free software: you can redistribute it and/or modify //
+//  it under the terms of the GNU Lesser General Public License as published  //
+//  by the Free Software Foundation, either version 3 of the License, or      //
+//  (at your option) any later version.                                       //
+//                                                                            //
+//  Signal-IO-EposCmd is distributed in the hope that it will be useful,      //
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of            //
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the              //
+//  GNU Lesser General Public License for more details.                       //
+//                                                                            //
+//  You should have received a copy of the GNU Lesser General Public License  //
+//  along with Signal-IO-EposCmd. If not, see <http://www.gnu.org/licenses/>. //
+//                                                                            //
+////////////////////////////////////////////////////////////////////////////////
+
+
+// Setpoints mapped to a synchronous PDO must be left to the transfer thread even in the immediate writes layout,
+// Write() taking no bus time, and reach the drive at the next cycles. Reverting to SDO transmits from the caller again.
+// Runs in lock-step virtual time, where only bus transactions and steps move the clock
+
+#include "simulated_bus_test.h"
+
+#define CYCLE_PERIOD 0.001
+#define SETTLING_TIME ( 10 * CYCLE_PERIOD )
+#define TARGET_POSITION_INDEX 0x607A
+
+int main( int argc, char* argv[] )
+{
+  if( !UseVirtualTime() ) return 1;
+  
+  long int deviceID = InitSimulatedDevice( 0, 1 );
+  if( deviceID == SIGNAL_IO_DEVICE_INVALID_ID ) return 1;
+  SetTransferCycle( CYCLE_PERIOD, false, 0.0 );
+  CHECK( AcquireOutputChannel( deviceID, 0 ), "position setpoint not acquired" );
+  CHECK( !SetSetpointPdo( deviceID, 0, 5, TARGET_POSITION_INDEX, 0x00, true ), "invalid PDO number accepted" );
+  CHECK( SetSetpointPdo( deviceID, 0, 1, TARGET_POSITION_INDEX, 0x00, true ), "setpoint PDO not mapped" );
+  CHECK( StepVirtualTime( CYCLE_PERIOD ), "transfer thread not idle" );
+  
+  double writeTime = GetVirtualTime( NULL );
+  CHECK( Write( deviceID, 0, 1000.0 ), "PDO setpoint not written" );
+  CHECK( GetVirtualTime( NULL ) == writeTime, "PDO setpoint sent from the caller thread" );
+  CHECK( StepVirtualTime( SETTLING_TIME ), "transfer thread not idle" );
+  double position = 0.0;
+  CHECK( Read( deviceID, 0, &position ) > 0 && position == 1000.0, "position %g after the PDO setpoint", position );
+  
+  CHECK( SetSetpointPdo( deviceID, -1, 0, 0, 0x00, false ), "setpoint PDO not unmapped" );
+  writeTime = GetVirtualTime( NULL );
+  CHECK( Write( deviceID, 0, 2000.0 ), "SDO setpoint not written" );
+  CHECK( GetVirtualTime( NULL ) > writeTime, "SDO setpoint not sent from the caller thread" );
+  CHECK( StepVirtualTime( SETTLING_TIME ), "transfer thread not idle" );
+  CHECK( Read( deviceID, 0, &position ) > 0 && position == 2000.0, "position %g after the SDO setpoint", position );
+  
+  EndDevice( deviceID );
+  
+  return failedChecksCount;
+}
@@ -0,0 +1,102 @@
+////////////////////////////////////////////////////////////////////////////////
+//                                                                            //
+//  Copyright (c) 2019 Leonardo Consoni <leonardjc@protonmail.com>            //
+//                                                                            //
+//  This file is part of Signal-IO-EposCmd.                                   //
+//                                                                            //
+//  Signal-IO-EposCmd is free software: you can redistribute it and/or modify //
+//  it under the terms of the GNU Lesser General Public License as published  //
+//  by the Free Software Foundation, either version 3 of the License, or      //
+//  (at your option) any later version.                                       //
+//                                                                            //
+//  Signal-IO-EposCmd is distributed in the hope that it will be useful,      //
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of            //
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the              //
+//  GNU Lesser General Public License for more details.                       //
+//                                                                            //
+//  You should have received a copy of the GNU Lesser General Public License  //
+//  along with Signal-IO-EposCmd. If not, see <http://www.gnu.org/licenses/>. //
+//                                                                            //
+////////////////////////////////////////////////////////////////////////////////
+
+
+// Traced setpoints must get exact stage times in lock-step virtual time, where only bus transactions and steps move
+// the clock: buffered setpoints wait in the queue until the cycle start, then take one transaction to transmit and
+// the feedback reads to read back. Every other setpoint is traced, and overwritten traces are counted as dropped
+
+#include "simulated_bus_test.h"
+
+#include <stdlib.h>
+
+#define CYCLE_PERIOD 0.005
+#define WRITE_LEAD 0.002   // Time from each write to the next cycle start
+#define TRACING_INTERVAL 2
+#define SETPOINTS_NUMBER 20
+#define TIME_TOLERANCE 1e-9
+
+int main( int argc, char* argv[] )
+{
+  const char* transactionTimeValue = getenv( "EPOSCMD_SIMULATION_TRANSACTION_TIME" );
+  double transactionTime = ( transactionTimeValue != NULL ) ? strtod( transactionTimeValue, NULL ) : 0.0;
+  if( transactionTime <= 0.0 ) 
+  {
+    fprintf( stderr, "simulation transaction time must be set\n" );
+    return 1;
+  }
+  
+  if( !UseVirtualTime() ) return 1;
+  
+  long int deviceID = InitSimulatedDevice( 0, 1 );
+  if( deviceID == SIGNAL_IO_DEVICE_INVALID_ID ) return 1;
+  SetTransferCycle( CYCLE_PERIOD, false, 0.0 );
+  CHECK( SetTransferCycleLayout( SIGNAL_IO_EPOS_CYCLE_WRITES_READS, false, NULL, NULL ), "layout not set" );
+  CHECK( AcquireOutputChannel( deviceID, 0 ), "position setpoint not acquired" );
+  CHECK( SetSetpointTracing( TRACING_INTERVAL ), "tracing not enabled" );
+  
+  // Writes land WRITE_LEAD before a cycle start, found by stepping to the wait deadline
+  double deadline = 0.0;
+  unsigned long waitsCount = 0;
+  CHECK( StepVirtualTime( CYCLE_PERIOD ), "transfer thread not idle" );
+  CHECK( GetTransferWaitState( &deadline, &waitsCount ), "transfer thread not waiting" );
+  double writeTime = deadline - WRITE_LEAD;
+  if( writeTime < GetVirtualTime( NULL ) ) writeTime += CYCLE_PERIOD;
+  CHECK( StepVirtualTime( writeTime - GetVirtualTime( NULL ) ), "transfer thread not idle" );
+  for( int setpointIndex = 0; setpointIndex < SETPOINTS_NUMBER; setpointIndex++ )
+  {
+    CHECK( Write( deviceID, 0, 100.0 * setpointIndex ), "setpoint %d not written", setpointIndex );
+    CHECK( StepVirtualTime( CYCLE_PERIOD ), "transfer thread not idle at setpoint %d", setpointIndex );
+  }
+  
+  EposLatencyStats stages[ SIGNAL_IO_EPOS_TRACE_STAGES_NUMBER ];
+  unsigned long droppedTraces = 0;
+  CHECK( GetSetpointTraceStats( deviceID, stages, &droppedTraces ), "trace statistics not read" );
+  // Transmission, then position, velocity and current reads
+  const double STAGE_TIMES[ SIGNAL_IO_EPOS_TRACE_STAGES_NUMBER ] = { WRITE_LEAD + 4 * transactionTime, 0.0, WRITE_LEAD, 0.0, transactionTime, 3 * transactionTime };
+  for( int stage = 0; stage < SIGNAL_IO_EPOS_TRACE_STAGES_NUMBER; stage++ )
+  {
+    printf( "stage %d: %lu traces, %g to %g s\n", stage, stages[ stage ].count, stages[ stage ].minimum, stages[ stage ].maximum );
+    CHECK( stages[ stage ].count == SETPOINTS_NUMBER / TRACING_INTERVAL, "stage %d: %lu traces", stage, stages[ stage ].count );
+    CHECK( fabs( stages[ stage ].minimum - STAGE_TIMES[ stage ] ) < TIME_TOLERANCE && fabs( stages[ stage ].maximum - STAGE_TIMES[ stage ] ) < TIME_TOLERANCE,
+           "stage %d: %g to %g s instead of %g s", stage, stages[ stage ].minimum, stages[ stage ].maximum, STAGE_TIMES[ stage ] );
+  }
+  CHECK( droppedTraces == 0, "%lu traces dropped", droppedTraces );
+  
+  // A traced setpoint overwritten in the queue is dropped, and the overwriting one traced instead.
+  // Changing the interval resets the statistics
+  CHECK( SetSetpointTracing( 1 ), "tracing interval not changed" );
+  CHECK( Write( deviceID, 0, 0.0 ) && Write( deviceID, 0, 100.0 ), "overwritten setpoints not written" );
+  CHECK( StepVirtualTime( CYCLE_PERIOD ), "transfer thread not idle" );
+  CHECK( GetSetpointTraceStats( deviceID, stages, &droppedTraces ), "trace statistics not read" );
+  CHECK( droppedTraces == 1 && stages[ SIGNAL_IO_EPOS_TRACE_ENTRY ].count == 1, "%lu traces dropped, %lu completed", droppedTraces, stages[ SIGNAL_IO_EPOS_TRACE_ENTRY ].count );
+  
+  // Disabled tracing stamps nothing
+  CHECK( SetSetpointTracing( 0 ), "tracing not disabled" );
+  CHECK( Write( deviceID, 0, 200.0 ), "untraced setpoint not written" );
+  CHECK( StepVirtualTime( CYCLE_PERIOD ), "transfer thread not idle" );
+  CHECK( GetSetpointTraceStats( deviceID, stages, &droppedTraces ), "trace statistics not read" );
+  CHECK( stages[ SIGNAL_IO_EPOS_TRACE_ENTRY ].count == 0 && droppedTraces == 0, "%lu traces with tracing disabled", stages[ SIGNAL_IO_EPOS_TRACE_ENTRY ].count );
+  
+  EndDevice( deviceID );
+  
+  return failedChecksCount;
+}
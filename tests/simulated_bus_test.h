@@ -0,0 +1,135 @@
+////////////////////////////////////////////////////////////////////////////////
+//                                                                            //
+//  Copyright (c) 2019 Leonardo Consoni <leonardjc@protonmail.com>            //
+//                                                                            //
+//  This file is part of Signal-IO-EposCmd.                                   //
+//                                                                            //
+//  Signal-IO-EposCmd is free software: you can redistribute it and/or modify //
+//  it under the terms of the GNU Lesser General Public License as published  //
+//  by the Free Software Foundation, either version 3 of the License, or      //
+//  (at your option) any later version.                                       //
+//                                                                            //
+//  Signal-IO-EposCmd is distributed in the hope that it will be useful,      //
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of            //
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the              //
+//  GNU Lesser General Public License for more details.                       //
+//                                                                            //
+//  You should have received a copy of the GNU Lesser General Public License  //
+//  along with Signal-IO-EposCmd. If not, see <http://www.gnu.org/licenses/>. //
+//                                                                            //
+////////////////////////////////////////////////////////////////////////////////
+
+// Helpers shared by the tests run against the simulated EposCmd bus (EPOSCMD_SIMULATION)
+
+#ifndef SIMULATED_BUS_TEST_H
+#define SIMULATED_BUS_TEST_H
+
+#include "interface/signal_io.h"
+#include "signal_io_epos.h"
+#include "epos/simulation.h"
+
+#include <stdio.h>
+#include <math.h>
+
+#include <atomic>
+#include <thread>
+#include <chrono>
+
+DECLARE_MODULE_INTERFACE( SIGNAL_IO_INTERFACE );
+
+// Failed checks are reported and counted, the test returning their number
+static int failedChecksCount = 0;
+
+#define CHECK( condition, ... ) \
+  do { \
+    if( !(condition) ) \
+    { \
+      fprintf( stderr, "%s:%d: check failed: %s (", __FILE__, __LINE__, #condition ); \
+      fprintf( stderr, __VA_ARGS__ ); \
+      fprintf( stderr, ")\n" ); \
+      failedChecksCount++; \
+    } \
+  } while( 0 )
+
+// Simulated CANopen device at the given node of bus CAN<busIndex>
+static inline long int InitSimulatedDevice( unsigned int busIndex, unsigned int nodeId )
+{
+  char configuration[ 64 ];
+  snprintf( configuration, sizeof(configuration), "EPOS4:CANopen:Kvaser:CAN%u:%u:1000000", busIndex, nodeId );
+  return InitDevice( configuration );
+}
+
+static inline double GetTestTime( void )
+{
+  return std::chrono::duration<double>( std::chrono::steady_clock::now().time_since_epoch() ).count();
+}
+
+// Virtual clock shared by the module and the simulated bus. Bus transactions advance it by their duration,
+// and StepVirtualTime() by idle time, so that results do not depend on the host speed
+#define VIRTUAL_START_TIME 1.0
+#define LOCK_STEP_TIMEOUT 10.0  // Wall time the transfer thread gets to go idle, in seconds
+
+static std::atomic<double> virtualTime( VIRTUAL_START_TIME );
+
+static double GetVirtualTime( void* data )
+{
+  return virtualTime.load();
+}
+
+// Only moves forward, as concurrent transactions and steps may race
+static void AdvanceVirtualTime( double time )
+{
+  double lastTime = virtualTime.load();
+  while( time > lastTime && !virtualTime.compare_exchange_weak( lastTime, time ) );
+}
+
+static void DelayVirtualTime( double duration, void* data )
+{
+  double lastTime = virtualTime.load();
+  while( !virtualTime.compare_exchange_weak( lastTime, lastTime + duration ) );
+}
+
+// Called before any device is initialized
+static inline bool UseVirtualTime( void )
+{
+  SetSimulationClock( GetVirtualTime, DelayVirtualTime, NULL );
+  return SetTimeSource( GetVirtualTime, NULL );
+}
+
+// Advances the virtual clock by duration, in lock-step with the transfer thread: each time it waits for a cycle 
+// start within the step, the clock jumps there, and the next jump waits for the cycle (and its bus time) to run.
+// Returns false if the transfer thread never went idle
+static inline bool StepVirtualTime( double duration )
+{
+  double targetTime = virtualTime.load() + duration;
+  double timeoutTime = GetTestTime() + LOCK_STEP_TIMEOUT;
+  while( true )
+  {
+    double deadline = 0.0;
+    unsigned long waitsCount = 0;
+    while( !GetTransferWaitState( &deadline, &waitsCount ) )
+    {
+      if( GetTestTime() > timeoutTime ) return false;
+      std::this_thread::yield();
+    }
+    
+    if( deadline > targetTime )
+    {
+      AdvanceVirtualTime( targetTime );
+      NotifyTimeChange();
+      return true;
+    }
+    
+    // Past the wake up, the thread either waits again (counting a new wait) or stops
+    AdvanceVirtualTime( deadline );
+    NotifyTimeChange();
+    unsigned long lastWaitsCount = waitsCount;
+    while( GetTransferWaitState( &deadline, &waitsCount ) && waitsCount == lastWaitsCount && deadline != HUGE_VAL )
+    {
+      if( GetTestTime() > timeoutTime ) return false;
+      std::this_thread::yield();
+    }
+  }
+}
+
+#endif // SIMULATED_BUS_TEST_H
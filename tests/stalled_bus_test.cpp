@@ -0,0 +1,151 @@
+////////////////////////////////////////////////////////////////////////////////
+//                                                                            //
+//  Copyright (c) 2019 Leonardo Consoni <leonardjc@protonmail.com>            //
+//                                                                            //
+//  This file is part of Signal-IO-EposCmd.                                   //
+//                                                                            //
+//  Signal-IO-EposCmd is free software: you can redistribute it and/or modify //
+//  it under the terms of the GNU Lesser General Public License as published  //
+//  by the Free Software Foundation, either version 3 of the License, or      //
+//  (at your option) any later version.                                       //
+//                                                                            //
+//  Signal-IO-EposCmd is distributed in the hope that it will be useful,      //
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of            //
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the              //
+//  GNU Lesser General Public License for more details.                       //
+//                                                                            //
+//  You should have received a copy of the GNU Lesser General Public License  //
+//  along with Signal-IO-EposCmd. If not, see <http://www.gnu.org/licenses/>. //
+//                                                                            //
+////////////////////////////////////////////////////////////////////////////////
+
+
+// A bus transaction of the transfer thread is held up, as by a drive gone silent, while the consumer
+// calls that only touch statistics, probes, tracing and capture state must still return at once, and
+// EndDevice() must give up on the transfer thread at the shutdown timeout, a capture still running
+
+#include "simulated_bus_test.h"
+
+#include <stdlib.h>
+
+#define STALL_TIME 1.0        // Longest a stalled transaction lasts, in seconds
+#define MAX_CALL_TIME 0.1     // Consumer calls must return well before the stall ends
+#define SHUTDOWN_TIMEOUT 0.2
+#define CAPTURE_FILE_PATH "stalled_bus_capture.json"
+
+static std::atomic<bool> isStallRequested( false );
+static std::atomic<bool> isStalled( false );
+static std::atomic<int> commandResult( -1 );
+
+static double GetStallableTime( void* data )
+{
+  return GetTestTime();
+}
+
+// Transactions started while a stall is requested last STALL_TIME, or until the request is withdrawn
+static void DelayStallable( double duration, void* data )
+{
+  if( isStallRequested.load() )
+  {
+    isStalled = true;
+    double stallEndTime = GetTestTime() + STALL_TIME;
+    while( isStallRequested.load() && GetTestTime() < stallEndTime )
+      std::this_thread::sleep_for( std::chrono::milliseconds( 1 ) );
+    isStalled = false;
+  }
+  std::this_thread::sleep_for( std::chrono::duration<double>( duration ) );
+}
+
+static bool WaitForStall( void )
+{
+  double timeoutTime = GetTestTime() + STALL_TIME;
+  while( !isStalled.load() && GetTestTime() < timeoutTime )
+    std::this_thread::yield();
+  return isStalled.load();
+}
+
+static void CompleteCommand( bool result, void* data )
+{
+  commandResult = result ? 1 : 0;
+}
+
+static bool WaitForCaptureDone( void )
+{
+  double timeoutTime = GetTestTime() + 2 * STALL_TIME;
+  while( !IsCycleCaptureDone() && GetTestTime() < timeoutTime )
+    std::this_thread::sleep_for( std::chrono::milliseconds( 1 ) );
+  return IsCycleCaptureDone();
+}
+
+#define CHECK_CALL_TIME( call ) \
+  do { \
+    double callStartTime = GetTestTime(); \
+    call; \
+    double callTime = GetTestTime() - callStartTime; \
+    CHECK( callTime < MAX_CALL_TIME, "%s took %g s", #call, callTime ); \
+  } while( 0 )
+
+int main( int argc, char* argv[] )
+{
+  SetSimulationClock( GetStallableTime, DelayStallable, NULL );
+  
+  long int deviceID = InitSimulatedDevice( 0, 1 );
+  CHECK( deviceID != SIGNAL_IO_DEVICE_INVALID_ID, "device not initialized" );
+  if( deviceID == SIGNAL_IO_DEVICE_INVALID_ID ) return failedChecksCount;
+  CHECK( AcquireOutputChannel( deviceID, 0 ), "position setpoint not acquired" );
+  CHECK( Write( deviceID, 0, 100.0 ), "position setpoint not written" );
+  
+  isStallRequested = true;
+  CHECK( WaitForStall(), "transfer thread transaction not stalled" );
+  
+  EposTransferStats transferStats;
+  EposLatencyStats latencyStats;
+  unsigned long lostSteps;
+  CHECK_CALL_TIME( GetTransferStats( &transferStats, false ) );
+  CHECK_CALL_TIME( GetCommandFeedbackDelay( deviceID, &latencyStats ) );
+  CHECK_CALL_TIME( CHECK( StartLatencyProbe( deviceID, 0, 10.0, 2 ), "probe not started" ) );
+  CHECK_CALL_TIME( GetLatencyProbeResults( deviceID, &latencyStats, &lostSteps ) );
+  CHECK_CALL_TIME( SetSetpointTracing( 1 ) );
+  CHECK_CALL_TIME( CHECK( StartCycleCapture( 4, 256, CAPTURE_FILE_PATH ), "capture not started" ) );
+  CHECK_CALL_TIME( CHECK( !IsCycleCaptureDone(), "capture done during the stall" ) );
+  CHECK( isStalled.load(), "stall ended before the calls" );
+  
+  isStallRequested = false;
+  
+  CHECK( WaitForCaptureDone(), "capture not done after the stall" );
+  remove( CAPTURE_FILE_PATH );
+  
+  EndDevice( deviceID );
+  
+  // Ending the last device with the transfer thread stalled, after a command worker ran
+  CHECK( SetShutdownTimeout( SHUTDOWN_TIMEOUT ), "shutdown timeout not set" );
+  deviceID = InitSimulatedDevice( 0, 1 );
+  CHECK( deviceID != SIGNAL_IO_DEVICE_INVALID_ID, "device not reinitialized" );
+  if( deviceID == SIGNAL_IO_DEVICE_INVALID_ID ) return failedChecksCount;
+  EposCommand command = {};
+  command.type = SIGNAL_IO_EPOS_COMMAND_RESET;
+  CHECK( SubmitCommand( deviceID, &command, CompleteCommand, NULL ), "command not submitted" );
+  double timeoutTime = GetTestTime() + STALL_TIME;
+  while( commandResult.load() < 0 && GetTestTime() < timeoutTime )
+    std::this_thread::sleep_for( std::chrono::milliseconds( 1 ) );
+  CHECK( commandResult.load() == 1, "command result %d", commandResult.load() );
+  CHECK( StartCycleCapture( 1000, 256, CAPTURE_FILE_PATH ), "second capture not started" );
+  
+  isStallRequested = true;
+  CHECK( WaitForStall(), "transfer thread transaction not stalled again" );
+  double endStartTime = GetTestTime();
+  EndDevice( deviceID );
+  double endTime = GetTestTime() - endStartTime;
+  CHECK( endTime < SHUTDOWN_TIMEOUT + MAX_CALL_TIME, "EndDevice() took %g s", endTime );
+  CHECK( isStalled.load(), "stall ended before EndDevice() returned" );
+  isStallRequested = false;
+  
+  // The transfer thread, left behind, still saves the interrupted capture once unblocked
+  CHECK( WaitForCaptureDone(), "interrupted capture not saved" );
+  FILE* captureFile = fopen( CAPTURE_FILE_PATH, "r" );
+  CHECK( captureFile != NULL, "no capture file" );
+  if( captureFile != NULL ) fclose( captureFile );
+  remove( CAPTURE_FILE_PATH );
+  
+  return failedChecksCount;
+}
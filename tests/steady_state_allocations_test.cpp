@@ -0,0 +1,112 @@
+////////////////////////////////////////////////////////////////////////////////
+//                                                                            //
+//  Copyright (c) 2019 Leonardo Consoni <leonardjc@protonmail.com>            //
+//                                                                            //
+//  This file is part of Signal-IO-EposCmd.                                   //
+//                                                                            //
+//  Signal-IO-EposCmd is free software: you can redistribute it and/or modify //
+//  it under the terms of the GNU Lesser General Public License as published  //
+//  by the Free Software Foundation, either version 3 of the License, or      //
+//  (at your option) any later version.                                       //
+//                                                                            //
+//  Signal-IO-EposCmd is distributed in the hope that it will be useful,      //
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of            //
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the              //
+//  GNU Lesser General Public License for more details.                       //
+//                                                                            //
+//  You should have received a copy of the GNU Lesser General Public License  //
+//  along with Signal-IO-EposCmd. If not, see <http://www.gnu.org/licenses/>. //
+//                                                                            //
+////////////////////////////////////////////////////////////////////////////////
+
+// Once devices run, neither the transfer thread nor Read()/Write() calls may allocate: every operator new
+// call from any thread is counted over a steady state window, with priority fetches, buffered and immediate
+// setpoints, input history and event windows in use
+
+#include "simulated_bus_test.h"
+
+#include <stdlib.h>
+
+#include <atomic>
+#include <new>
+#include <thread>
+
+#define DEVICES_NUMBER 2
+#define CYCLE_PERIOD 0.002
+#define WARM_UP_TIME 0.3
+#define STEADY_STATE_TIME 1.0
+
+static std::atomic<bool> isCounting( false );
+static std::atomic<unsigned long> allocationsCount( 0 );
+
+void* operator new( size_t size )
+{
+  if( isCounting.load( std::memory_order_relaxed ) ) allocationsCount++;
+  void* memory = malloc( size > 0 ? size : 1 );
+  if( memory == NULL ) throw std::bad_alloc();
+  return memory;
+}
+
+void* operator new[]( size_t size ) { return operator new( size ); }
+void* operator new( size_t size, const std::nothrow_t& ) noexcept { try { return operator new( size ); } catch( ... ) { return NULL; } }
+void* operator new[]( size_t size, const std::nothrow_t& ) noexcept { try { return operator new( size ); } catch( ... ) { return NULL; } }
+void operator delete( void* memory ) noexcept { free( memory ); }
+void operator delete[]( void* memory ) noexcept { free( memory ); }
+void operator delete( void* memory, size_t ) noexcept { free( memory ); }
+void operator delete[]( void* memory, size_t ) noexcept { free( memory ); }
+
+// Consumer load of one layout: each loop writes a setpoint and reads every input channel
+static unsigned long RunSteadyState( const long int* devices, int order )
+{
+  SetTransferCycleLayout( order, false, NULL, NULL );
+  
+  double value;
+  double startTime = GetTestTime();
+  unsigned long loopsCount = 0;
+  while( GetTestTime() - startTime < WARM_UP_TIME + STEADY_STATE_TIME )
+  {
+    if( !isCounting && GetTestTime() - startTime > WARM_UP_TIME ) isCounting = true;
+    for( int deviceIndex = 0; deviceIndex < DEVICES_NUMBER; deviceIndex++ )
+    {
+      Write( devices[ deviceIndex ], 0, (double) ( loopsCount % 1000 ) );
+      for( unsigned int channel = 0; channel < SIGNAL_IO_EPOS_INPUT_CHANNELS_NUMBER; channel++ )
+        Read( devices[ deviceIndex ], channel, &value );
+      HasError( devices[ deviceIndex ] );
+    }
+    loopsCount++;
+    std::this_thread::sleep_for( std::chrono::microseconds( 500 ) );
+  }
+  isCounting = false;
+  
+  unsigned long layoutAllocationsCount = allocationsCount.exchange( 0 );
+  printf( "layout %d: %lu loops, %lu allocations\n", order, loopsCount, layoutAllocationsCount );
+  
+  return layoutAllocationsCount;
+}
+
+int main( int argc, char* argv[] )
+{
+  long int devices[ DEVICES_NUMBER ];
+  for( int deviceIndex = 0; deviceIndex < DEVICES_NUMBER; deviceIndex++ )
+  {
+    devices[ deviceIndex ] = InitSimulatedDevice( 0, deviceIndex + 1 );
+    if( devices[ deviceIndex ] == SIGNAL_IO_DEVICE_INVALID_ID ) return 1;
+    AcquireOutputChannel( devices[ deviceIndex ], 0 );
+    SetInputChannelMaxAge( devices[ deviceIndex ], 1, CYCLE_PERIOD / 2, 0.05 );
+    SetInputHistoryLength( devices[ deviceIndex ], 1000 );
+    SetInputRollup( devices[ deviceIndex ], SIGNAL_IO_EPOS_ROLLUP_FINE, 0.01, 100 );
+    SetTargetWindows( devices[ deviceIndex ], 10, 10, 10, 10 );
+  }
+  SetTransferCycle( CYCLE_PERIOD, false, 0.0 );
+  
+  for( int order = SIGNAL_IO_EPOS_CYCLE_IMMEDIATE_WRITES; order <= SIGNAL_IO_EPOS_CYCLE_READS_COMPUTE_WRITES; order++ )
+  {
+    unsigned long layoutAllocationsCount = RunSteadyState( devices, order );
+    CHECK( layoutAllocationsCount == 0, "%lu allocations with layout %d", layoutAllocationsCount, order );
+  }
+  
+  for( int deviceIndex = 0; deviceIndex < DEVICES_NUMBER; deviceIndex++ )
+    EndDevice( devices[ deviceIndex ] );
+  
+  return failedChecksCount;
+}
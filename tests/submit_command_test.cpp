@@ -0,0 +1,176 @@
+////////////////////////////////////////////////////////////////////////////////
+//                                                                            //
+//  Copyright (c) 2019 Leonardo Consoni <leonardjc@protonmail.com>            //
+//                                                                            //
+//  This file is part of Signal-IO-EposCmd.                                   //
+//                                                                            //
+//  Signal-IO-EposCmd is free software: you can redistribute it and/or modify //
+//  it under the terms of the GNU Lesser General Public License as published  //
+//  by the Free Software Foundation, either version 3 of the License, or      //
+//  (at your option) any later version.                                       //
+//                                                                            //
+//  Signal-IO-EposCmd is distributed in the hope that it will be useful,      //
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of            //
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the              //
+//  GNU Lesser General Public License for more details.                       //
+//                                                                            //
+//  You should have received a copy of the GNU Lesser General Public License  //
+//  along with Signal-IO-EposCmd. If not, see <http://www.gnu.org/licenses/>. //
+//                                                                            //
+////////////////////////////////////////////////////////////////////////////////
+
+// Submitted commands must complete in submission order on a worker of their bus, with their own results and copied
+// payloads: a completion holding its worker delays the following commands of that bus only, and a command queued
+// for a device ended meanwhile fails. Invalid submissions are refused at once
+
+#include "simulated_bus_test.h"
+
+#include <stdint.h>
+
+#include <mutex>
+#include <condition_variable>
+#include <vector>
+
+#define WRITES_NUMBER 20
+#define WAIT_TIMEOUT 5.0
+#define OBJECT_INDEX 0x2000
+#define OBJECT_SUB_INDEX 0x01
+
+typedef struct Completion
+{
+  int index;
+  bool result;
+  std::thread::id threadId;
+}
+Completion;
+
+static std::mutex completionsLock;
+static std::condition_variable completionsEvent;
+static std::vector<Completion> completions;
+static bool isWorkerHeld = false;
+
+// Completion data is the command index
+static void Complete( bool result, void* data )
+{
+  std::unique_lock<std::mutex> lock( completionsLock );
+  completions.push_back( { (int) (intptr_t) data, result, std::this_thread::get_id() } );
+  completionsEvent.notify_all();
+}
+
+// Holds the worker until released
+static void CompleteAndHold( bool result, void* data )
+{
+  Complete( result, data );
+  std::unique_lock<std::mutex> lock( completionsLock );
+  completionsEvent.wait_for( lock, std::chrono::duration<double>( WAIT_TIMEOUT ), []{ return !isWorkerHeld; } );
+}
+
+static bool WaitCompletions( size_t completionsNumber )
+{
+  std::unique_lock<std::mutex> lock( completionsLock );
+  return completionsEvent.wait_for( lock, std::chrono::duration<double>( WAIT_TIMEOUT ), [ completionsNumber ]{ return completions.size() >= completionsNumber; } );
+}
+
+static Completion GetCompletion( int index )
+{
+  std::lock_guard<std::mutex> lock( completionsLock );
+  for( const Completion& completion : completions )
+  {
+    if( completion.index == index ) return completion;
+  }
+  return { -1, false, std::thread::id() };
+}
+
+static EposCommand GetWriteCommand( const unsigned int* value )
+{
+  EposCommand command = { SIGNAL_IO_EPOS_COMMAND_WRITE_OBJECT, 0, OBJECT_INDEX, OBJECT_SUB_INDEX, value, sizeof(*value) };
+  return command;
+}
+
+int main( int argc, char* argv[] )
+{
+  long int deviceID = InitSimulatedDevice( 0, 1 );
+  long int sharedBusDeviceID = InitSimulatedDevice( 0, 2 );
+  long int otherBusDeviceID = InitSimulatedDevice( 1, 1 );
+  if( deviceID == SIGNAL_IO_DEVICE_INVALID_ID || sharedBusDeviceID == SIGNAL_IO_DEVICE_INVALID_ID || otherBusDeviceID == SIGNAL_IO_DEVICE_INVALID_ID ) return 1;
+  
+  unsigned int value = 0;
+  EposCommand command = GetWriteCommand( &value );
+  CHECK( !SubmitCommand( deviceID, NULL, Complete, NULL ), "null command submitted" );
+  command.type = SIGNAL_IO_EPOS_COMMANDS_NUMBER;
+  CHECK( !SubmitCommand( deviceID, &command, Complete, NULL ), "invalid command type submitted" );
+  command = GetWriteCommand( &value );
+  command.size = 0;
+  CHECK( !SubmitCommand( deviceID, &command, Complete, NULL ), "empty object write submitted" );
+  command = GetWriteCommand( &value );
+  CHECK( !SubmitCommand( SIGNAL_IO_DEVICE_INVALID_ID, &command, Complete, NULL ), "command for invalid device submitted" );
+  
+  // Payloads are copied on submission, so that the source is reused at once, and written in order
+  int commandIndex = 0;
+  for( ; commandIndex < WRITES_NUMBER; commandIndex++ )
+  {
+    value = commandIndex + 1;
+    CHECK( SubmitCommand( deviceID, &command, Complete, (void*) (intptr_t) commandIndex ), "write %d not submitted", commandIndex );
+  }
+  value = 0;
+  CHECK( WaitCompletions( WRITES_NUMBER ), "%zu of %d writes completed", completions.size(), WRITES_NUMBER );
+  for( int completionIndex = 0; completionIndex < (int) completions.size(); completionIndex++ )
+  {
+    CHECK( completions[ completionIndex ].index == completionIndex && completions[ completionIndex ].result, "completion %d: write %d with result %d", 
+           completionIndex, completions[ completionIndex ].index, completions[ completionIndex ].result );
+    CHECK( completions[ completionIndex ].threadId != std::this_thread::get_id(), "completion %d on the submitting thread", completionIndex );
+  }
+  unsigned int readValue = 0;
+  CHECK( ReadDriveObject( deviceID, OBJECT_INDEX, OBJECT_SUB_INDEX, &readValue, sizeof(readValue), NULL, false ) && readValue == WRITES_NUMBER, "object %u after writes", readValue );
+  
+  // Each command gets its own result
+  EposCommand acquireCommand = { SIGNAL_IO_EPOS_COMMAND_ACQUIRE, 0 };
+  EposCommand invalidAcquireCommand = { SIGNAL_IO_EPOS_COMMAND_ACQUIRE, SIGNAL_IO_EPOS_OUTPUT_CHANNELS_NUMBER };
+  EposCommand warmStartCommand = { SIGNAL_IO_EPOS_COMMAND_RESTORE_WARM_START };
+  EposCommand releaseCommand = { SIGNAL_IO_EPOS_COMMAND_RELEASE, 0 };
+  int firstResultIndex = commandIndex;
+  CHECK( SubmitCommand( deviceID, &acquireCommand, Complete, (void*) (intptr_t) commandIndex++ ), "acquire not submitted" );
+  CHECK( SubmitCommand( deviceID, &invalidAcquireCommand, Complete, (void*) (intptr_t) commandIndex++ ), "invalid acquire not submitted" );
+  CHECK( SubmitCommand( deviceID, &warmStartCommand, Complete, (void*) (intptr_t) commandIndex++ ), "warm start not submitted" );
+  CHECK( SubmitCommand( deviceID, &releaseCommand, Complete, (void*) (intptr_t) commandIndex++ ), "release not submitted" );
+  CHECK( WaitCompletions( commandIndex ), "%zu of %d commands completed", completions.size(), commandIndex );
+  const bool RESULTS[] = { true, false, false, true };
+  for( int resultIndex = 0; resultIndex < 4; resultIndex++ )
+  {
+    Completion completion = GetCompletion( firstResultIndex + resultIndex );
+    CHECK( completion.index >= 0 && completion.result == RESULTS[ resultIndex ], "command %d result %d", firstResultIndex + resultIndex, completion.result );
+  }
+  
+  // A held worker stops its bus only. A device ended behind it gets its queued commands failed
+  {
+    std::lock_guard<std::mutex> lock( completionsLock );
+    completions.clear();
+    isWorkerHeld = true;
+  }
+  value = 1;
+  CHECK( SubmitCommand( deviceID, &command, CompleteAndHold, (void*) 0 ), "holding write not submitted" );
+  CHECK( WaitCompletions( 1 ), "holding write not completed" );
+  CHECK( SubmitCommand( sharedBusDeviceID, &command, Complete, (void*) 1 ), "shared bus write not submitted" );
+  CHECK( SubmitCommand( otherBusDeviceID, &command, Complete, (void*) 2 ), "other bus write not submitted" );
+  CHECK( WaitCompletions( 2 ) && GetCompletion( 2 ).result, "other bus write not completed" );
+  CHECK( GetCompletion( 1 ).index < 0, "shared bus write completed past the held worker" );
+  // Ending waits for the queued command to release the device, so it runs on its own thread, until unregistered
+  std::thread endThread( EndDevice, sharedBusDeviceID );
+  double feedback = 0.0, deadline = GetTestTime() + WAIT_TIMEOUT;
+  while( Read( sharedBusDeviceID, 0, &feedback ) > 0 && GetTestTime() < deadline )
+    std::this_thread::yield();
+  {
+    std::lock_guard<std::mutex> lock( completionsLock );
+    isWorkerHeld = false;
+  }
+  completionsEvent.notify_all();
+  CHECK( WaitCompletions( 3 ), "shared bus write not completed" );
+  Completion completion = GetCompletion( 1 );
+  CHECK( completion.index == 1 && !completion.result, "write for ended device with result %d", completion.result );
+  endThread.join();
+  
+  EndDevice( otherBusDeviceID );
+  EndDevice( deviceID );
+  
+  return failedChecksCount;
+}
@@ -0,0 +1,108 @@
+////////////////////////////////////////////////////////////////////////////////
+//                                                                            //
+//  Copyright (c) 2019 Leonardo Consoni <leonardjc@protonmail.com>            //
+//                                                                            //
+//  This file is part of Signal-IO-EposCmd.                                   //
+//                                                                            //
+//  Signal-IO-EposCmd is free software: you can redistribute it and/or modify //
+//  it under the terms of the GNU Lesser General Public License as published  //
+//  by the Free Software Foundation, either version 3 of the License, or      //
+//  (at your option) any later version.                                       //
+//                                                                            //
+//  Signal-IO-EposCmd is distributed in the hope that it will be useful,      //
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of            //
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the              //
+//  GNU Lesser General Public License for more details.                       //
+//                                                                            //
+//  You should have received a copy of the GNU Lesser General Public License  //
+//  along with Signal-IO-EposCmd. If not, see <http://www.gnu.org/licenses/>. //
+//                                                                            //
+////////////////////////////////////////////////////////////////////////////////
+
+
+// Target events come from the status word the simulated drive sends by TPDO on change: each setpoint must give
+// one target reached event once the position window time elapsed, without any status word SDO read in the cycle.
+// Runs in lock-step virtual time, so that window times are exact
+
+#include "simulated_bus_test.h"
+
+#include <string.h>
+
+#define CYCLE_PERIOD 0.005
+#define POSITION_WINDOW 10
+#define POSITION_WINDOW_TIME 12  // ms, spanning several cycles
+#define CAPTURE_CYCLES_NUMBER 8
+#define CAPTURE_FILE_PATH "target_events_capture.json"
+#define CAPTURE_FILE_MAX_SIZE 65536
+
+static EposEvent ReadTargetEvent( long int deviceID, unsigned int channel )
+{
+  EposEvent event = {};
+  CHECK( ReadEvent( deviceID, channel, &event ), "event %u not read", channel );
+  return event;
+}
+
+// The capture file is only checked for the names of the transactions run
+static bool ReadCaptureFile( char* ref_contents, size_t maxSize )
+{
+  FILE* captureFile = fopen( CAPTURE_FILE_PATH, "r" );
+  if( captureFile == NULL ) return false;
+  size_t size = fread( ref_contents, 1, maxSize - 1, captureFile );
+  ref_contents[ size ] = '\0';
+  fclose( captureFile );
+  remove( CAPTURE_FILE_PATH );
+  return true;
+}
+
+int main( int argc, char* argv[] )
+{
+  if( !UseVirtualTime() ) return 1;
+  
+  // Status words only come by PDO from CANopen devices
+  long int serialDeviceID = InitDevice( "EPOS4:MAXON SERIAL V2:USB:USB0:1:1000000" );
+  CHECK( serialDeviceID != SIGNAL_IO_DEVICE_INVALID_ID, "serial device not initialized" );
+  CHECK( !SetTargetWindows( serialDeviceID, POSITION_WINDOW, POSITION_WINDOW_TIME, 0, 0 ), "windows enabled on a serial device" );
+  EndDevice( serialDeviceID );
+  
+  long int deviceID = InitSimulatedDevice( 0, 1 );
+  if( deviceID == SIGNAL_IO_DEVICE_INVALID_ID ) return 1;
+  SetTransferCycle( CYCLE_PERIOD, false, 0.0 );
+  EposEvent event;
+  CHECK( !ReadEvent( deviceID, SIGNAL_IO_EPOS_EVENT_TARGET_REACHED, &event ), "event read without windows" );
+  CHECK( AcquireOutputChannel( deviceID, 0 ), "position setpoint not acquired" );
+  CHECK( SetTargetWindows( deviceID, POSITION_WINDOW, POSITION_WINDOW_TIME, 0, 0 ), "windows not enabled" );
+  CHECK( ReadTargetEvent( deviceID, SIGNAL_IO_EPOS_EVENT_TARGET_REACHED ).count == 0, "target reached before any setpoint" );
+  
+  double setpoints[ 3 ] = { 1000.0, 2000.0, 2000.0 };
+  for( int setpointIndex = 0; setpointIndex < 3; setpointIndex++ )
+  {
+    CHECK( Write( deviceID, 0, setpoints[ setpointIndex ] ), "setpoint %d not written", setpointIndex );
+    CHECK( StepVirtualTime( CYCLE_PERIOD ), "transfer thread not idle" );
+    event = ReadTargetEvent( deviceID, SIGNAL_IO_EPOS_EVENT_TARGET_REACHED );
+    CHECK( !event.isActive && event.count == (unsigned long) setpointIndex, "setpoint %d: target reached too early (%lu events)", setpointIndex, event.count );
+    CHECK( StepVirtualTime( 4 * CYCLE_PERIOD ), "transfer thread not idle" );
+    event = ReadTargetEvent( deviceID, SIGNAL_IO_EPOS_EVENT_TARGET_REACHED );
+    CHECK( event.isActive && event.count == (unsigned long) setpointIndex + 1, "setpoint %d: %lu target events", setpointIndex, event.count );
+    // The window was already entered at its configuration, the last setpoint being long reached
+    event = ReadTargetEvent( deviceID, SIGNAL_IO_EPOS_EVENT_IN_WINDOW );
+    CHECK( event.isActive && event.count == (unsigned long) setpointIndex + 2, "setpoint %d: %lu window events", setpointIndex, event.count );
+  }
+  
+  // Steady cycles read the status word frames from the receive queue only
+  CHECK( StartCycleCapture( CAPTURE_CYCLES_NUMBER, 1024, CAPTURE_FILE_PATH ), "capture not started" );
+  CHECK( StepVirtualTime( ( CAPTURE_CYCLES_NUMBER + 2 ) * CYCLE_PERIOD ), "transfer thread not idle" );
+  double timeoutTime = GetTestTime() + LOCK_STEP_TIMEOUT;
+  while( !IsCycleCaptureDone() && GetTestTime() < timeoutTime ) 
+    std::this_thread::sleep_for( std::chrono::milliseconds( 1 ) );
+  static char captureContents[ CAPTURE_FILE_MAX_SIZE ];
+  CHECK( IsCycleCaptureDone() && ReadCaptureFile( captureContents, sizeof(captureContents) ), "no capture file" );
+  CHECK( strstr( captureContents, "\"VCS_ReadCANFrame\"" ) != NULL, "status word frames not read" );
+  CHECK( strstr( captureContents, "\"VCS_GetObject\"" ) == NULL, "status word read by SDO" );
+  
+  CHECK( SetTargetWindows( deviceID, 0, 0, 0, 0 ), "windows not disabled" );
+  CHECK( !ReadEvent( deviceID, SIGNAL_IO_EPOS_EVENT_TARGET_REACHED, &event ), "event read after disabling windows" );
+  
+  EndDevice( deviceID );
+  
+  return failedChecksCount;
+}
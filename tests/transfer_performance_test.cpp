@@ -0,0 +1,116 @@
+////////////////////////////////////////////////////////////////////////////////
+//                                                                            //
+//  Copyright (c) 2019 Leonardo Consoni <leonardjc@protonmail.com>            //
+//                                                                            //
+//  This file is part of Signal-IO-EposCmd.                                   //
+//                                                                            //
+//  Signal-IO-EposCmd is free software: you can redistribute it and/or modify //
+//  it under the terms of the GNU Lesser General Public License as published  //
+//  by the Free Software Foundation, either version 3 of the License, or      //
+//  (at your option) any later version.                                       //
+//                                                                            //
+//  Signal-IO-EposCmd is distributed in the hope that it will be useful,      //
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of            //
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the              //
+//  GNU Lesser General Public License for more details.                       //
+//                                                                            //
+//  You should have received a copy of the GNU Lesser General Public License  //
+//  along with Signal-IO-EposCmd. If not, see <http://www.gnu.org/licenses/>. //
+//                                                                            //
+////////////////////////////////////////////////////////////////////////////////
+
+// Transfer cycle rate and read latency floors and ceilings, over 4 devices on 2 simulated buses with the
+// default latency model (0.2 ms per transaction, 1 ms drive response delay), about 4 ms of bus time per cycle.
+// Module and bus run in lock-step virtual time, so that every figure only depends on the latency model and
+// the scheduling code, not on the host: a minute of operation runs in a few seconds, and limits are tight
+
+#include "simulated_bus_test.h"
+
+#define DEVICES_NUMBER 4
+#define CYCLE_PERIOD 0.02
+#define RUN_TIME 60.0
+#define CONSUMER_PERIOD 0.0005
+
+#define MIN_CYCLE_RATE_RATIO 0.99      // Of the configured rate
+#define MAX_MEAN_CYCLE_DURATION 0.0035 // One write and three reads per device
+#define MAX_CYCLE_PERIOD 0.0207        // Cycle starts may be pushed back by a fetch in progress
+#define MAX_INPUT_AGE 0.002
+#define FETCH_TIMEOUT 0.1
+#define MAX_MEAN_FETCH_LATENCY 0.001   // A fetch reads the three channels of its device
+#define MAX_FETCH_LATENCY 0.0015
+
+int main( int argc, char* argv[] )
+{
+  if( !UseVirtualTime() ) return 1;
+  
+  long int devices[ DEVICES_NUMBER ];
+  for( int deviceIndex = 0; deviceIndex < DEVICES_NUMBER; deviceIndex++ )
+  {
+    devices[ deviceIndex ] = InitSimulatedDevice( deviceIndex % 2, deviceIndex / 2 + 1 );
+    if( devices[ deviceIndex ] == SIGNAL_IO_DEVICE_INVALID_ID ) return 1;
+    AcquireOutputChannel( devices[ deviceIndex ], 1 );
+  }
+  // Buffered setpoints, so that consumer calls never wait on the bus themselves
+  SetTransferCycleLayout( SIGNAL_IO_EPOS_CYCLE_WRITES_READS, false, NULL, NULL );
+  SetTransferCycle( CYCLE_PERIOD, false, 0.0 );
+  
+  // Warm up, then measure the settled cycle
+  CHECK( StepVirtualTime( 10 * CYCLE_PERIOD ), "transfer thread not idle" );
+  EposTransferStats stats;
+  GetTransferStats( &stats, true );
+  double startTime = GetVirtualTime( NULL );
+  
+  // Cached reads between cycles
+  double value;
+  size_t readsNumber = 0, consumerStepsNumber = 0;
+  while( GetVirtualTime( NULL ) - startTime < RUN_TIME / 2 )
+  {
+    for( int deviceIndex = 0; deviceIndex < DEVICES_NUMBER; deviceIndex++ )
+    {
+      Write( devices[ deviceIndex ], 1, (double) ( consumerStepsNumber % 100 ) );
+      for( unsigned int channel = 0; channel < SIGNAL_IO_EPOS_INPUT_CHANNELS_NUMBER; channel++ )
+        readsNumber += Read( devices[ deviceIndex ], channel, &value );
+    }
+    if( !StepVirtualTime( CONSUMER_PERIOD ) ) break;
+    consumerStepsNumber++;
+  }
+  CHECK( readsNumber == consumerStepsNumber * DEVICES_NUMBER * SIGNAL_IO_EPOS_INPUT_CHANNELS_NUMBER, "%zu cached reads", readsNumber );
+  
+  // Reads older than the maximum age wait for priority fetches
+  for( int deviceIndex = 0; deviceIndex < DEVICES_NUMBER; deviceIndex++ )
+    SetInputChannelMaxAge( devices[ deviceIndex ], 0, MAX_INPUT_AGE, FETCH_TIMEOUT );
+  size_t fetchReadsNumber = 0, failedReadsNumber = 0;
+  while( GetVirtualTime( NULL ) - startTime < RUN_TIME )
+  {
+    for( int deviceIndex = 0; deviceIndex < DEVICES_NUMBER; deviceIndex++ )
+    {
+      if( Read( devices[ deviceIndex ], 0, &value ) == 0 ) failedReadsNumber++;
+      fetchReadsNumber++;
+    }
+    if( !StepVirtualTime( 2 * MAX_INPUT_AGE ) ) break;
+  }
+  double runTime = GetVirtualTime( NULL ) - startTime;
+  
+  GetTransferStats( &stats, false );
+  double cycleRate = stats.cyclesCount / runTime;
+  printf( "%.1f s: cycles: %lu (%.2f Hz), overruns: %lu, duration mean %.3f ms max %.3f ms, period max %.3f ms\n", runTime,
+          stats.cyclesCount, cycleRate, stats.overrunsCount, stats.cycleDurations.mean * 1e3, stats.cycleDurations.maximum * 1e3,
+          stats.cyclePeriods.maximum * 1e3 );
+  printf( "fetches: %lu mean %.3f ms max %.3f ms, timeouts %lu\n", 
+          stats.fetchLatencies.count, stats.fetchLatencies.mean * 1e3, stats.fetchLatencies.maximum * 1e3, stats.fetchTimeoutsCount );
+  
+  CHECK( runTime >= RUN_TIME, "run stopped after %g s", runTime );
+  CHECK( cycleRate >= MIN_CYCLE_RATE_RATIO / CYCLE_PERIOD, "%.2f Hz", cycleRate );
+  CHECK( stats.overrunsCount == 0, "%lu overruns", stats.overrunsCount );
+  CHECK( stats.cycleDurations.mean <= MAX_MEAN_CYCLE_DURATION, "%g s", stats.cycleDurations.mean );
+  CHECK( stats.cyclePeriods.maximum <= MAX_CYCLE_PERIOD, "%g s", stats.cyclePeriods.maximum );
+  CHECK( stats.fetchLatencies.count > 0 && stats.fetchLatencies.mean <= MAX_MEAN_FETCH_LATENCY, "%g s", stats.fetchLatencies.mean );
+  CHECK( stats.fetchLatencies.maximum <= MAX_FETCH_LATENCY, "%g s", stats.fetchLatencies.maximum );
+  CHECK( stats.fetchTimeoutsCount == 0 && failedReadsNumber == 0, "%lu timeouts, %zu failed reads out of %zu", 
+         stats.fetchTimeoutsCount, failedReadsNumber, fetchReadsNumber );
+  
+  for( int deviceIndex = 0; deviceIndex < DEVICES_NUMBER; deviceIndex++ )
+    EndDevice( devices[ deviceIndex ] );
+  
+  return failedChecksCount;
+}
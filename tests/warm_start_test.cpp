@@ -0,0 +1,106 @@
+////////////////////////////////////////////////////////////////////////////////
+//                                                                            //
+//  Copyright (c) 2019 Leonardo Consoni <leonardjc@protonmail.com>            //
+//                                                                            //
+//  This file is part of Signal-IO-EposCmd.                                   //
+//                                                                            //
+//  Signal-IO-EposCmd is free software: you can redistribute it and/or modify //
+//  it under the terms of the GNU Lesser General Public License as published  //
+//  by the Free Software Foundation, either version 3 of the License, or      //
+//  (at your option) any later version.                                       //
+//                                                                            //
+//  Signal-IO-EposCmd is distributed in the hope that it will be useful,      //
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of            //
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the              //
+//  GNU Lesser General Public License for more details.                       //
+//                                                                            //
+//  You should have received a copy of the GNU Lesser General Public License  //
+//  along with Signal-IO-EposCmd. If not, see <http://www.gnu.org/licenses/>. //
+//                                                                            //
+////////////////////////////////////////////////////////////////////////////////
+
+
+// A warm start record, saved when a standing axis ends, must restore its position once, and be rejected after a
+// power cycle of the drive when a marker is enabled: the simulated drive comes back still and with no logged error, so
+// that only the marker tells. Another device keeps the bus, and so the drive state, alive across device restarts
+
+#include "simulated_bus_test.h"
+
+#include <stdlib.h>
+#include <unistd.h>
+
+#define CYCLE_PERIOD 0.005  // Longer than the bus time of both devices
+#define SETTLING_TIME ( 10 * CYCLE_PERIOD )
+#define MARKER_INDEX 0x2000
+#define MARKER_SUBINDEX 0x10
+
+// Ends the device standing at position, leaving its warm start record
+static void EndAtPosition( long int deviceID, double position )
+{
+  CHECK( AcquireOutputChannel( deviceID, 0 ) && Write( deviceID, 0, position ), "setpoint %g not written", position );
+  CHECK( StepVirtualTime( SETTLING_TIME ), "transfer thread not idle" );
+  EndDevice( deviceID );
+}
+
+// Restarts the device and restores its warm start record, reading back the position then
+static bool RestartAndRestore( long int* ref_deviceID, double* ref_position )
+{
+  *ref_deviceID = InitSimulatedDevice( 0, 1 );
+  if( *ref_deviceID == SIGNAL_IO_DEVICE_INVALID_ID ) return false;
+  bool isRestored = RestoreWarmStart( *ref_deviceID );
+  CHECK( StepVirtualTime( SETTLING_TIME ), "transfer thread not idle" );
+  *ref_position = -1.0;
+  CHECK( Read( *ref_deviceID, 0, ref_position ) > 0, "position not read" );
+  return isRestored;
+}
+
+int main( int argc, char* argv[] )
+{
+  char directoryPath[] = "/tmp/warm_start_test_XXXXXX";
+  if( mkdtemp( directoryPath ) == NULL ) return 1;
+  
+  if( !UseVirtualTime() ) return 1;
+  CHECK( SetWarmStartDirectory( directoryPath ), "warm start directory not set" );
+  CHECK( SetWarmStartMarker( MARKER_INDEX, MARKER_SUBINDEX ), "warm start marker not set" );
+  
+  long int busKeeperID = InitSimulatedDevice( 0, 2 );
+  if( busKeeperID == SIGNAL_IO_DEVICE_INVALID_ID ) return 1;
+  SetTransferCycle( CYCLE_PERIOD, false, 0.0 );
+  
+  // Accepted while the drive stayed powered, only once
+  long int deviceID = InitSimulatedDevice( 0, 1 );
+  if( deviceID == SIGNAL_IO_DEVICE_INVALID_ID ) return 1;
+  CHECK( !RestoreWarmStart( deviceID ), "restored without a record" );
+  EndAtPosition( deviceID, 1000.0 );
+  double position = -1.0;
+  CHECK( RestartAndRestore( &deviceID, &position ), "record rejected" );
+  CHECK( position == 1000.0, "restored position %g", position );
+  CHECK( !RestoreWarmStart( deviceID ), "record restored twice" );
+  
+  // Rejected after a power cycle, the drive starting from 0
+  EndAtPosition( deviceID, 2000.0 );
+  PowerCycleSimulatedNode( "CAN0", 1 );
+  CHECK( !RestartAndRestore( &deviceID, &position ), "record accepted after a power cycle" );
+  CHECK( position == 0.0, "position %g after a rejected record", position );
+  
+  // Without the marker, a clean power cycle goes unnoticed
+  CHECK( SetWarmStartMarker( 0, 0 ), "warm start marker not disabled" );
+  EndAtPosition( deviceID, 3000.0 );
+  PowerCycleSimulatedNode( "CAN0", 1 );
+  CHECK( RestartAndRestore( &deviceID, &position ), "record without marker rejected" );
+  CHECK( position == 3000.0, "restored position %g", position );
+  
+  // Records saved without the marker are rejected once it is enabled
+  EndAtPosition( deviceID, 4000.0 );
+  CHECK( SetWarmStartMarker( MARKER_INDEX, MARKER_SUBINDEX ), "warm start marker not set" );
+  CHECK( !RestartAndRestore( &deviceID, &position ), "record without marker accepted" );
+  CHECK( position == 4000.0, "position %g", position );
+  
+  // No record is left behind
+  SetWarmStartDirectory( NULL );
+  EndDevice( deviceID );
+  EndDevice( busKeeperID );
+  CHECK( rmdir( directoryPath ) == 0, "records left in %s", directoryPath );
+  
+  return failedChecksCount;
+}